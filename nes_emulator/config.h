@@ -37,4 +37,85 @@ typedef enum address_mode
 
 #define EMULATOR_WINDOW_TITLE "NES Emulator"
 
+// Print a trace line in the layout of nestest.log before every instruction, see disassembler.h
 //#define LOGGING
+
+// Dispatch opcodes through a switch instead of the handler table (used to benchmark the two)
+//#define SWITCH_DISPATCH
+
+// Run cpu_exec_batch as a threaded interpreter using computed goto.
+// Needs the GCC/Clang labels as values extension and is ignored elsewhere.
+//#define THREADED_DISPATCH
+
+// Translate basic blocks to x86-64 code and run the interpreter only for what the translator leaves out.
+// Only available in 64-bit x86 builds.
+//#define JIT
+
+// Check every translated block against the interpreter and abort on the first difference
+//#define JIT_VERIFY
+
+// Run known subroutines, such as the 16-bit division of rom/division.bin, as native C when a JSR calls them, see hooks.h
+//#define NATIVE_HOOKS
+
+// Run every hooked routine through the interpreter as well and abort on the first difference
+//#define HOOK_VERIFY
+
+// Drive the bus like the 6502 does: indexed addressing reads the address before the carry into the high byte
+// is fixed, read-modify-write instructions write the value back before the result, and reads where nothing
+// answers see the last value on the bus. Slower, the cpu_dummy_* test ROMs need it.
+//#define BUS_ACCURATE
+
+// Run the PRG-ROM translation written by nes_emulator <rom> --recompile recompiled.c.
+// recompiled.c has to be in the project directory, the emulator falls back to the interpreter for any other ROM.
+//#define RECOMPILED
+
+#if defined(JIT) && !(defined(_M_X64) || defined(__x86_64__))
+#undef JIT
+#endif
+
+// Recompiled blocks write RAM directly, the JIT would not see writes to code it translated
+#if defined(JIT) && defined(RECOMPILED)
+#undef JIT
+#endif
+
+// Recompiled blocks call the routines they reach directly
+#if defined(NATIVE_HOOKS) && defined(RECOMPILED)
+#undef NATIVE_HOOKS
+#endif
+
+// The translated code, the recompiled blocks, the decode cache and the native routines leave out the accesses BUS_ACCURATE adds
+#ifdef BUS_ACCURATE
+#undef JIT
+#undef RECOMPILED
+#undef THREADED_DISPATCH
+#undef NATIVE_HOOKS
+#endif
+
+// The trace is printed by the interpreter, instruction by instruction
+#ifdef LOGGING
+#undef JIT
+#undef RECOMPILED
+#undef THREADED_DISPATCH
+#undef NATIVE_HOOKS
+#endif
+
+// Pre-decoded instructions skip the opcode and operand fetches, BUS_ACCURATE has to see them on the bus
+// and LOGGING traces the instructions execute runs
+#if !defined(BUS_ACCURATE) && !defined(LOGGING)
+#define DECODE_CACHE
+#endif
+
+// Computed goto needs GCC or Clang, and the JIT and the recompiled blocks hook into the portable cpu_exec_batch loop
+#if defined(THREADED_DISPATCH) && (!defined(__GNUC__) || defined(JIT) || defined(RECOMPILED))
+#undef THREADED_DISPATCH
+#endif
+
+#define CACHE_LINE_SIZE	64
+
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#define CACHE_ALIGNED __declspec(align(CACHE_LINE_SIZE))
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#define CACHE_ALIGNED __attribute__((aligned(CACHE_LINE_SIZE)))
+#endif
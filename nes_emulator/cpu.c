@@ -1,41 +1,139 @@
 #include "cpu.h"
 #include <assert.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "memory.h"
+#include "jit.h"
+#include "recompiler.h"
+#include "disassembler.h"
+#include "hooks.h"
 
-static byte read_memory(cpu* cpu, const word address);
-static void write_memory(cpu* cpu, const word address, const byte value);
+static void invalidate_decoded(cpu* cpu, const word address);
 
-static void calc_carry(cpu* cpu, const word value)
+static FORCE_INLINE byte read_memory(cpu* cpu, const word address)
 {
-	if (value & 0xFF00) {
-		cpu_set_c_flag(cpu, 1);
-	}
-	else {
-		cpu_set_c_flag(cpu, 0);
+	const memory_page* page = &cpu->pages[address >> PAGE_SHIFT];
+#ifdef BUS_ACCURATE
+	cpu->open_bus = page->read != NULL ? page->read[address & (PAGE_SIZE - 1)] : page->read_handler(cpu, address);
+	return cpu->open_bus;
+#else
+	if (page->read != NULL)
+	{
+		return page->read[address & (PAGE_SIZE - 1)];
 	}
+	return page->read_handler(cpu, address);
+#endif
 }
 
-static void calc_zero(cpu* cpu, const byte byte)
+static FORCE_INLINE void write_memory(cpu* cpu, const word address, const byte value)
 {
-	if (byte == 0x00) {
-		cpu_set_z_flag(cpu, 1);
+#ifdef BUS_ACCURATE
+	cpu->open_bus = value;
+#endif
+	const memory_page* page = &cpu->pages[address >> PAGE_SHIFT];
+	if (page->write != NULL)
+	{
+		page->write[address & (PAGE_SIZE - 1)] = value;
+		return;
 	}
-	else {
-		cpu_set_z_flag(cpu, 0);
+	page->write_handler(cpu, address, value);
+}
+
+// Zero page and stack accesses can only land in internal RAM, so they skip the page table and I/O handlers
+static FORCE_INLINE byte read_ram(cpu* cpu, const word address)
+{
+#ifdef BUS_ACCURATE
+	cpu->open_bus = cpu->memory.ram[address];
+#endif
+	return cpu->memory.ram[address];
+}
+
+static FORCE_INLINE void write_ram(cpu* cpu, const word address, const byte value)
+{
+#ifdef BUS_ACCURATE
+	cpu->open_bus = value;
+#endif
+	cpu->memory.ram[address] = value;
+
+#ifdef JIT
+	// Code in RAM may have been translated
+	if (cpu->jit != NULL)
+	{
+		jit_invalidate(cpu->jit, address);
 	}
+#endif
 }
 
-static void calc_negative(cpu* cpu, const byte byte)
+// Memory accesses of an instruction's effective address. address_mode is a constant in every handler,
+// so the zero page modes compile down to read_ram and write_ram.
+static FORCE_INLINE bool is_zero_page_mode(const address_mode address_mode)
 {
-	if ((byte & 0b10000000) != 0) {
-		cpu_set_n_flag(cpu, 1);
+	return address_mode == zero_page || address_mode == zero_page_x || address_mode == zero_page_y;
+}
+
+static FORCE_INLINE byte read_address(cpu* cpu, const address_mode address_mode, const word address)
+{
+	return is_zero_page_mode(address_mode) ? read_ram(cpu, address) : read_memory(cpu, address);
+}
+
+static FORCE_INLINE void write_address(cpu* cpu, const address_mode address_mode, const word address, const byte value)
+{
+	if (is_zero_page_mode(address_mode))
+	{
+		write_ram(cpu, address, value);
 	}
-	else {
-		cpu_set_n_flag(cpu, 0);
+	else
+	{
+		write_memory(cpu, address, value);
 	}
 }
 
+static FORCE_INLINE void set_flag(cpu* cpu, const byte flag, const bool value)
+{
+	cpu->p = (cpu->p & ~flag) | (value ? flag : 0);
+}
+
+// While instructions run, N and Z are not kept in p: nz holds the last result and they are worked out when read.
+// Z is set when the low byte is 0, N when bit 7 or bit 8 is set. Bit 8 covers a status with both N and Z set.
+static FORCE_INLINE void set_nz(cpu* cpu, const byte value)
+{
+	cpu->nz = value;
+}
+
+static FORCE_INLINE bool get_n(const cpu* cpu)
+{
+	return (cpu->nz & 0x180) != 0;
+}
+
+static FORCE_INLINE bool get_z(const cpu* cpu)
+{
+	return (byte)cpu->nz == 0;
+}
+
+// Moves N and Z from p to nz before instructions run
+static FORCE_INLINE void load_nz(cpu* cpu)
+{
+	cpu->nz = ((cpu->p & N_FLAG) << 1) | ((cpu->p & Z_FLAG) ? 0 : 1);
+}
+
+// p with N and Z worked out from nz
+static FORCE_INLINE byte get_status(const cpu* cpu)
+{
+	return (cpu->p & ~(N_FLAG | Z_FLAG)) | (get_n(cpu) ? N_FLAG : 0) | (get_z(cpu) ? Z_FLAG : 0);
+}
+
+// Puts N and Z back in p once instructions stop running
+static FORCE_INLINE void store_nz(cpu* cpu)
+{
+	cpu->p = get_status(cpu);
+}
+
+static void calc_carry(cpu* cpu, const word value)
+{
+	set_flag(cpu, C_FLAG, value & 0xFF00);
+}
+
 // http://www.righto.com/2012/12/the-6502-overflow-flag-explained.html
 // Two numbers that have the same sign are added, and the result has a different sign
 static void calc_overflow(cpu* cpu, const word result, const byte operand)
@@ -44,14 +142,7 @@ static void calc_overflow(cpu* cpu, const word result, const byte operand)
 	const byte operand_sign = operand & 0x80;
 	const byte result_sign = result & 0x80;
 
-	if ((a_sign == operand_sign) && a_sign != result_sign)
-	{
-		cpu_set_v_flag(cpu, 1);
-	}
-	else
-	{
-		cpu_set_v_flag(cpu, 0);
-	}
+	set_flag(cpu, V_FLAG, (a_sign == operand_sign) && a_sign != result_sign);
 }
 
 static void calc_add(cpu* cpu, const byte argument)
@@ -60,102 +151,227 @@ static void calc_add(cpu* cpu, const byte argument)
 	calc_carry(cpu, result);
 	calc_overflow(cpu, result, argument);
 	cpu->a = result & 0xFF;
-	calc_zero(cpu, cpu->a);
-	calc_negative(cpu, cpu->a);
+	set_nz(cpu, cpu->a);
+}
+
+// Host memory behind address, NULL where nothing is mapped or only registers are
+static byte* host_address(const cpu* cpu, const word address)
+{
+	const memory* memory = &cpu->memory;
+
+	if (address < RAM_SIZE || (address < RAM_END && memory->image == NULL))
+	{
+		return (byte*)&memory->ram[address & (RAM_SIZE - 1)];
+	}
+	if (memory->image != NULL)
+	{
+		return &memory->image[address];
+	}
+	if (address >= PRG_ROM_START)
+	{
+		return memory->prg_rom != NULL ? (byte*)&memory->prg_rom[(address - PRG_ROM_START) & (memory->prg_rom_size - 1)] : NULL;
+	}
+	if (address >= PRG_RAM_START && memory->prg_ram != NULL)
+	{
+		return &memory->prg_ram[address - PRG_RAM_START];
+	}
+	return NULL;
+}
+
+// Same as host_address, but NULL for the cartridge's PRG-ROM
+static byte* writable_host_address(const cpu* cpu, const word address)
+{
+	if (address >= PRG_ROM_START && cpu->memory.image == NULL)
+	{
+		return NULL;
+	}
+	return host_address(cpu, address);
 }
 
 byte cpu_read_memory(const cpu* cpu, const word address)
 {
-	return cpu->memory.data[address];
+	const byte* data = host_address(cpu, address);
+	return data != NULL ? *data : 0;
 }
 
 void cpu_write_memory(cpu* cpu, const word address, const byte value)
 {
-	cpu->memory.data[address] = value;
+	byte* data = writable_host_address(cpu, address);
+	if (data == NULL)
+	{
+		return;
+	}
+	*data = value;
+
+	// Only a raw image has writable memory there
+	if (address >= PRG_ROM_START && cpu->decode_cache != NULL)
+	{
+		invalidate_decoded(cpu, address);
+	}
+
+#ifdef RECOMPILED
+	// The recompiled blocks are translations of the original PRG-ROM
+	if (address >= PRG_ROM_START)
+	{
+		cpu->recompiled = false;
+	}
+#endif
+
+#ifdef JIT
+	// Code in RAM is translated at its address in $0000-$07FF, writes to the mirrors have to find it there
+	if (cpu->jit != NULL)
+	{
+		const bool in_ram = data >= cpu->memory.ram && data < cpu->memory.ram + RAM_SIZE;
+		jit_invalidate(cpu->jit, in_ram ? (word)(data - cpu->memory.ram) : address);
+	}
+#endif
+}
+
+// Moves the fetch window to the run of pages around pc that follow each other in host memory.
+// It stays empty while pc is in a page of registers or of nothing.
+static void move_fetch_window(cpu* cpu)
+{
+	const int page = cpu->pc >> PAGE_SHIFT;
+	if (cpu->pages[page].read == NULL)
+	{
+		cpu->fetch_size = 0;
+		return;
+	}
+
+	int first = page, last = page;
+	while (first > 0 && cpu->pages[first - 1].read != NULL && cpu->pages[first - 1].read + PAGE_SIZE == cpu->pages[first].read)
+	{
+		first--;
+	}
+	while (last < PAGE_COUNT - 1 && cpu->pages[last].read + PAGE_SIZE == cpu->pages[last + 1].read)
+	{
+		last++;
+	}
+
+	// The PPU registers are never plain memory, so no window covers all 64KB and the size fits in a word
+	cpu->fetch_window = cpu->pages[first].read;
+	cpu->fetch_start = (word)(first << PAGE_SHIFT);
+	cpu->fetch_size = (word)((last - first + 1) << PAGE_SHIFT);
+}
+
+// Host address of the length bytes at pc, NULL when they are not all inside the fetch window after moving it
+static FORCE_INLINE const byte* fetch_address(cpu* cpu, const byte length)
+{
+	if ((word)(cpu->pc - cpu->fetch_start) + length > cpu->fetch_size)
+	{
+		move_fetch_window(cpu);
+		if ((word)(cpu->pc - cpu->fetch_start) + length > cpu->fetch_size)
+		{
+			return NULL;
+		}
+	}
+	return &cpu->fetch_window[(word)(cpu->pc - cpu->fetch_start)];
+}
+
+// Reads the opcode at pc and advances pc past it
+static FORCE_INLINE byte fetch_opcode(cpu* cpu)
+{
+	const byte* bytes = fetch_address(cpu, 1);
+	if (bytes == NULL)
+	{
+		return read_memory(cpu, cpu->pc++);
+	}
+
+	cpu->pc++;
+#ifdef BUS_ACCURATE
+	cpu->open_bus = bytes[0];
+#endif
+	return bytes[0];
 }
 
-static word get_memory_address(cpu* cpu, const address_mode address_mode)
+// Reads the operand bytes that follow the opcode and advances pc past them
+static FORCE_INLINE word fetch_operand(cpu* cpu, const address_mode address_mode)
 {
 	switch (address_mode) {
 		case implicit:
-			assert(false);
-			break;
-
 		case accumulator:
 			break;
 
 		case immediate:
-			return cpu->pc++;
-
 		case zero_page:
-		{
-			const byte value = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			return value;
-		}
-
 		case zero_page_x:
-		{
-			const byte value = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			return (value + cpu->x) & 0x00FF;
-		}
-
 		case zero_page_y:
-		{
-			const byte value = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			return (value + cpu->y) & 0x00FF;
-		}
-
 		case relative:
+		case indexed_indirect:
+		case indirect_indexed:
 		{
-			const byte value = read_memory(cpu, cpu->pc);
+			const byte* bytes = fetch_address(cpu, 1);
+			if (bytes == NULL)
+			{
+				return read_memory(cpu, cpu->pc++);
+			}
 			cpu->pc++;
-			return value;
+#ifdef BUS_ACCURATE
+			cpu->open_bus = bytes[0];
+#endif
+			return bytes[0];
 		}
 
 		case absolute:
+		case absolute_x:
+		case absolute_y:
+		case indirect:
 		{
-			const byte low_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const byte high_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			return  ((word)(high_byte << 8)) | low_byte;
+			const byte* bytes = fetch_address(cpu, 2);
+			if (bytes == NULL)
+			{
+				const byte low_byte = read_memory(cpu, cpu->pc++);
+				const byte high_byte = read_memory(cpu, cpu->pc++);
+				return ((word)(high_byte << 8)) | low_byte;
+			}
+			cpu->pc += 2;
+#ifdef BUS_ACCURATE
+			cpu->open_bus = bytes[1];
+#endif
+			// Compilers turn this into a single unaligned 16-bit load on little-endian hosts
+			return ((word)(bytes[1] << 8)) | bytes[0];
 		}
+	}
+
+	return 0;
+}
+
+// Resolves the effective address from an operand already fetched by fetch_operand or the decode cache
+static FORCE_INLINE word get_memory_address(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	switch (address_mode) {
+		case implicit:
+			assert(false);
+			break;
+
+		case accumulator:
+			break;
+
+		case immediate:
+			// The operand byte is the one right before pc
+			return cpu->pc - 1;
+
+		case zero_page:
+		case relative:
+		case absolute:
+			return operand;
+
+		case zero_page_x:
+			return (operand + cpu->x) & 0x00FF;
+
+		case zero_page_y:
+			return (operand + cpu->y) & 0x00FF;
 
 		case absolute_x:
-		{
-			const byte low_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const byte high_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			word address = ((word)(high_byte << 8)) | low_byte;
-			address += cpu->x;
-			return address;
-		}
+			return operand + cpu->x;
 
 		case absolute_y:
-		{
-			const byte low_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const byte high_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			word address = ((word)(high_byte << 8)) | low_byte;
-			address += cpu->y;
-			return address;
-		}
+			return operand + cpu->y;
 
 		case indirect:
 		{
-			const byte low_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const byte high_byte = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const word address = ((word)(high_byte << 8)) | low_byte;
-
-			const byte indirect_lo_byte = read_memory(cpu, address);
-			const byte indirect_hi_byte = read_memory(cpu, address + 1);
+			const byte indirect_lo_byte = read_memory(cpu, operand);
+			const byte indirect_hi_byte = read_memory(cpu, operand + 1);
 
 			const word indirect_address = ((word)(indirect_hi_byte << 8)) | indirect_lo_byte;
 
@@ -164,20 +380,15 @@ static word get_memory_address(cpu* cpu, const address_mode address_mode)
 
 		case indexed_indirect:
 		{
-
-			const byte vector = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const byte low_byte = read_memory(cpu, (vector + cpu->x) & 0xFF);
-			const byte high_byte = read_memory(cpu, (vector + cpu->x + 1) & 0xFF);
+			const byte low_byte = read_ram(cpu, (operand + cpu->x) & 0xFF);
+			const byte high_byte = read_ram(cpu, (operand + cpu->x + 1) & 0xFF);
 			return ((word)(high_byte << 8)) | low_byte;
 		}
 
 		case indirect_indexed:
 		{
-			const byte vector = read_memory(cpu, cpu->pc);
-			cpu->pc++;
-			const byte low_byte = read_memory(cpu, vector);
-			const byte high_byte = read_memory(cpu, (vector + 1) & 0xFF);
+			const byte low_byte = read_ram(cpu, operand);
+			const byte high_byte = read_ram(cpu, (operand + 1) & 0xFF);
 
 			return (((word)(high_byte << 8)) | low_byte) + cpu->y;
 		}
@@ -186,22 +397,90 @@ static word get_memory_address(cpu* cpu, const address_mode address_mode)
 	return 0;
 }
 
+#ifdef BUS_ACCURATE
+// Indexed addressing first reads from the address the index was added to without the carry into the high byte.
+// Reads only do it when there is a carry, writes and read-modify-write instructions always do.
+static FORCE_INLINE void dummy_read(cpu* cpu, const address_mode address_mode, const word address, const bool always)
+{
+	if (address_mode == absolute_x || address_mode == absolute_y || address_mode == indirect_indexed)
+	{
+		const byte index = address_mode == absolute_x ? cpu->x : cpu->y;
+		const word uncarried = ((address - index) & 0xFF00) | (address & 0x00FF);
+		if (always || uncarried != address)
+		{
+			read_memory(cpu, uncarried);
+		}
+	}
+}
+#endif
+
+// The cycle an indexed read takes more when the index carries into the high byte of the address.
+// The dispatchers add it for the opcodes opcodes.h marks with page_cycle.
+static FORCE_INLINE byte page_cross_cycles(const cpu* cpu, const address_mode address_mode, const word operand)
+{
+	switch (address_mode)
+	{
+		case absolute_x:
+			return ((operand & 0xFF) + cpu->x) >> 8;
+		case absolute_y:
+			return ((operand & 0xFF) + cpu->y) >> 8;
+		case indirect_indexed:
+			return (cpu->memory.ram[operand & 0xFF] + cpu->y) >> 8;
+		default:
+			return 0;
+	}
+}
+
+// Reads the value an instruction operates on. Immediate operands are used as they are.
+static FORCE_INLINE byte read_argument(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	if (address_mode == immediate)
+	{
+		return (byte)operand;
+	}
+
+	const word address = get_memory_address(cpu, address_mode, operand);
+#ifdef BUS_ACCURATE
+	dummy_read(cpu, address_mode, address, false);
+#endif
+	return read_address(cpu, address_mode, address);
+}
+
+// Effective address of a store or a read-modify-write instruction
+static FORCE_INLINE word get_write_address(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_memory_address(cpu, address_mode, operand);
+#ifdef BUS_ACCURATE
+	dummy_read(cpu, address_mode, address, true);
+#endif
+	return address;
+}
+
+// Stores the result of a read-modify-write instruction, which writes the value it read once more before it
+static FORCE_INLINE void write_modified(cpu* cpu, const address_mode address_mode, const word address, const byte value, const byte result)
+{
+#ifdef BUS_ACCURATE
+	write_address(cpu, address_mode, address, value);
+#endif
+	write_address(cpu, address_mode, address, result);
+}
+
 void cpu_stack_push_16(cpu* cpu, const word val)
 {
-	write_memory(cpu, STACK_BASE + cpu->sp, (val >> 8) & 0xFF);
-	write_memory(cpu, STACK_BASE + (cpu->sp - 1), val & 0xFF);
+	write_ram(cpu, STACK_BASE + cpu->sp, (val >> 8) & 0xFF);
+	write_ram(cpu, STACK_BASE + (cpu->sp - 1), val & 0xFF);
 	cpu->sp -= 2;
 }
 
 void cpu_stack_push_8(cpu* cpu, const byte val)
 {
-	write_memory(cpu, STACK_BASE + cpu->sp, val);
+	write_ram(cpu, STACK_BASE + cpu->sp, val);
 	cpu->sp--;
 }
 
 word cpu_stack_pop_16(cpu* cpu)
 {
-	const word result = (word)(read_memory(cpu, STACK_BASE + (cpu->sp + 2)) << 8) | (word)read_memory(cpu, STACK_BASE + (cpu->sp + 1));
+	const word result = (word)(read_ram(cpu, STACK_BASE + (cpu->sp + 2)) << 8) | (word)read_ram(cpu, STACK_BASE + (cpu->sp + 1));
 	cpu->sp += 2;
 	return result;
 }
@@ -209,43 +488,173 @@ word cpu_stack_pop_16(cpu* cpu)
 byte cpu_stack_pop_8(cpu* cpu)
 {
 	cpu->sp++;
-	return  read_memory(cpu, STACK_BASE + cpu->sp);
+	return  read_ram(cpu, STACK_BASE + cpu->sp);
 }
 
-static byte read_memory(cpu* cpu, word address)
+// The eight PPU registers repeat every 8 bytes through $3FFF. A raw image only has them at $2000-$2007.
+static FORCE_INLINE bool is_ppu_register(const cpu* cpu, const word address)
 {
-	switch (address)
+	return cpu->memory.image == NULL || address <= PPU_DATA;
+}
+
+// Addresses with neither memory nor registers behind them
+static byte read_unmapped(cpu* cpu, const word address)
+{
+#ifdef BUS_ACCURATE
+	// Nothing drives the bus, the last value on it is read back
+	return cpu->open_bus;
+#else
+	return 0;
+#endif
+}
+
+// PPU_DATA reads and writes move the VRAM address by 1, or by 32 to go down a name table column
+static void increment_ppu_data_addr(cpu* cpu)
+{
+	if (cpu->ppu.registers.ppu_ctrl & 0b00000100)
 	{
-		case PPU_CTRL:
-		case PPU_MASK:
-		case PPU_SCROLL:
-			// Do nothing. Write-only registers
-			return 0;
+		cpu->ppu.ppu_data_addr += 32;
+	}
+	else
+	{
+		cpu->ppu.ppu_data_addr += 1;
+	}
+}
 
+// The PPU holds the NMI line up while it is in vblank with NMI enabled in PPU_CTRL
+static void update_ppu_nmi(cpu* cpu)
+{
+	cpu_set_nmi(cpu, (cpu->ppu.registers.ppu_status & cpu->ppu.registers.ppu_ctrl & 0x80) != 0);
+}
+
+// The PPU catches up to the end of the cycle the CPU is in, before the CPU accesses its registers
+void cpu_sync_ppu(cpu* cpu)
+{
+	const uint64_t frames = cpu->ppu.frames;
+	ppu_run(&cpu->ppu, cpu->cycles * DOTS_PER_CPU_CYCLE);
+
+	// The line went down at the end of the last vblank even when no access saw it
+	if (cpu->ppu.frames != frames)
+	{
+		cpu_set_nmi(cpu, false);
+	}
+	update_ppu_nmi(cpu);
+}
+
+// Reading PPU_STATUS clears the vblank flag and the PPU_SCROLL/PPU_ADDR latch
+static byte read_ppu_status(cpu* cpu)
+{
+	const byte status = cpu->ppu.registers.ppu_status;
+	cpu->ppu.registers.ppu_status &= 0x7F;
+	cpu->ppu.ppu_latch = false;
+	update_ppu_nmi(cpu);
+	return status;
+}
+
+// VRAM reads come out of a buffer the read refills, but for the palette, which is read directly.
+// The buffer then gets the name table byte under the palette.
+static byte read_ppu_data(cpu* cpu)
+{
+	const word address = cpu->ppu.ppu_data_addr & 0x3FFF;
+	byte value = cpu->ppu.registers.ppu_data;
+
+	if (address >= PALETTE_BASE)
+	{
+		value = ppu_read_vram(&cpu->ppu, address);
+		cpu->ppu.registers.ppu_data = ppu_read_vram(&cpu->ppu, address - 0x1000);
+	}
+	else
+	{
+		cpu->ppu.registers.ppu_data = ppu_read_vram(&cpu->ppu, address);
+	}
+
+	increment_ppu_data_addr(cpu);
+	return value;
+}
+
+// $2000-$3FFF
+static byte read_ppu_page(cpu* cpu, const word address)
+{
+	if (!is_ppu_register(cpu, address))
+	{
+		return cpu_read_memory(cpu, address);
+	}
+	cpu_sync_ppu(cpu);
+
+#ifdef BUS_ACCURATE
+	// Write-only registers and the low bits of PPU_STATUS read back the last value the PPU latched off its bus
+	switch (PPU_CTRL | (address & 0x7))
+	{
+		case PPU_STATUS:
+			cpu->ppu.io_latch = (read_ppu_status(cpu) & 0xE0) | (cpu->ppu.io_latch & 0x1F);
+			break;
+		case OAM_DATA:
+			cpu->ppu.io_latch = cpu->ppu.oam.data[cpu->ppu.registers.oam_addr];
+			break;
+		case PPU_DATA:
+			cpu->ppu.io_latch = read_ppu_data(cpu);
+			break;
+		default:
+			break;
+	}
+	return cpu->ppu.io_latch;
+#else
+	switch (PPU_CTRL | (address & 0x7))
+	{
 		case PPU_STATUS:
-			cpu->ppu.ppu_latch = false;
-			return cpu->ppu.registers.ppu_status;
+			return read_ppu_status(cpu);
 		case OAM_ADDR:
 			return cpu->ppu.registers.oam_addr;
 		case OAM_DATA:
-			return cpu->ppu.registers.oam_data;
+			return cpu->ppu.oam.data[cpu->ppu.registers.oam_addr];
 		case PPU_ADDR:
 			return cpu->ppu.registers.ppu_addr;
 		case PPU_DATA:
-			return cpu->ppu.registers.ppu_data;
-		case CONTROLLER_1:
-			return read_next_button(cpu->controller);
+			return read_ppu_data(cpu);
 		default:
-			return cpu_read_memory(cpu, address);
+			// Do nothing. Write-only registers
+			return 0;
 	}
+#endif
 }
 
-static void write_memory(cpu* cpu, word address, const byte value)
+// $4000-$43FF
+static byte read_io_page(cpu* cpu, const word address)
 {
-	switch (address)
+	if (address == CONTROLLER_1)
+	{
+#ifdef BUS_ACCURATE
+		// The controller only drives the low bits
+		return (cpu->open_bus & 0xE0) | read_next_button(cpu->controller);
+#else
+		return read_next_button(cpu->controller);
+#endif
+	}
+
+	const byte* data = host_address(cpu, address);
+	return data != NULL ? *data : read_unmapped(cpu, address);
+}
+
+static void write_ppu_page(cpu* cpu, const word address, const byte value)
+{
+	if (!is_ppu_register(cpu, address))
+	{
+		cpu_write_memory(cpu, address, value);
+		return;
+	}
+	cpu_sync_ppu(cpu);
+
+#ifdef BUS_ACCURATE
+	cpu->ppu.io_latch = value;
+#endif
+
+	switch (PPU_CTRL | (address & 0x7))
 	{
 		case PPU_CTRL:
+			// Enabling NMI during vblank raises the line right away
 			cpu->ppu.registers.ppu_ctrl = value;
+			cpu->ppu.ppu_temp_addr = (cpu->ppu.ppu_temp_addr & ~0x0C00) | ((value & NAME_TABLE_ADDR_FLAGS) << 10);
+			update_ppu_nmi(cpu);
 			break;
 		case PPU_MASK:
 			cpu->ppu.registers.ppu_mask = value;
@@ -258,18 +667,21 @@ static void write_memory(cpu* cpu, word address, const byte value)
 			break;
 		case OAM_DATA:
 			cpu->ppu.registers.oam_data = value;
+			cpu->ppu.oam.data[cpu->ppu.registers.oam_addr++] = value;
 			break;
 
 		case PPU_SCROLL:
 		{
+			// X goes to coarse x and fine x, then Y to coarse y and fine y
 			if (cpu->ppu.ppu_latch)
 			{
-				cpu->ppu.registers.ppu_scroll_y = value;
+				cpu->ppu.ppu_temp_addr = (cpu->ppu.ppu_temp_addr & ~0x73E0) | ((value & 0x07) << 12) | ((value & 0xF8) << 2);
 				cpu->ppu.ppu_latch = false;
 			}
 			else
 			{
-				cpu->ppu.registers.ppu_scroll_x = value;
+				cpu->ppu.ppu_temp_addr = (cpu->ppu.ppu_temp_addr & ~0x001F) | (value >> 3);
+				cpu->ppu.fine_x = value & 0x07;
 				cpu->ppu.ppu_latch = true;
 			}
 		}
@@ -277,40 +689,53 @@ static void write_memory(cpu* cpu, word address, const byte value)
 
 		case PPU_ADDR:
 		{
+			// The high byte waits in t, PPU_DATA and rendering keep using the old address until the low byte comes
 			if (cpu->ppu.ppu_latch)
 			{
-				cpu->ppu.ppu_data_addr |= (word)value;
+				cpu->ppu.ppu_temp_addr = (cpu->ppu.ppu_temp_addr & 0xFF00) | value;
+				cpu->ppu.ppu_data_addr = cpu->ppu.ppu_temp_addr;
 				cpu->ppu.ppu_latch = false;
 			}
 			else
 			{
-				cpu->ppu.ppu_data_addr = (word)(value << 8);
+				cpu->ppu.registers.ppu_addr = value & 0x3F;
+				cpu->ppu.ppu_temp_addr = (cpu->ppu.ppu_temp_addr & 0x00FF) | ((value & 0x3F) << 8);
 				cpu->ppu.ppu_latch = true;
 			}
-			assert(cpu->ppu.ppu_data_addr < VRAM_SIZE);
 		}
 		break;
 
 		case PPU_DATA:
-			assert(cpu->ppu.ppu_data_addr <= VRAM_SIZE - 1);
-			cpu->ppu.memory.data[cpu->ppu.ppu_data_addr] = value;
-			if (cpu->ppu.registers.ppu_ctrl & 0b00000100)
-			{
-				cpu->ppu.ppu_data_addr += 32;
-			}
-			else
-			{
-				cpu->ppu.ppu_data_addr += 1;
-			}
+			ppu_write_vram(&cpu->ppu, cpu->ppu.ppu_data_addr, value);
+			increment_ppu_data_addr(cpu);
 			break;
+	}
+}
 
+static void write_io_page(cpu* cpu, const word address, const byte value)
+{
+	switch (address)
+	{
 		case OAM_DMA:
 		{
-			for (word i = 0; i < 256; ++i)
+			// A page of plain memory is copied in one go, one with registers byte by byte through their handlers
+			cpu_sync_ppu(cpu);
+			const word source = (word)(value << 8);
+			const memory_page* page = &cpu->pages[source >> PAGE_SHIFT];
+			if (page->read != NULL)
+			{
+				memcpy(cpu->ppu.oam.data, &page->read[source & (PAGE_SIZE - 1)], OAM_SIZE);
+			}
+			else
 			{
-				const word oam_copy_address = (word)(value << 8) + i;
-				cpu->ppu.oam.data[i] = read_memory(cpu, oam_copy_address);
+				for (word i = 0; i < OAM_SIZE; ++i)
+				{
+					cpu->ppu.oam.data[i] = read_memory(cpu, source + i);
+				}
 			}
+
+			// The CPU is halted while the DMA runs, a cycle longer when it has to wait for an even cycle first
+			cpu->cycles += OAM_DMA_CYCLES + (cpu->cycles & 1);
 		}
 		break;
 
@@ -322,465 +747,328 @@ static void write_memory(cpu* cpu, word address, const byte value)
 	}
 }
 
-static void lda(cpu* cpu, const address_mode address_mode)
+void cpu_map_memory(cpu* cpu)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	cpu->a = read_memory(cpu, address);
+	for (int page = 0; page < PAGE_COUNT; page++)
+	{
+		const word address = (word)(page << PAGE_SHIFT);
 
-	calc_zero(cpu, cpu->a);
-	calc_negative(cpu, cpu->a);
+		// Raw image writes to PRG-ROM have to reach the decode cache, and with a translation cache any write may hit translated code
+		cpu->pages[page].read = host_address(cpu, address);
+		cpu->pages[page].write = address < PRG_ROM_START && cpu->jit == NULL ? writable_host_address(cpu, address) : NULL;
+		cpu->pages[page].read_handler = read_unmapped;
+		cpu->pages[page].write_handler = cpu_write_memory;
+	}
 
-#ifdef LOGGING
-	printf("LDA %x\n", cpu->a);
-#endif
+	const int ppu_pages = cpu->memory.image != NULL ? 1 : (0x4000 - PPU_CTRL) >> PAGE_SHIFT;
+	for (int page = 0; page < ppu_pages; page++)
+	{
+		cpu->pages[(PPU_CTRL >> PAGE_SHIFT) + page] = (memory_page){ NULL, NULL, read_ppu_page, write_ppu_page };
+	}
+	cpu->pages[OAM_DMA >> PAGE_SHIFT] = (memory_page){ NULL, NULL, read_io_page, write_io_page };
+
+	// The next fetch finds the window again
+	cpu->fetch_size = 0;
 }
 
-static void ldx(cpu* cpu, const address_mode address_mode)
+void cpu_clear_memory(cpu* cpu)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	cpu->x = read_memory(cpu, address);
-	calc_zero(cpu, cpu->x);
-	calc_negative(cpu, cpu->x);
-#ifdef LOGGING
-	printf("LDX %x\n", cpu->x);
-#endif
+	memset(&cpu->memory, 0, sizeof(cpu->memory));
+	cpu->ppu.memory.chr = NULL;
+	cpu->ppu.memory.chr_writable = false;
+	cpu->ppu.memory.tile_rows = NULL;
 }
 
-static void ldy(cpu* cpu, const address_mode address_mode)
+void cpu_load_cartridge(cpu* cpu, const byte* prg_rom, const uint32_t prg_rom_size, byte* prg_ram)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	cpu->y = read_memory(cpu, address);
-	calc_zero(cpu, cpu->y);
-	calc_negative(cpu, cpu->y);
-#ifdef LOGGING
-	printf("LDY %x\n", cpu->y);
-#endif
+	cpu->memory.prg_rom = prg_rom;
+	cpu->memory.prg_rom_size = prg_rom_size;
+	cpu->memory.prg_ram = prg_ram;
+	cpu->memory.image = NULL;
+}
+
+void cpu_load_image(cpu* cpu, byte* image)
+{
+	memcpy(cpu->memory.ram, image, RAM_SIZE);
+	cpu->memory.image = image;
+}
+
+
+
+byte cpu_read_bus(cpu* cpu, const word address)
+{
+	return read_memory(cpu, address);
+}
+
+void cpu_write_bus(cpu* cpu, const word address, const byte value)
+{
+	write_memory(cpu, address, value);
+}
+
+static FORCE_INLINE void lda(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->a = read_argument(cpu, address_mode, operand);
+
+	set_nz(cpu, cpu->a);
+}
+
+static FORCE_INLINE void ldx(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->x = read_argument(cpu, address_mode, operand);
+	set_nz(cpu, cpu->x);
+}
+
+static FORCE_INLINE void ldy(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->y = read_argument(cpu, address_mode, operand);
+	set_nz(cpu, cpu->y);
 }
 
 // Add with Carry
-static void adc(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void adc(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const byte memory = read_argument(cpu, address_mode, operand);
 	calc_add(cpu, memory);
-
-#ifdef LOGGING
-	printf("ADC %x\n", memory);
-#endif
 }
 
 // Logical AND
-static void AND(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void AND(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte value = read_memory(cpu, address);
+	const byte value = read_argument(cpu, address_mode, operand);
 	cpu->a &= value;
-	calc_negative(cpu, cpu->a);
-	calc_zero(cpu, cpu->a);
-#ifdef LOGGING
-	printf("AND %x\n", read_memory(cpu, address));
-#endif
+	set_nz(cpu, cpu->a);
 }
 
 // Arithmetic Shift Left
-static void asl(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void asl(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	if (address_mode == accumulator)
 	{
-		cpu_set_c_flag(cpu, ((cpu->a & 0b10000000) ? 1 : 0));
+		set_flag(cpu, C_FLAG, ((cpu->a & 0b10000000) ? 1 : 0));
 		cpu->a <<= 1;
 
-		calc_negative(cpu, cpu->a);
-		calc_zero(cpu, cpu->a);
-#ifdef LOGGING
-		puts("ASL");
-#endif
+		set_nz(cpu, cpu->a);
 	}
 	else {
-		const word address = get_memory_address(cpu, address_mode);
-		const byte value = read_memory(cpu, address);
-		cpu_set_c_flag(cpu, (value & 0b10000000 ? 1 : 0));
+		const word address = get_write_address(cpu, address_mode, operand);
+		const byte value = read_address(cpu, address_mode, address);
+		set_flag(cpu, C_FLAG, (value & 0b10000000 ? 1 : 0));
 		const byte new_value = (byte)(value << 1);
-		write_memory(cpu, address, new_value);
+		write_modified(cpu, address_mode, address, value, new_value);
 
-		calc_negative(cpu, new_value);
-		calc_zero(cpu, new_value);
-
-#ifdef LOGGING
-		printf("ASL %x <%x>\n", address, new_value);
-#endif
+		set_nz(cpu, new_value);
 	}
 }
 
-// Branch if Carry Clear
-static void bcc(cpu* cpu, const address_mode address_mode)
+// Taken branches take a cycle more, two when they land in another page
+static FORCE_INLINE void branch(cpu* cpu, const bool taken, const word operand)
 {
-	if (!cpu_get_c_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
+	if (taken)
 	{
-		cpu->pc++;
+		const word target = cpu->pc + (char)operand;
+		cpu->cycles += ((target ^ cpu->pc) & 0xFF00) ? 2 : 1;
+		cpu->pc = target;
 	}
-#ifdef LOGGING
-	printf("BCC %x\n", cpu->pc);
-#endif
 }
 
-// Branch if Carry Set
-static void bcs(cpu* cpu, const address_mode address_mode)
+// Branch if Carry Clear
+static FORCE_INLINE void bcc(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (cpu_get_c_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
-	{
-		cpu->pc++;
-	}
+	branch(cpu, !cpu_get_c_flag(cpu), operand);
+}
 
-#ifdef LOGGING
-	printf("BCS %x\n", cpu->pc);
-#endif
+// Branch if Carry Set
+static FORCE_INLINE void bcs(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	branch(cpu, cpu_get_c_flag(cpu), operand);
 }
 
 // Branch if Equal
-static void beq(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void beq(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (cpu_get_z_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
-	{
-		cpu->pc++;
-	}
-
-#ifdef LOGGING
-	printf("BEQ %x\n", cpu->pc);
-#endif
+	branch(cpu, get_z(cpu), operand);
 }
 
 // Bit Test
-static void bit(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void bit(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const word address = get_memory_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
 	const byte result = cpu->a & memory;
 
-	cpu_set_n_flag(cpu, memory & 0b10000000 ? 1 : 0);
-	cpu_set_v_flag(cpu, memory & 0b01000000 ? 1 : 0);
-	cpu_set_z_flag(cpu, result == 0 ? 1 : 0);
-
-#ifdef LOGGING
-	printf("BIT %x\n", address);
-#endif
+	// N comes from the operand, Z from the AND
+	cpu->nz = result | ((memory & N_FLAG) << 1);
+	set_flag(cpu, V_FLAG, memory & 0b01000000 ? 1 : 0);
 }
 
 // Branch if Minus
-static void bmi(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void bmi(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (cpu_get_n_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
-	{
-		cpu->pc++;
-	}
-#ifdef LOGGING
-	printf("BMI %x\n", cpu->pc);
-#endif
+	branch(cpu, get_n(cpu), operand);
 }
 
 // Branch if Not Equal
-static void bne(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void bne(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (!cpu_get_z_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
-	{
-		cpu->pc++;
-	}
-#ifdef LOGGING
-	printf("BNE %x\n", cpu->pc);
-#endif
+	branch(cpu, !get_z(cpu), operand);
 }
 
 // Branch if Positive
-static void bpl(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void bpl(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (!cpu_get_n_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-#ifdef LOGGING
-		printf("BPL %x\n", address);
-#endif
-	}
-	else
-	{
-		cpu->pc++;
-#ifdef LOGGING
-		printf("BPL %x\n", cpu->pc);
-#endif
-	}
+	branch(cpu, !get_n(cpu), operand);
 }
 
 // Force Interrupt
-static void brk(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void brk(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 
 	cpu_stack_push_16(cpu, cpu->pc + 1);
-	cpu_set_b_flag(cpu, 1);
-	cpu_set_i_flag(cpu, 1);
-	cpu_stack_push_8(cpu, cpu->p);
+	set_flag(cpu, B_FLAG, 1);
+	set_flag(cpu, I_FLAG, 1);
+	cpu_stack_push_8(cpu, get_status(cpu));
 
 	cpu->pc = cpu->irq_prt;
-
-#ifdef LOGGING
-	printf("BRK\n");
-#endif
 }
 
 // Branch if Overflow Clear
-static void bvc(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void bvc(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (!cpu_get_v_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
-	{
-		cpu->pc++;
-	}
-#ifdef LOGGING
-	printf("BVC %x\n", cpu->pc);
-#endif
+	branch(cpu, !cpu_get_v_flag(cpu), operand);
 }
 
 // Branch if Overflow Set
-static void bvs(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void bvs(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	if (cpu_get_v_flag(cpu))
-	{
-		const word address = get_memory_address(cpu, address_mode);
-		cpu->pc += (char)address;
-	}
-	else
-	{
-		cpu->pc++;
-	}
-
-#ifdef LOGGING
-	printf("BVS %x\n", cpu->pc);
-#endif
+	branch(cpu, cpu_get_v_flag(cpu), operand);
 }
 
 // Clear Carry Flag
-static void clc(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void clc(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_c_flag(cpu, 0);
-#ifdef LOGGING
-	puts("CLC");
-#endif
+	set_flag(cpu, C_FLAG, 0);
 }
 
 // Clear Decimal Mode
-static void cld(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void cld(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_d_flag(cpu, 0);
-
-#ifdef LOGGING
-	puts("CLD");
-#endif
+	set_flag(cpu, D_FLAG, 0);
 }
 
 // Clear Interrupt Disable
-static void cli(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void cli(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_i_flag(cpu, 0);
-
-#ifdef LOGGING
-	puts("CLI");
-#endif
+	set_flag(cpu, I_FLAG, 0);
 }
 
 // Clear Overflow Flag
-static void clv(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void clv(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_v_flag(cpu, 0);
-
-#ifdef LOGGING
-	puts("CLV");
-#endif
+	set_flag(cpu, V_FLAG, 0);
 }
 
 // Compare
-static void cmp(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void cmp(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const byte memory = read_argument(cpu, address_mode, operand);
 
 	const int result = cpu->a - (int)memory;
 
-	cpu_set_c_flag(cpu, result >= 0 ? 1 : 0);
-	calc_negative(cpu, (byte)result);
-	calc_zero(cpu, (byte)result);
-
-#ifdef LOGGING
-	printf("CMP %x\n", memory);
-#endif
+	set_flag(cpu, C_FLAG, result >= 0 ? 1 : 0);
+	set_nz(cpu, (byte)result);
 }
 
 // Compare X Register
-static void cpx(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void cpx(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const byte memory = read_argument(cpu, address_mode, operand);
 
 	const int result = cpu->x - (int)memory;
 
-	cpu_set_c_flag(cpu, result >= 0 ? 1 : 0);
-	calc_negative(cpu, (byte)result);
-	calc_zero(cpu, (byte)result);
-
-#ifdef LOGGING
-	printf("CPX %x\n", memory);
-#endif
+	set_flag(cpu, C_FLAG, result >= 0 ? 1 : 0);
+	set_nz(cpu, (byte)result);
 }
 
 // Compare Y Register
-static void cpy(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void cpy(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const byte memory = read_argument(cpu, address_mode, operand);
 
 	const int result = cpu->y - (int)memory;
 
-	cpu_set_c_flag(cpu, result >= 0 ? 1 : 0);
-	calc_negative(cpu, (byte)result);
-	calc_zero(cpu, (byte)result);
-
-#ifdef LOGGING
-	printf("CPY %x\n", memory);
-#endif
+	set_flag(cpu, C_FLAG, result >= 0 ? 1 : 0);
+	set_nz(cpu, (byte)result);
 }
 
 // Decrement Memory
-static void dec(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void dec(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
 	const byte new_value = memory - 1;
-	write_memory(cpu, address, new_value);
-	calc_negative(cpu, new_value);
-	calc_zero(cpu, new_value);
-
-#ifdef LOGGING
-	printf("DEC %x\n", address);
-#endif
+	write_modified(cpu, address_mode, address, memory, new_value);
+	set_nz(cpu, new_value);
 }
 
 // Decrement X Register
-static void dex(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void dex(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->x -= 1;
-	calc_negative(cpu, cpu->x);
-	calc_zero(cpu, cpu->x);
-
-#ifdef LOGGING
-	puts("DEX");
-#endif
+	set_nz(cpu, cpu->x);
 }
 
 // Decrement Y Register
-static void dey(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void dey(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->y -= 1;
-	calc_negative(cpu, cpu->y);
-	calc_zero(cpu, cpu->y);
-
-#ifdef LOGGING
-	puts("DEY");
-#endif
+	set_nz(cpu, cpu->y);
 }
 
 // Exclusive OR
-static void eor(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void eor(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const byte memory = read_argument(cpu, address_mode, operand);
 	cpu->a ^= memory;
-	calc_negative(cpu, cpu->a);
-	calc_zero(cpu, cpu->a);
-
-#ifdef LOGGING
-	printf("EOR %x\n", memory);
-#endif
+	set_nz(cpu, cpu->a);
 }
 
 // Increment Memory
-static void inc(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void inc(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
 	const byte new_value = memory + 1;
-	write_memory(cpu, address, new_value);
-	calc_negative(cpu, new_value);
-	calc_zero(cpu, new_value);
-
-#ifdef LOGGING
-	printf("INC %x\n", address);
-#endif
+	write_modified(cpu, address_mode, address, memory, new_value);
+	set_nz(cpu, new_value);
 }
 
 // Increment X Register
-static void inx(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void inx(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->x += 1;
-	calc_negative(cpu, cpu->x);
-	calc_zero(cpu, cpu->x);
-
-#ifdef LOGGING
-	puts("INX");
-#endif
+	set_nz(cpu, cpu->x);
 }
 
 // Increment Y Register
-static void iny(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void iny(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->y += 1;
-	calc_negative(cpu, cpu->y);
-	calc_zero(cpu, cpu->y);
-
-#ifdef LOGGING
-	puts("INY");
-#endif
+	set_nz(cpu, cpu->y);
 }
 
 // Jump
-static void jmp(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void jmp(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
+	const word address = get_memory_address(cpu, address_mode, operand);
 
 	// An original 6502 has a bug where it does not correctly fetch the target address
 	// if the indirect vector falls on a page boundary (e.g. $xxFF where xx is
@@ -792,599 +1080,1149 @@ static void jmp(cpu* cpu, const address_mode address_mode)
 	//assert(!(address_mode == indirect && (address & 0x00FF) == 0x00FF));
 
 	cpu->pc = address;
-
-#ifdef LOGGING
-	puts("JMP");
-#endif
 }
 
 // Jump to Subroutine
-static void jsr(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void jsr(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == absolute);
-	cpu_stack_push_16(cpu, cpu->pc + 1);
-	const word address = get_memory_address(cpu, address_mode);
+	// pc is already past the operand, push the address of its last byte
+	cpu_stack_push_16(cpu, cpu->pc - 1);
+	const word address = get_memory_address(cpu, address_mode, operand);
 	cpu->pc = address;
 
-#ifdef LOGGING
-	printf("JSR %x\n", address);
+#ifdef NATIVE_HOOKS
+	// A hooked routine runs natively up to its RTS
+	if (cpu->hooks != NULL)
+	{
+		store_nz(cpu);
+		hooks_call(cpu);
+		load_nz(cpu);
+	}
 #endif
 }
 
 // Logical Shift Right
-static void lsr(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void lsr(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	if (address_mode == accumulator)
 	{
-		cpu_set_c_flag(cpu, (cpu->a & 0b00000001) ? 1 : 0);
+		set_flag(cpu, C_FLAG, (cpu->a & 0b00000001) ? 1 : 0);
 		cpu->a >>= 1;
-		calc_negative(cpu, cpu->a);
-		calc_zero(cpu, cpu->a);
-
-#ifdef LOGGING
-		printf("LSR\n");
-#endif
+		set_nz(cpu, cpu->a);
 	}
 	else {
-		const word address = get_memory_address(cpu, address_mode);
-		byte memory = read_memory(cpu, address);
-		cpu_set_c_flag(cpu, (memory & 0b00000001) ? 1 : 0);
-		write_memory(cpu, address, memory >> 1);
-		memory = read_memory(cpu, address);
-		calc_negative(cpu, memory);
-		calc_zero(cpu, memory);
-
-#ifdef LOGGING
-		printf("LSR %x\n", address);
+		const word address = get_write_address(cpu, address_mode, operand);
+		byte memory = read_address(cpu, address_mode, address);
+		set_flag(cpu, C_FLAG, (memory & 0b00000001) ? 1 : 0);
+		write_modified(cpu, address_mode, address, memory, memory >> 1);
+#ifdef BUS_ACCURATE
+		// There is no second read on the bus
+		memory >>= 1;
+#else
+		memory = read_address(cpu, address_mode, address);
 #endif
+		set_nz(cpu, memory);
 	}
 }
 
 // No Operation
-static void nop(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void nop(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	assert(address_mode == implicit);
-
-#ifdef LOGGING
-	puts("NOP");
-#endif
+	// The unofficial NOPs with an operand read it and drop it
+	if (address_mode != implicit)
+	{
+		read_argument(cpu, address_mode, operand);
+	}
 }
 
 // Logical Inclusive OR
-static void ora(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void ora(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	cpu->a |= read_memory(cpu, address);
-	calc_negative(cpu, cpu->a);
-	calc_zero(cpu, cpu->a);
-
-#ifdef LOGGING
-	printf("ORA %x\n", address);
-#endif
+	cpu->a |= read_argument(cpu, address_mode, operand);
+	set_nz(cpu, cpu->a);
 }
 
 // Push Accumulator
-static void pha(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void pha(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu_stack_push_8(cpu, cpu->a);
-
-#ifdef LOGGING
-	puts("PHA");
-#endif
 }
 
 // Push Processor Status
-static void php(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void php(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_stack_push_8(cpu, cpu->p | UNUSED_FLAG | B_FLAG);
-
-#ifdef LOGGING
-	puts("PHP");
-#endif
+	cpu_stack_push_8(cpu, get_status(cpu) | UNUSED_FLAG | B_FLAG);
 }
 
 // Pull Accumulator
-static void pla(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void pla(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->a = cpu_stack_pop_8(cpu);
-	calc_negative(cpu, cpu->a);
-	calc_zero(cpu, cpu->a);
-
-#ifdef LOGGING
-	puts("PLA");
-#endif
+	set_nz(cpu, cpu->a);
 }
 
 // Pull Processor Status
-static void plp(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void plp(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->p = cpu_stack_pop_8(cpu);
-
-#ifdef LOGGING
-	puts("PLP");
-#endif
+	load_nz(cpu);
 }
 
 // Rotate Left
-static void rol(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void rol(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	const bool current_carry_flag = cpu_get_c_flag(cpu);
 	if (address_mode == accumulator)
 	{
-		cpu_set_c_flag(cpu, (cpu->a & 0b10000000) ? 1 : 0);
+		set_flag(cpu, C_FLAG, (cpu->a & 0b10000000) ? 1 : 0);
 		cpu->a <<= 1;
 		cpu->a |= current_carry_flag ? 1 : 0;
-		calc_zero(cpu, cpu->a);
-		calc_negative(cpu, cpu->a);
-
-#ifdef LOGGING
-		puts("ROL");
-#endif
+		set_nz(cpu, cpu->a);
 	}
 	else {
-		const word address = get_memory_address(cpu, address_mode);
-		const byte memory = read_memory(cpu, address);
-		cpu_set_c_flag(cpu, (memory & 0b10000000) ? 1 : 0);
+		const word address = get_write_address(cpu, address_mode, operand);
+		const byte memory = read_address(cpu, address_mode, address);
+		set_flag(cpu, C_FLAG, (memory & 0b10000000) ? 1 : 0);
 		byte new_value = (byte)(memory << 1);
 		new_value |= current_carry_flag ? 1 : 0;
-		write_memory(cpu, address, new_value);
-		calc_zero(cpu, new_value);
-		calc_negative(cpu, new_value);
-
-#ifdef LOGGING
-		printf("ROL %x\n", address);
-#endif
+		write_modified(cpu, address_mode, address, memory, new_value);
+		set_nz(cpu, new_value);
 	}
 }
 
 //  Rotate Right
-static void ror(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void ror(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	const bool current_carry_flag = cpu_get_c_flag(cpu);
 	if (address_mode == accumulator)
 	{
-		cpu_set_c_flag(cpu, (cpu->a & 0b00000001) ? 1 : 0);
+		set_flag(cpu, C_FLAG, (cpu->a & 0b00000001) ? 1 : 0);
 		cpu->a >>= 1;
 		cpu->a |= current_carry_flag ? 0b10000000 : 0;
-		calc_negative(cpu, cpu->a);
-		calc_zero(cpu, cpu->a);
-
-#ifdef LOGGING
-		puts("ROR");
-#endif
+		set_nz(cpu, cpu->a);
 	}
 	else {
-		const word address = get_memory_address(cpu, address_mode);
-		const byte memory = read_memory(cpu, address);
-		cpu_set_c_flag(cpu, (memory & 0b00000001) ? 1 : 0);
+		const word address = get_write_address(cpu, address_mode, operand);
+		const byte memory = read_address(cpu, address_mode, address);
+		set_flag(cpu, C_FLAG, (memory & 0b00000001) ? 1 : 0);
 		byte new_value = memory >> 1;
 		new_value |= current_carry_flag ? 0b10000000 : 0;
-		write_memory(cpu, address, new_value);
-		calc_negative(cpu, new_value);
-		calc_zero(cpu, new_value);
-
-#ifdef LOGGING
-		printf("ROR %x\n", address);
-#endif
+		write_modified(cpu, address_mode, address, memory, new_value);
+		set_nz(cpu, new_value);
 	}
 }
 
 //  Return from Interrupt
-static void rti(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void rti(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	cpu->p = cpu_stack_pop_8(cpu);
+	load_nz(cpu);
 	cpu->pc = cpu_stack_pop_16(cpu);
-
-#ifdef LOGGING
-	puts("RTI");
-#endif
 }
 
 // Return from Subroutine
-static void rts(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void rts(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
 	const word value = cpu_stack_pop_16(cpu);
 	cpu->pc = value + 1;
-
-#ifdef LOGGING
-	puts("RTS");
-#endif
 }
 
 // Subtract with Carry
-static void sbc(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void sbc(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	const byte memory = read_memory(cpu, address);
+	const byte memory = read_argument(cpu, address_mode, operand);
 	calc_add(cpu, ~memory);
-
-#ifdef LOGGING
-	printf("SBC %x\n", address);
-#endif
 }
 
 // Set Carry Flag
-static void sec(cpu* cpu, const address_mode address_mode)
+static FORCE_INLINE void sec(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_c_flag(cpu, 1);
+	set_flag(cpu, C_FLAG, 1);
+}
 
-#ifdef LOGGING
-	puts("SEC");
-#endif
+// Set Decimal Flag
+static FORCE_INLINE void sed(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	assert(address_mode == implicit);
+	set_flag(cpu, D_FLAG, 1);
+}
+
+// Set Interrupt Disable
+static FORCE_INLINE void sei(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	assert(address_mode == implicit);
+	set_flag(cpu, I_FLAG, 1);
+}
+
+// Store Accumulator
+static FORCE_INLINE void sta(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	write_address(cpu, address_mode, address, cpu->a);
+}
+
+// Store X Register
+static FORCE_INLINE void stx(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	write_address(cpu, address_mode, address, cpu->x);
+}
+
+// Store Y Register
+static FORCE_INLINE void sty(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	write_address(cpu, address_mode, address, cpu->y);
+}
+
+// Transfer Accumulator to X
+static FORCE_INLINE void tax(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	assert(address_mode == implicit);
+	cpu->x = cpu->a;
+	set_nz(cpu, cpu->x);
+}
+
+// Transfer Accumulator to Y
+static FORCE_INLINE void tay(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	assert(address_mode == implicit);
+	cpu->y = cpu->a;
+	set_nz(cpu, cpu->y);
+}
+
+// Transfer Stack Pointer to X
+static FORCE_INLINE void tsx(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	assert(address_mode == implicit);
+	cpu->x = cpu->sp;
+	set_nz(cpu, cpu->x);
+}
+
+// Transfer X to Accumulator
+static FORCE_INLINE void txa(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	assert(address_mode == implicit);
+	cpu->a = cpu->x;
+	set_nz(cpu, cpu->a);
 }
 
-// Set Decimal Flag
-static void sed(cpu* cpu, const address_mode address_mode)
+// Transfer X to Stack Pointer
+static FORCE_INLINE void txs(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_d_flag(cpu, 1);
-
-#ifdef LOGGING
-	puts("SED");
-#endif
+	cpu->sp = cpu->x;
 }
 
-// Set Interrupt Disable
-static void sei(cpu* cpu, const address_mode address_mode)
+// Transfer Y to Accumulator
+static FORCE_INLINE void tya(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu_set_i_flag(cpu, 1);
-
-#ifdef LOGGING
-	puts("SEI");
-#endif
+	cpu->a = cpu->y;
+	set_nz(cpu, cpu->a);
 }
 
-// Store Accumulator
-static void sta(cpu* cpu, const address_mode address_mode)
-{
-	const word address = get_memory_address(cpu, address_mode);
-#ifdef LOGGING
-	printf("STA %x (%x)\n", address, cpu->a);
-#endif
-	write_memory(cpu, address, cpu->a);
+// Unofficial opcodes, https://www.nesdev.org/wiki/CPU_unofficial_opcodes
 
+// AND Immediate, then copy N to C
+static FORCE_INLINE void anc(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->a &= read_argument(cpu, address_mode, operand);
+	set_nz(cpu, cpu->a);
+	set_flag(cpu, C_FLAG, cpu->a & 0b10000000);
 }
 
-// Store X Register
-static void stx(cpu* cpu, const address_mode address_mode)
+// AND Immediate, then LSR A
+static FORCE_INLINE void alr(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	write_memory(cpu, address, cpu->x);
-
-#ifdef LOGGING
-	printf("STX %x\n", address);
-#endif
+	cpu->a &= read_argument(cpu, address_mode, operand);
+	set_flag(cpu, C_FLAG, cpu->a & 0b00000001);
+	cpu->a >>= 1;
+	set_nz(cpu, cpu->a);
 }
 
-// Store Y Register
-static void sty(cpu* cpu, const address_mode address_mode)
+// AND Immediate, then ROR A. C is bit 6 of the result and V is bit 6 XOR bit 5.
+static FORCE_INLINE void arr(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	const word address = get_memory_address(cpu, address_mode);
-	write_memory(cpu, address, cpu->y);
+	const byte value = cpu->a & read_argument(cpu, address_mode, operand);
+	cpu->a = (value >> 1) | (cpu_get_c_flag(cpu) ? 0b10000000 : 0);
+	set_nz(cpu, cpu->a);
+	set_flag(cpu, C_FLAG, cpu->a & 0b01000000);
+	set_flag(cpu, V_FLAG, ((cpu->a >> 6) ^ (cpu->a >> 5)) & 1);
+}
 
-#ifdef LOGGING
-	printf("STY %x\n", address);
-#endif
+// X = (A AND X) - Immediate, without borrow in and with C set like CMP
+static FORCE_INLINE void axs(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const int result = (cpu->a & cpu->x) - (int)read_argument(cpu, address_mode, operand);
+	set_flag(cpu, C_FLAG, result >= 0);
+	cpu->x = (byte)result;
+	set_nz(cpu, cpu->x);
 }
 
-// Transfer Accumulator to X
-static void tax(cpu* cpu, const address_mode address_mode)
+// DEC, then CMP
+static FORCE_INLINE void dcp(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	assert(address_mode == implicit);
-	cpu->x = cpu->a;
-	calc_zero(cpu, cpu->x);
-	calc_negative(cpu, cpu->x);
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
+	const byte new_value = memory - 1;
+	write_modified(cpu, address_mode, address, memory, new_value);
 
-#ifdef LOGGING
-	puts("TAX");
-#endif
+	const int result = cpu->a - (int)new_value;
+	set_flag(cpu, C_FLAG, result >= 0);
+	set_nz(cpu, (byte)result);
 }
 
-// Transfer Accumulator to Y
-static void tay(cpu* cpu, const address_mode address_mode)
+// INC, then SBC
+static FORCE_INLINE void isc(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	assert(address_mode == implicit);
-	cpu->y = cpu->a;
-	calc_zero(cpu, cpu->y);
-	calc_negative(cpu, cpu->y);
-
-#ifdef LOGGING
-	puts("TAY");
-#endif
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
+	const byte new_value = memory + 1;
+	write_modified(cpu, address_mode, address, memory, new_value);
+	calc_add(cpu, ~new_value);
 }
 
-// Transfer Stack Pointer to X
-static void tsx(cpu* cpu, const address_mode address_mode)
+// Locks the CPU up until reset: pc stays on the opcode, which runs again and again
+static FORCE_INLINE void jam(cpu* cpu, const address_mode address_mode, const word operand)
 {
 	assert(address_mode == implicit);
-	cpu->x = cpu->sp;
-	calc_zero(cpu, cpu->x);
-	calc_negative(cpu, cpu->x);
+	cpu->pc--;
+}
 
-#ifdef LOGGING
-	puts("TSX");
-#endif
+// A, X and SP = memory AND SP
+static FORCE_INLINE void las(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const byte value = read_argument(cpu, address_mode, operand) & cpu->sp;
+	cpu->a = value;
+	cpu->x = value;
+	cpu->sp = value;
+	set_nz(cpu, value);
 }
 
-// Transfer X to Accumulator
-static void txa(cpu* cpu, const address_mode address_mode)
+// LDA and LDX at once
+static FORCE_INLINE void lax(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	assert(address_mode == implicit);
-	cpu->a = cpu->x;
-	calc_zero(cpu, cpu->a);
-	calc_negative(cpu, cpu->a);
+	cpu->a = read_argument(cpu, address_mode, operand);
+	cpu->x = cpu->a;
+	set_nz(cpu, cpu->a);
+}
 
-#ifdef LOGGING
+// The unstable immediate opcodes mix A with a value that differs between chips, 0xEE is the common one
+#define UNSTABLE_MAGIC	0xEE
 
-	puts("TXA");
-#endif
+// A and X = (A OR magic) AND Immediate
+static FORCE_INLINE void lxa(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->a = (cpu->a | UNSTABLE_MAGIC) & read_argument(cpu, address_mode, operand);
+	cpu->x = cpu->a;
+	set_nz(cpu, cpu->a);
 }
 
-// Transfer X to Stack Pointer
-static void txs(cpu* cpu, const address_mode address_mode)
+// ROL, then AND
+static FORCE_INLINE void rla(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	assert(address_mode == implicit);
-	cpu->sp = cpu->x;
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
+	const byte new_value = (byte)(memory << 1) | (cpu_get_c_flag(cpu) ? 1 : 0);
+	set_flag(cpu, C_FLAG, memory & 0b10000000);
+	write_modified(cpu, address_mode, address, memory, new_value);
+	cpu->a &= new_value;
+	set_nz(cpu, cpu->a);
+}
 
-#ifdef LOGGING
+// ROR, then ADC with the carry ROR shifted out
+static FORCE_INLINE void rra(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
+	const byte new_value = (memory >> 1) | (cpu_get_c_flag(cpu) ? 0b10000000 : 0);
+	set_flag(cpu, C_FLAG, memory & 0b00000001);
+	write_modified(cpu, address_mode, address, memory, new_value);
+	calc_add(cpu, new_value);
+}
 
-	puts("TXS");
-#endif
+// Store A AND X
+static FORCE_INLINE void sax(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	write_address(cpu, address_mode, address, cpu->a & cpu->x);
 }
 
-// Transfer Y to Accumulator
-static void tya(cpu* cpu, const address_mode address_mode)
+// SHA, SHX, SHY and TAS store value AND the high byte of the unindexed address plus 1.
+// When the index carries into the high byte, the stored value replaces it.
+static FORCE_INLINE void store_high_and(cpu* cpu, const address_mode address_mode, const word operand, byte value)
 {
-	assert(address_mode == implicit);
-	cpu->a = cpu->y;
-	calc_zero(cpu, cpu->a);
-	calc_negative(cpu, cpu->a);
+	word address = get_write_address(cpu, address_mode, operand);
+	const word base = address - (address_mode == absolute_x ? cpu->x : cpu->y);
+	value &= (byte)((base >> 8) + 1);
+	if ((base ^ address) & 0xFF00)
+	{
+		address = (word)(value << 8) | (address & 0xFF);
+	}
+	write_address(cpu, address_mode, address, value);
+}
 
-#ifdef LOGGING
-	puts("TYA");
-#endif
+// Store A AND X AND (high byte + 1)
+static FORCE_INLINE void sha(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	store_high_and(cpu, address_mode, operand, cpu->a & cpu->x);
+}
 
+// Store X AND (high byte + 1)
+static FORCE_INLINE void shx(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	store_high_and(cpu, address_mode, operand, cpu->x);
 }
 
-// https://www.nesdev.org/obelisk-6502-guide/reference.html
-void cpu_exec(cpu* cpu, const byte instruction)
+// Store Y AND (high byte + 1)
+static FORCE_INLINE void shy(cpu* cpu, const address_mode address_mode, const word operand)
 {
-	switch (instruction)
-	{
-		OP(A9, lda, immediate);
-		OP(A5, lda, zero_page);
-		OP(B5, lda, zero_page_x);
-		OP(AD, lda, absolute);
-		OP(BD, lda, absolute_x);
-		OP(B9, lda, absolute_y);
-		OP(A1, lda, indexed_indirect);
-		OP(B1, lda, indirect_indexed);
+	store_high_and(cpu, address_mode, operand, cpu->y);
+}
 
-		OP(A2, ldx, immediate);
-		OP(A6, ldx, zero_page);
-		OP(B6, ldx, zero_page_y);
-		OP(AE, ldx, absolute);
-		OP(BE, ldx, absolute_y);
+// ASL, then ORA
+static FORCE_INLINE void slo(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
+	const byte new_value = (byte)(memory << 1);
+	set_flag(cpu, C_FLAG, memory & 0b10000000);
+	write_modified(cpu, address_mode, address, memory, new_value);
+	cpu->a |= new_value;
+	set_nz(cpu, cpu->a);
+}
 
-		OP(A0, ldy, immediate);
-		OP(A4, ldy, zero_page);
-		OP(B4, ldy, zero_page_x);
-		OP(AC, ldy, absolute);
-		OP(BC, ldy, absolute_x);
+// LSR, then EOR
+static FORCE_INLINE void sre(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	const word address = get_write_address(cpu, address_mode, operand);
+	const byte memory = read_address(cpu, address_mode, address);
+	const byte new_value = memory >> 1;
+	set_flag(cpu, C_FLAG, memory & 0b00000001);
+	write_modified(cpu, address_mode, address, memory, new_value);
+	cpu->a ^= new_value;
+	set_nz(cpu, cpu->a);
+}
 
-		OP(69, adc, immediate);
-		OP(65, adc, zero_page);
-		OP(75, adc, zero_page_x);
-		OP(6D, adc, absolute);
-		OP(7D, adc, absolute_x);
-		OP(79, adc, absolute_y);
-		OP(61, adc, indexed_indirect);
-		OP(71, adc, indirect_indexed);
+// SP = A AND X, then store SP AND (high byte + 1)
+static FORCE_INLINE void tas(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->sp = cpu->a & cpu->x;
+	store_high_and(cpu, address_mode, operand, cpu->sp);
+}
 
-		OP(29, AND, immediate);
-		OP(25, AND, zero_page);
-		OP(35, AND, zero_page_x);
-		OP(2D, AND, absolute);
-		OP(3D, AND, absolute_x);
-		OP(39, AND, absolute_y);
-		OP(21, AND, indexed_indirect);
-		OP(31, AND, indirect_indexed);
+// A = (A OR magic) AND X AND Immediate
+static FORCE_INLINE void xaa(cpu* cpu, const address_mode address_mode, const word operand)
+{
+	cpu->a = (cpu->a | UNSTABLE_MAGIC) & cpu->x & read_argument(cpu, address_mode, operand);
+	set_nz(cpu, cpu->a);
+}
 
-		OP(0A, asl, accumulator);
-		OP(06, asl, zero_page);
-		OP(16, asl, zero_page_x);
-		OP(0E, asl, absolute);
-		OP(1E, asl, absolute_x);
+// next_operand is only used by fused instruction pairs and triples
+typedef void (*decoded_handler)(cpu* cpu, word operand, word next_operand);
 
-		OP(90, bcc, relative);
+// Executes an opcode whose operand has already been fetched, with the page-crossing cycle when it takes one
+#define OP(opcode, mnemonic, operation, address_mode, base_cycles, page_cycle) \
+static void exec_##opcode(cpu* cpu, const word operand, const word next_operand) \
+{ \
+	if (page_cycle) \
+	{ \
+		cpu->cycles += page_cross_cycles(cpu, address_mode, operand); \
+	} \
+	operation(cpu, address_mode, operand); \
+}
+#include "opcodes.h"
+#undef OP
 
-		OP(B0, bcs, relative);
+typedef struct
+{
+	decoded_handler handler;
+	address_mode address_mode;
+	byte cycles;
+} opcode_definition;
 
-		OP(F0, beq, relative);
+#define OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) [0x##opcode] = { exec_##opcode, address_mode, cycles },
+static const opcode_definition opcode_definitions[256] =
+{
+#include "opcodes.h"
+};
+#undef OP
 
-		OP(24, bit, zero_page);
-		OP(2C, bit, absolute);
+#ifndef SWITCH_DISPATCH
+// One handler per opcode, each specialized for its addressing mode.
+#define OP(opcode, mnemonic, operation, address_mode, base_cycles, page_cycle) \
+static void op_##opcode(cpu* cpu) \
+{ \
+	cpu->cycles += base_cycles; \
+	exec_##opcode(cpu, fetch_operand(cpu, address_mode), 0); \
+}
+#include "opcodes.h"
+#undef OP
 
-		OP(30, bmi, relative);
+typedef void (*opcode_handler)(cpu* cpu);
 
-		OP(D0, bne, relative);
+#define OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) [0x##opcode] = op_##opcode,
+static const opcode_handler opcode_table[256] =
+{
+#include "opcodes.h"
+};
+#undef OP
+#endif
 
-		OP(10, bpl, relative);
+// https://www.nesdev.org/obelisk-6502-guide/reference.html
+// Runs one instruction with N and Z in nz
+static void execute(cpu* cpu, const byte instruction)
+{
+#ifdef LOGGING
+	// The trace shows p, which gets N and Z from nz here
+	char line[TRACE_LINE_SIZE];
+	store_nz(cpu);
+	disassemble_trace(cpu, cpu->pc - 1, line, sizeof(line));
+	puts(line);
+#endif
 
-		OP(00, brk, implicit);
+#ifdef SWITCH_DISPATCH
+	switch (instruction)
+	{
+#define OP(opcode, mnemonic, operation, address_mode, base_cycles, page_cycle) \
+		case 0x##opcode: \
+			cpu->cycles += base_cycles; \
+			exec_##opcode(cpu, fetch_operand(cpu, address_mode), 0); \
+			break;
+#include "opcodes.h"
+#undef OP
+	}
+#else
+	opcode_table[instruction](cpu);
+#endif
+}
 
-		OP(50, bvc, relative);
+void cpu_exec(cpu* cpu, const byte instruction)
+{
+	load_nz(cpu);
+	execute(cpu, instruction);
+	store_nz(cpu);
+}
+
+// Runs both instructions of a superinstruction. pc is already past the pair. cycles only has the first
+// instruction's base cycles, the second's are added once the first ran so PPU reads see the right time.
+#define FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand) \
+static void fused_##name(cpu* cpu, const word operand, const word next_operand) \
+{ \
+	cpu->fusion_hits[fusion_##name]++; \
+	exec_##first_opcode(cpu, operand, 0); \
+	cpu->cycles += opcode_definitions[0x##second_opcode].cycles; \
+	exec_##second_opcode(cpu, next_operand, 0); \
+}
+// A triple's operand and next_operand belong to its second and third instructions
+#define FUSION_TRIPLE(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, third_opcode, third_operation, third_mode) \
+static void fused_##name(cpu* cpu, const word operand, const word next_operand) \
+{ \
+	cpu->fusion_hits[fusion_##name]++; \
+	exec_##first_opcode(cpu, 0, 0); \
+	cpu->cycles += opcode_definitions[0x##second_opcode].cycles; \
+	exec_##second_opcode(cpu, operand, 0); \
+	cpu->cycles += opcode_definitions[0x##third_opcode].cycles; \
+	exec_##third_opcode(cpu, next_operand, 0); \
+}
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+
+// Labels below FUSED_LABEL_BASE are opcodes, the ones above are fusions and then idle loops
+#define FUSED_LABEL_BASE	256
+#define IDLE_LOOP_LABEL		(FUSED_LABEL_BASE + FUSION_COUNT)
+
+// Longest idle loop cpu_idle_loop_length looks for, in bytes
+#define MAX_IDLE_LOOP_SIZE	8
+
+// Longest run of bytes a cached entry is decoded from: an idle loop, or a fused pair or triple
+#define MAX_DECODED_LENGTH	MAX_IDLE_LOOP_SIZE
+
+// How many instructions each superinstruction stands for
+static const byte fused_instruction_count[FUSION_COUNT] =
+{
+#define FUSION(name, ...) 2,
+#define FUSION_TRIPLE(name, ...) 3,
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+};
+
+struct decoded_instruction
+{
+	decoded_handler handler;
+	word operand;
+	word next_operand;
+	word label;
+	byte length;
+	byte cycles;
+};
+
+byte cpu_instruction_length(const address_mode address_mode)
+{
+	switch (address_mode) {
+		case implicit:
+		case accumulator:
+			return 1;
 
-		OP(70, bvs, relative);
+		case absolute:
+		case absolute_x:
+		case absolute_y:
+		case indirect:
+			return 3;
 
-		OP(18, clc, implicit);
+		default:
+			return 2;
+	}
+}
 
-		OP(d8, cld, implicit);
+static word decode_operand(const cpu* cpu, const word address, const byte length)
+{
+	switch (length)
+	{
+		case 2:
+			return cpu_read_memory(cpu, address + 1);
+		case 3:
+			return ((word)(cpu_read_memory(cpu, address + 2) << 8)) | cpu_read_memory(cpu, address + 1);
+		default:
+			return 0;
+	}
+}
 
-		OP(58, cli, implicit);
+// Turns a decoded instruction into a superinstruction when it and the next ones match a pattern in fusions.h
+static void fuse_instruction(const cpu* cpu, decoded_instruction* instruction, const word address)
+{
+	const int next_address = address + instruction->length;
+	if (instruction->label >= FUSED_LABEL_BASE || next_address > 0xFFFF)
+	{
+		return;
+	}
 
-		OP(B8, clv, implicit);
+	const byte first = (byte)instruction->label;
+	const byte second = cpu_read_memory(cpu, next_address);
+
+	// Triples are tried first so they win over a pair starting with the same instructions
+#define FUSION(...)
+#define FUSION_TRIPLE(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, third_opcode, third_operation, third_mode) \
+	if (first == 0x##first_opcode && second == 0x##second_opcode) \
+	{ \
+		const int third_address = next_address + cpu_instruction_length(second_mode); \
+		if (third_address + cpu_instruction_length(third_mode) <= MAX_MEMORY && \
+			cpu_read_memory(cpu, third_address) == 0x##third_opcode) \
+		{ \
+			instruction->handler = fused_##name; \
+			instruction->operand = decode_operand(cpu, (word)next_address, cpu_instruction_length(second_mode)); \
+			instruction->next_operand = decode_operand(cpu, (word)third_address, cpu_instruction_length(third_mode)); \
+			instruction->label = FUSED_LABEL_BASE + fusion_##name; \
+			instruction->length += cpu_instruction_length(second_mode) + cpu_instruction_length(third_mode); \
+			return; \
+		} \
+	}
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+
+#define FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand) \
+	if (first == 0x##first_opcode && second == 0x##second_opcode && \
+		((first_operand) < 0 || instruction->operand == (first_operand)) && \
+		next_address + cpu_instruction_length(second_mode) <= MAX_MEMORY) \
+	{ \
+		instruction->handler = fused_##name; \
+		instruction->next_operand = decode_operand(cpu, (word)next_address, cpu_instruction_length(second_mode)); \
+		instruction->label = FUSED_LABEL_BASE + fusion_##name; \
+		instruction->length += cpu_instruction_length(second_mode); \
+		return; \
+	}
+#define FUSION_TRIPLE(...)
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+}
 
-		OP(C9, cmp, immediate);
-		OP(C5, cmp, zero_page);
-		OP(D5, cmp, zero_page_x);
-		OP(CD, cmp, absolute);
-		OP(DD, cmp, absolute_x);
-		OP(D9, cmp, absolute_y);
-		OP(C1, cmp, indexed_indirect);
-		OP(D1, cmp, indirect_indexed);
+// Idle loops only run these: loads, compares and logic on A without indexing, and NOP
+static bool is_idle_opcode(const byte opcode)
+{
+	switch (opcode)
+	{
+		// LDA, LDX, LDY
+		case 0xA9: case 0xA5: case 0xAD:
+		case 0xA2: case 0xA6: case 0xAE:
+		case 0xA0: case 0xA4: case 0xAC:
+		// BIT
+		case 0x24: case 0x2C:
+		// CMP, CPX, CPY
+		case 0xC9: case 0xC5: case 0xCD:
+		case 0xE0: case 0xE4: case 0xEC:
+		case 0xC0: case 0xC4: case 0xCC:
+		// AND, ORA, EOR
+		case 0x29: case 0x25: case 0x2D:
+		case 0x09: case 0x05: case 0x0D:
+		case 0x49: case 0x45: case 0x4D:
+		// NOP
+		case 0xEA:
+			return true;
+		default:
+			return false;
+	}
+}
 
-		OP(E0, cpx, immediate);
-		OP(E4, cpx, zero_page);
-		OP(EC, cpx, absolute);
+// RAM and the cartridge only change when the program writes them, and PPU_STATUS only when the frame loop handles an event
+static bool is_idle_read(const word address)
+{
+	return address < PPU_CTRL || address == PPU_STATUS || address > CONTROLLER_2;
+}
 
-		OP(C0, cpy, immediate);
-		OP(C4, cpy, zero_page);
-		OP(CC, cpy, absolute);
+byte cpu_idle_loop_length(const cpu* cpu, const word address)
+{
+	int pc = address;
 
-		OP(C6, dec, zero_page);
-		OP(D6, dec, zero_page_x);
-		OP(CE, dec, absolute);
-		OP(DE, dec, absolute_x);
+	for (byte count = 1; pc - address < MAX_IDLE_LOOP_SIZE; count++)
+	{
+		const byte opcode = cpu_read_memory(cpu, pc);
+		const opcode_definition* definition = &opcode_definitions[opcode];
+		const byte length = cpu_instruction_length(definition->address_mode);
+		if (pc + length > MAX_MEMORY || pc + length - address > MAX_IDLE_LOOP_SIZE)
+		{
+			return 0;
+		}
 
-		OP(CA, dex, implicit);
+		const word operand = decode_operand(cpu, (word)pc, length);
+		const word next = (word)(pc + length);
 
-		OP(88, dey, implicit);
+		// The loop ends with a branch or JMP back to its first instruction
+		if (definition->address_mode == relative)
+		{
+			return (word)(next + (char)operand) == address ? count : 0;
+		}
+		if (opcode == 0x4C)
+		{
+			return operand == address ? count : 0;
+		}
 
-		OP(49, eor, immediate);
-		OP(45, eor, zero_page);
-		OP(55, eor, zero_page_x);
-		OP(4D, eor, absolute);
-		OP(5D, eor, absolute_x);
-		OP(59, eor, absolute_y);
-		OP(41, eor, indexed_indirect);
-		OP(51, eor, indirect_indexed);
+		if (!is_idle_opcode(opcode) ||
+			((definition->address_mode == zero_page || definition->address_mode == absolute) && !is_idle_read(operand)))
+		{
+			return 0;
+		}
+		pc = next;
+	}
 
-		OP(E6, inc, zero_page);
-		OP(F6, inc, zero_page_x);
-		OP(EE, inc, absolute);
-		OP(FE, inc, absolute_x);
+	return 0;
+}
 
-		OP(E8, inx, implicit);
+static void decode_instruction(cpu* cpu, const word address)
+{
+	decoded_instruction* instruction = &cpu->decode_cache[address - PRG_ROM_START];
+	const byte opcode = cpu_read_memory(cpu, address);
+	const opcode_definition* definition = &opcode_definitions[opcode];
 
-		OP(C8, iny, implicit);
+	instruction->label = opcode;
+	instruction->next_operand = 0;
+	instruction->handler = definition->handler;
+	instruction->length = cpu_instruction_length(definition->address_mode);
+	instruction->cycles = definition->cycles;
+	instruction->operand = decode_operand(cpu, address, instruction->length);
 
-		OP(4C, jmp, absolute);
-		OP(6C, jmp, indirect);
+	// run_idle_loop runs idle loops from their own instructions, it only needs to know how many there are
+	const byte idle_length = cpu_idle_loop_length(cpu, address);
+	if (idle_length != 0)
+	{
+		instruction->label = IDLE_LOOP_LABEL;
+		instruction->operand = idle_length;
+		instruction->length = 0;
+		instruction->cycles = 0;
+		return;
+	}
 
-		OP(20, jsr, absolute);
+	fuse_instruction(cpu, instruction, address);
+}
 
-		OP(4A, lsr, accumulator);
-		OP(46, lsr, zero_page);
-		OP(56, lsr, zero_page_x);
-		OP(4E, lsr, absolute);
-		OP(5E, lsr, absolute_x);
+// Runs the idle loop of length instructions at pc with count instructions left in the batch.
+// An iteration that leaves the machine as it found it does the same every time until the frame loop handles an event,
+// so the iterations that fit in the batch after it are skipped by advancing the cycle counter.
+// Returns the number of instructions executed or skipped.
+static int run_idle_loop(cpu* cpu, const byte length, const int count)
+{
+	if (count < length)
+	{
+		execute(cpu, fetch_opcode(cpu));
+		return 1;
+	}
 
-		OP(EA, nop, implicit);
-		OP(1A, nop, implicit);
-		OP(3A, nop, implicit);
+	const word start = cpu->pc;
+	const byte a = cpu->a, x = cpu->x, y = cpu->y, sp = cpu->sp, status = get_status(cpu);
+	const bool latch = cpu->ppu.ppu_latch;
+	const uint64_t cycles = cpu->cycles;
+	const uint64_t clock = cpu->ppu.clock;
 
-		OP(09, ora, immediate);
-		OP(05, ora, zero_page);
-		OP(15, ora, zero_page_x);
-		OP(0D, ora, absolute);
-		OP(1D, ora, absolute_x);
-		OP(19, ora, absolute_y);
-		OP(01, ora, indexed_indirect);
-		OP(11, ora, indirect_indexed);
+	for (int i = 0; i < length; i++)
+	{
+		execute(cpu, fetch_opcode(cpu));
+	}
 
-		OP(48, pha, implicit);
+	if (cpu->pc != start || cpu->a != a || cpu->x != x || cpu->y != y || cpu->sp != sp ||
+		get_status(cpu) != status || cpu->ppu.ppu_latch != latch)
+	{
+		return length;
+	}
 
-		OP(08, php, implicit);
+	// A loop that polls PPU_STATUS caught the PPU up, it reads the same until the PPU changes it.
+	// The skipped iterations stop short of that.
+	const uint64_t iteration_cycles = cpu->cycles - cycles;
+	int iterations = (count - length) / length;
+	const uint64_t status_change = cpu->ppu.clock != clock ? ppu_next_status_change(&cpu->ppu) / DOTS_PER_CPU_CYCLE : UINT64_MAX;
+	if (cpu->cycles + iterations * iteration_cycles > status_change)
+	{
+		iterations = status_change > cpu->cycles ? (int)((status_change - cpu->cycles) / iteration_cycles) : 0;
+	}
 
-		OP(68, pla, implicit);
+	const uint64_t skipped = (uint64_t)iterations * iteration_cycles;
+	cpu->cycles += skipped;
+	cpu->idle_cycles += skipped;
+	return length + iterations * length;
+}
 
-		OP(28, plp, implicit);
+// Re-decodes every cached instruction whose bytes include address
+static void invalidate_decoded(cpu* cpu, const word address)
+{
+	for (int start = address - (MAX_DECODED_LENGTH - 1); start <= address; start++)
+	{
+		if (start >= PRG_ROM_START && start < PRG_ROM_START + DECODE_CACHE_SIZE)
+		{
+			decode_instruction(cpu, (word)start);
+		}
+	}
+}
 
-		OP(2A, rol, accumulator);
-		OP(26, rol, zero_page);
-		OP(36, rol, zero_page_x);
-		OP(2E, rol, absolute);
-		OP(3E, rol, absolute_x);
+void cpu_decode_prg_rom(cpu* cpu)
+{
+#ifdef DECODE_CACHE
+	if (cpu->decode_cache == NULL)
+	{
+		cpu->decode_cache = malloc(DECODE_CACHE_SIZE * sizeof(decoded_instruction));
+		if (cpu->decode_cache == NULL)
+		{
+			return;
+		}
+	}
 
-		OP(6A, ror, accumulator);
-		OP(66, ror, zero_page);
-		OP(76, ror, zero_page_x);
-		OP(6E, ror, absolute);
-		OP(7E, ror, absolute_x);
+	for (word offset = 0; offset < DECODE_CACHE_SIZE; offset++)
+	{
+		decode_instruction(cpu, PRG_ROM_START + offset);
+	}
+#endif
+}
 
-		OP(40, rti, implicit);
+void cpu_free(cpu* cpu)
+{
+	free(cpu->decode_cache);
+	cpu->decode_cache = NULL;
+	ppu_free(&cpu->ppu);
+#ifdef JIT
+	jit_destroy(cpu);
+#endif
+#ifdef NATIVE_HOOKS
+	hooks_destroy(cpu);
+#endif
+	memset(cpu->fusion_hits, 0, sizeof(cpu->fusion_hits));
+}
 
-		OP(60, rts, implicit);
+// interrupts also stays non-zero while the I flag masks an IRQ, the batches test it first and only then call this
+bool cpu_interrupt_due(const cpu* cpu)
+{
+	return (cpu->interrupts & INTERRUPT_NMI) || ((cpu->interrupts & INTERRUPT_IRQ) && !(cpu->p & I_FLAG));
+}
 
-		OP(E9, sbc, immediate);
-		OP(E5, sbc, zero_page);
-		OP(F5, sbc, zero_page_x);
-		OP(ED, sbc, absolute);
-		OP(FD, sbc, absolute_x);
-		OP(F9, sbc, absolute_y);
-		OP(E1, sbc, indexed_indirect);
-		OP(F1, sbc, indirect_indexed);
+#ifdef THREADED_DISPATCH
+// Threaded interpreter: every handler fetches the next opcode and jumps straight to its label.
+// Instructions in the decode cache jump past the operand fetch. Returns the instructions left when an interrupt
+// ended the batch early.
+static int run_batch(cpu* cpu, int count)
+{
+	static void* fetch_labels[256];
+	static void* execute_labels[IDLE_LOOP_LABEL + 1];
+	static bool labels_ready = false;
 
-		OP(38, sec, implicit);
+	if (!labels_ready)
+	{
+#define OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) \
+		fetch_labels[0x##opcode] = &&fetch_##opcode; \
+		execute_labels[0x##opcode] = &&execute_##opcode;
+#include "opcodes.h"
+#undef OP
+#define FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand) \
+		execute_labels[FUSED_LABEL_BASE + fusion_##name] = &&fused_##name;
+#define FUSION_TRIPLE(name, ...) \
+		execute_labels[FUSED_LABEL_BASE + fusion_##name] = &&fused_##name;
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+		execute_labels[IDLE_LOOP_LABEL] = &&idle_loop;
+		labels_ready = true;
+	}
 
-		OP(F8, sed, implicit);
+	const decoded_instruction* const cache = cpu->decode_cache;
+	const word cached_size = cache != NULL ? DECODE_CACHE_SIZE : 0;
+	word operand = 0;
+	word next_operand = 0;
+
+#define DISPATCH() \
+	if (--count < 0) \
+	{ \
+		return 0; \
+	} \
+	if (cpu->interrupts != 0 && cpu_interrupt_due(cpu)) \
+	{ \
+		return count + 1; \
+	} \
+	if ((word)(cpu->pc - PRG_ROM_START) < cached_size) \
+	{ \
+		const decoded_instruction* instruction = &cache[(word)(cpu->pc - PRG_ROM_START)]; \
+		cpu->pc += instruction->length; \
+		cpu->cycles += instruction->cycles; \
+		operand = instruction->operand; \
+		next_operand = instruction->next_operand; \
+		goto *execute_labels[instruction->label]; \
+	} \
+	goto *fetch_labels[fetch_opcode(cpu)]
+
+	DISPATCH();
+
+#define OP(opcode, mnemonic, operation, address_mode, base_cycles, page_cycle) \
+fetch_##opcode: \
+	cpu->cycles += base_cycles; \
+	operand = fetch_operand(cpu, address_mode); \
+execute_##opcode: \
+	if (page_cycle) \
+	{ \
+		cpu->cycles += page_cross_cycles(cpu, address_mode, operand); \
+	} \
+	operation(cpu, address_mode, operand); \
+	DISPATCH();
+#include "opcodes.h"
+#undef OP
+
+	// With a single instruction left in the batch only the first half of the pair runs
+#define FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand) \
+fused_##name: \
+	if (count == 0) \
+	{ \
+		cpu->pc -= cpu_instruction_length(second_mode); \
+		goto execute_##first_opcode; \
+	} \
+	count--; \
+	cpu->fusion_hits[fusion_##name]++; \
+	exec_##first_opcode(cpu, operand, 0); \
+	cpu->cycles += opcode_definitions[0x##second_opcode].cycles; \
+	exec_##second_opcode(cpu, next_operand, 0); \
+	DISPATCH();
+	// A triple needs two more instructions of the batch, otherwise only its first runs
+#define FUSION_TRIPLE(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, third_opcode, third_operation, third_mode) \
+fused_##name: \
+	if (count < 2) \
+	{ \
+		cpu->pc -= cpu_instruction_length(second_mode) + cpu_instruction_length(third_mode); \
+		goto execute_##first_opcode; \
+	} \
+	count -= 2; \
+	cpu->fusion_hits[fusion_##name]++; \
+	exec_##first_opcode(cpu, 0, 0); \
+	cpu->cycles += opcode_definitions[0x##second_opcode].cycles; \
+	exec_##second_opcode(cpu, operand, 0); \
+	cpu->cycles += opcode_definitions[0x##third_opcode].cycles; \
+	exec_##third_opcode(cpu, next_operand, 0); \
+	DISPATCH();
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+
+	// DISPATCH counted the loop as one instruction
+idle_loop:
+	count += 1 - run_idle_loop(cpu, (byte)operand, count + 1);
+	DISPATCH();
+#undef DISPATCH
+}
+#else
+// Returns the instructions left when an interrupt ended the batch early
+static int run_batch(cpu* cpu, int count)
+{
+	const decoded_instruction* const cache = cpu->decode_cache;
+	const word cached_size = cache != NULL ? DECODE_CACHE_SIZE : 0;
+
+	while (count > 0)
+	{
+		if (cpu->interrupts != 0 && cpu_interrupt_due(cpu))
+		{
+			return count;
+		}
 
-		OP(78, sei, implicit);
+#ifdef RECOMPILED
+		if (cpu->recompiled)
+		{
+			// Recompiled code keeps all the flags in p
+			store_nz(cpu);
+			const int executed = recompiled_exec(cpu, count);
+			load_nz(cpu);
+			if (executed > 0)
+			{
+				count -= executed;
+				continue;
+			}
+		}
+#endif
 
-		OP(85, sta, zero_page);
-		OP(95, sta, zero_page_x);
-		OP(8D, sta, absolute);
-		OP(9D, sta, absolute_x);
-		OP(99, sta, absolute_y);
-		OP(81, sta, indexed_indirect);
-		OP(91, sta, indirect_indexed);
+#ifdef JIT
+		if (cpu->jit != NULL)
+		{
+			store_nz(cpu);
+			const int executed = jit_exec(cpu, count);
+			load_nz(cpu);
+			if (executed > 0)
+			{
+				count -= executed;
+				continue;
+			}
+		}
+#endif
 
-		OP(86, stx, zero_page);
-		OP(96, stx, zero_page_y);
-		OP(8E, stx, absolute);
+		const word offset = cpu->pc - PRG_ROM_START;
+		if (offset < cached_size)
+		{
+			const decoded_instruction* instruction = &cache[offset];
 
-		OP(84, sty, zero_page);
-		OP(94, sty, zero_page_x);
-		OP(8C, sty, absolute);
+			// A fused pair counts as two instructions, a triple as three
+			if (instruction->label < FUSED_LABEL_BASE)
+			{
+				count--;
+			}
+			else if (instruction->label == IDLE_LOOP_LABEL)
+			{
+				count -= run_idle_loop(cpu, (byte)instruction->operand, count);
+				continue;
+			}
+			else if (count >= fused_instruction_count[instruction->label - FUSED_LABEL_BASE])
+			{
+				count -= fused_instruction_count[instruction->label - FUSED_LABEL_BASE];
+			}
+			else
+			{
+				// Only room for part of the superinstruction, its first instruction runs alone
+				execute(cpu, fetch_opcode(cpu));
+				count--;
+				continue;
+			}
 
-		OP(AA, tax, implicit);
+			cpu->pc += instruction->length;
+			cpu->cycles += instruction->cycles;
+			instruction->handler(cpu, instruction->operand, instruction->next_operand);
+		}
+		else
+		{
+			execute(cpu, fetch_opcode(cpu));
+			count--;
+		}
+	}
+	return 0;
+}
+#endif
 
-		OP(A8, tay, implicit);
+// Takes the pending interrupt with the highest priority, between instructions and with N and Z in nz.
+// An IRQ keeps waiting while the I flag is set.
+static void poll_interrupts(cpu* cpu)
+{
+	word vector;
+	if (cpu->interrupts & INTERRUPT_NMI)
+	{
+		cpu->interrupts &= ~INTERRUPT_NMI;
+		vector = cpu->nmi_prt;
+	}
+	else if (!(cpu->p & I_FLAG))
+	{
+		vector = cpu->irq_prt;
+	}
+	else
+	{
+		return;
+	}
 
-		OP(BA, tsx, implicit);
+	cpu->cycles += INTERRUPT_CYCLES;
+	cpu_stack_push_16(cpu, cpu->pc);
+	// Unlike BRK, the status is pushed with B clear
+	cpu_stack_push_8(cpu, (get_status(cpu) & ~B_FLAG) | UNUSED_FLAG);
+	set_flag(cpu, I_FLAG, 1);
+	cpu->pc = vector;
+}
 
-		OP(8A, txa, implicit);
+void cpu_exec_batch(cpu* cpu, int count)
+{
+	load_nz(cpu);
+	while (count > 0)
+	{
+		if (cpu->interrupts != 0)
+		{
+			poll_interrupts(cpu);
+		}
+		count = run_batch(cpu, count);
+	}
+	store_nz(cpu);
+}
 
-		OP(9A, txs, implicit);
+run_result cpu_run(cpu* cpu, const int budget)
+{
+	const uint64_t budget_end = cpu->cycles + budget;
+	const bool event_first = cpu->event_cycle <= budget_end;
+	const uint64_t end = event_first ? cpu->event_cycle : budget_end;
 
-		OP(98, tya, implicit);
+	// N and Z stay in nz for the whole run. Batches are sized so that even the longest instructions can't run far past the end.
+	load_nz(cpu);
+	while (cpu->cycles < end)
+	{
+		// Interrupts are taken here, before the first batch and when one ended early because an interrupt came up
+		if (cpu->interrupts != 0)
+		{
+			poll_interrupts(cpu);
+		}
 
-		default:
-			cpu->pc++;
-			printf("Unsupported opcode:%x\nPC:%x\n", instruction, cpu->pc);
+		const int count = (int)((end - cpu->cycles) / MAX_INSTRUCTION_CYCLES);
+		run_batch(cpu, count > 0 ? count : 1);
 	}
+	store_nz(cpu);
+
+	return event_first ? run_event_reached : run_budget_spent;
 }
 
-void cpu_clear_memory(cpu* cpu)
+void cpu_print_fusion_hits(const cpu* cpu)
 {
-	memset(&cpu->memory, 0, MAX_MEMORY);
+	puts("Superinstruction hits:");
+#define FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand) \
+	printf("  %-24s %u\n", #name, cpu->fusion_hits[fusion_##name]);
+#define FUSION_TRIPLE(name, ...) \
+	printf("  %-24s %u\n", #name, cpu->fusion_hits[fusion_##name]);
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
 }
 
+// The pattern tables belong to the cartridge and stay
 void ppu_clear_memory(ppu* ppu)
 {
-	memset(&ppu->memory.data, 0, VRAM_SIZE);
+	memset(ppu->memory.name_tables, 0, sizeof(ppu->memory.name_tables));
+	memset(ppu->memory.palette, 0, PALETTE_SIZE);
 	memset(&ppu->oam.data, 0, OAM_SIZE);
 
 	ppu->ppu_data_addr = 0x00;
+	ppu->ppu_temp_addr = 0x00;
+	ppu->fine_x = 0x00;
 	ppu->ppu_latch = false;
 	ppu->ppu_latch = false;
 }
@@ -1398,18 +2236,46 @@ void ppu_clear_registers(ppu* ppu)
 	ppu->registers.ppu_ctrl = 0x00;
 	ppu->registers.ppu_data = 0x00;
 	ppu->registers.ppu_mask = 0x00;
-	ppu->registers.ppu_scroll_x = 0x00;
-	ppu->registers.ppu_scroll_y = 0x00;
 	ppu->registers.ppu_status = 0x00;
+#ifdef BUS_ACCURATE
+	ppu->io_latch = 0x00;
+#endif
+
+	// The PPU starts at the top of a frame, along with the CPU's cycle 0
+	ppu->clock = 0;
+	ppu->scanline = 0;
+	ppu->dot = 0;
+	ppu->odd_frame = false;
+	ppu->sprite_0_hit_dot = 0;
+	ppu->frames = 0;
+	ppu->framebuffer = NULL;
 }
 
 void cpu_init(cpu* cpu, const word prg_size)
 {
+	// The hot fields have to share the first cache line, see cpu.h
+	assert(offsetof(struct cpu, ppu.ppu_data_addr) + sizeof(word) <= CACHE_LINE_SIZE);
+
 	cpu->sp = 0xFF;
 	cpu->p = 0b00100000;
 	cpu->a = 0x00;
 	cpu->x = 0x00;
 	cpu->y = 0x00;
+	cpu->cycles = INTERRUPT_CYCLES;
+	cpu->event_cycle = UINT64_MAX;
+	cpu->idle_cycles = 0;
+	cpu->interrupts = 0;
+	cpu->nmi_line = false;
+	cpu->irq_lines = 0;
+	cpu->decode_cache = NULL;
+	cpu->jit = NULL;
+	cpu->hooks = NULL;
+	cpu->recompiled = false;
+#ifdef BUS_ACCURATE
+	cpu->open_bus = 0x00;
+#endif
+	cpu_map_memory(cpu);
+	memset(cpu->fusion_hits, 0, sizeof(cpu->fusion_hits));
 
 	cpu->pc = ((word)(read_memory(cpu, 0x8000 + prg_size - 3) << 8)) | read_memory(cpu, 0x8000 + prg_size - 4);
 
@@ -1495,9 +2361,24 @@ void cpu_set_n_flag(cpu* cpu, const char val)
 	cpu->p ^= (-val ^ cpu->p) & N_FLAG;
 }
 
-void cpu_call_nmi(cpu* cpu)
+void cpu_set_nmi(cpu* cpu, const bool level)
 {
-	cpu_stack_push_16(cpu, cpu->pc);
-	cpu_stack_push_8(cpu, cpu->p);
-	cpu->pc = cpu->nmi_prt;
+	// Edge triggered: the request stays after the line goes down again
+	if (level && !cpu->nmi_line)
+	{
+		cpu->interrupts |= INTERRUPT_NMI;
+	}
+	cpu->nmi_line = level;
+}
+
+void cpu_set_irq(cpu* cpu, const byte source, const bool level)
+{
+	// Level triggered: the request lasts as long as the line is held
+	cpu->irq_lines = level ? cpu->irq_lines | source : cpu->irq_lines & ~source;
+	cpu->interrupts = (cpu->interrupts & ~INTERRUPT_IRQ) | (cpu->irq_lines != 0 ? INTERRUPT_IRQ : 0);
+}
+
+uint64_t cpu_next_vblank_cycle(const cpu* cpu)
+{
+	return (ppu_next_vblank(&cpu->ppu) + DOTS_PER_CPU_CYCLE - 1) / DOTS_PER_CPU_CYCLE;
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "config.h"
 #include "ppu.h"
@@ -8,6 +9,24 @@
 
 #define MAX_MEMORY		65536
 #define STACK_BASE		0x100
+#define PRG_ROM_START	0x8000
+
+// 2KB of internal RAM, mirrored through $1FFF
+#define RAM_SIZE		0x800
+#define RAM_END			0x2000
+
+// Optional cartridge RAM at $6000-$7FFF
+#define PRG_RAM_START	0x6000
+#define PRG_RAM_SIZE	0x2000
+
+// The memory map is made of 1KB pages, the smallest unit the NES mirrors memory in
+#define PAGE_SHIFT		10
+#define PAGE_SIZE		(1 << PAGE_SHIFT)
+#define PAGE_COUNT		(MAX_MEMORY >> PAGE_SHIFT)
+
+// Instructions starting in $8000-$FFFD are pre-decoded.
+// The last two bytes are left out so that no cached instruction wraps around to $0000.
+#define DECODE_CACHE_SIZE	0x7FFE
 
 #define SIGN_BIT		0x80
 
@@ -20,18 +39,82 @@
 #define N_FLAG			0b10000000
 #define UNUSED_FLAG		0b00100000
 
+// Cycles taken by the reset sequence, NMI, IRQ and BRK
+#define INTERRUPT_CYCLES	7
+// Cycles the CPU is halted for by a write to OAM_DMA, one more when the write ends on an odd cycle
+#define OAM_DMA_CYCLES		513
+// No instruction takes longer, page-crossing and branch penalties included
+#define MAX_INSTRUCTION_CYCLES	7
+
+// Interrupt requests waiting in cpu->interrupts for the next instruction boundary
+#define INTERRUPT_NMI	0b00000001
+#define INTERRUPT_IRQ	0b00000010
+
 
 
 typedef struct
 {
-	byte data[MAX_MEMORY];
+	byte ram[RAM_SIZE];
+
+	// The cartridge, owned by whoever loaded it. 16KB of PRG-ROM are mirrored at $C000. prg_ram may be NULL.
+	const byte* prg_rom;
+	uint32_t prg_rom_size;
+	byte* prg_ram;
+
+	// A raw 6502 program sees 64KB of RAM instead of a cartridge. When set, $0800-$FFFF come from image,
+	// but for the PPU registers at $2000-$2007 and the I/O registers at $4000-$40FF.
+	byte* image;
 }memory;
 
+// Pre-decoded PRG-ROM instruction: handler, operand, length and base cycles
+typedef struct decoded_instruction decoded_instruction;
+
+// Translated x86-64 code, see jit.c
+typedef struct translation_cache translation_cache;
+
+// Subroutines run as native code, see hooks.c
+typedef struct hook_table hook_table;
+
+struct cpu;
+
+typedef byte (*bus_read_handler)(struct cpu* cpu, word address);
+typedef void (*bus_write_handler)(struct cpu* cpu, word address, byte value);
+
+// Where the accesses to a page go: straight to host memory through read and write,
+// or to the handlers where they are NULL
 typedef struct
 {
-	word nmi_prt;
-	word irq_prt;
+	byte* read;
+	byte* write;
+	bus_read_handler read_handler;
+	bus_write_handler write_handler;
+} memory_page;
+
+// Why cpu_run returned
+typedef enum
+{
+	// The cycle budget is used up
+	run_budget_spent,
+	// cycles reached event_cycle, the frontend has work to do
+	run_event_reached
+} run_result;
+
+// Instruction pairs and triples the decode cache runs as one handler, see fusions.h
+typedef enum
+{
+#define FUSION(name, ...) fusion_##name,
+#define FUSION_TRIPLE(name, ...) fusion_##name,
+#include "fusions.h"
+#undef FUSION_TRIPLE
+#undef FUSION
+	FUSION_COUNT
+} fusion;
 
+// Everything an instruction touches outside of memory sits in the first cache line: the registers, the cycle
+// counters, the fetch window, the pointers run_batch checks before each instruction and the PPU registers that polling loops read.
+// The bulk arrays start on cache lines of their own behind it.
+typedef struct CACHE_ALIGNED cpu
+{
 	// Accumulator
 	byte a;
 
@@ -53,23 +136,100 @@ typedef struct
 	// C = Carry
 	byte p;
 
+	// Set by recompiled_attach when the PRG-ROM in memory is the one recompiled.c was generated from
+	bool recompiled;
+#ifdef BUS_ACCURATE
+	// The last byte read or written, what reads of unmapped addresses see
+	byte open_bus;
+#endif
+
+	// INTERRUPT_NMI and INTERRUPT_IRQ, instructions only look at the interrupt lines while this is not 0
+	byte interrupts;
+
+	// N and Z of the last result while instructions run, see cpu.c. They are back in p when cpu_exec or cpu_exec_batch returns.
+	word nz;
+
 	// Program counter
 	word pc;
 
+	// Instructions are fetched straight from fetch_window, the host memory behind the fetch_size bytes from
+	// fetch_start on. It spans the pages around pc that are contiguous in host memory and moves when pc leaves it.
+	word fetch_start;
+	word fetch_size;
+
+	// CPU cycles since reset
+	uint64_t cycles;
+	// cpu_run stops once cycles gets here, such as at the start of vblank
+	uint64_t event_cycle;
 
-	memory memory;
+	// NULL unless jit_create attached a translation cache
+	translation_cache* jit;
+	const byte* fetch_window;
+
+	// Starts with the registers, which fill the rest of the first cache line
 	ppu ppu;
+
 	controller* controller;
-} cpu;
 
-#define OP(opcode, operation, address_mode) \
-case 0x##opcode: \
-	##operation(cpu, ##address_mode); \
-	break
+	word nmi_prt;
+	word irq_prt;
+
+	// The NMI line, an NMI is requested when it goes up
+	bool nmi_line;
+	// One bit per device holding the IRQ line, an IRQ is requested for as long as any of them does
+	byte irq_lines;
+
+	// Cycles of idle loop iterations that were skipped instead of run, included in cycles
+	uint64_t idle_cycles;
+
+	// One entry per PRG-ROM address, NULL until cpu_decode_prg_rom is called. cpu_exec_batch looks it up once per batch.
+	decoded_instruction* decode_cache;
+	// NULL unless hooks_attach found routines to run natively. Only JSR looks at it.
+	hook_table* hooks;
+
+	// The memory map, see cpu_map_memory
+	CACHE_ALIGNED memory_page pages[PAGE_COUNT];
+
+	CACHE_ALIGNED memory memory;
+
+	// Executions of each superinstruction
+	unsigned int fusion_hits[FUSION_COUNT];
+} cpu;
 
 void cpu_exec(cpu* cpu, byte instruction);
+// Fetches and executes count instructions starting at pc, taking interrupts between them like cpu_run
+void cpu_exec_batch(cpu* cpu, int count);
+// Runs whole instructions until budget cycles have passed or cycles reaches event_cycle, whichever comes first.
+// The last instruction may run past the limit.
+run_result cpu_run(cpu* cpu, int budget);
+// Clears RAM and the PPU and detaches the cartridge
 void cpu_clear_memory(cpu* cpu);
+// Maps the PRG-ROM and PRG-RAM of a cartridge. prg_ram may be NULL, the memory stays with the caller.
+void cpu_load_cartridge(cpu* cpu, const byte* prg_rom, uint32_t prg_rom_size, byte* prg_ram);
+// Maps a 64KB raw 6502 program instead of a cartridge. Its first 2KB are copied to RAM, the rest stays with the caller.
+void cpu_load_image(cpu* cpu, byte* image);
 void cpu_init(cpu* cpu, const word prg_size);
+// Builds the page table: plain memory is accessed directly, the PPU and I/O registers through their handlers.
+// Call it again after attaching or removing a translation cache, RAM writes then have to go through cpu_write_memory,
+// and whenever the memory behind a page changes, such as on a bank switch, to move the fetch window.
+void cpu_map_memory(cpu* cpu);
+// Memory without the registers: RAM, the cartridge or the raw image. Reads 0 where nothing is mapped.
+byte cpu_read_memory(const cpu* cpu, word address);
+// Stores into RAM, PRG-RAM or the raw image and keeps the decoded and translated code in sync. Other writes are dropped.
+void cpu_write_memory(cpu* cpu, word address, byte value);
+// Decodes every instruction in PRG-ROM. Call once the ROM is in memory.
+void cpu_decode_prg_rom(cpu* cpu);
+void cpu_free(cpu* cpu);
+void cpu_print_fusion_hits(const cpu* cpu);
+byte cpu_instruction_length(const address_mode address_mode);
+// Number of instructions in the loop at address when it only reads RAM, the cartridge or PPU_STATUS and ends by
+// branching or jumping back to address, 0 otherwise. Once such a loop spins it keeps spinning until the next event,
+// or until the PPU changes PPU_STATUS when it polls it.
+byte cpu_idle_loop_length(const cpu* cpu, word address);
+
+// Memory accesses as the running program sees them, I/O registers included
+byte cpu_read_bus(cpu* cpu, const word address);
+void cpu_write_bus(cpu* cpu, const word address, const byte value);
 
 bool cpu_get_c_flag(const cpu* cpu);
 bool cpu_get_z_flag(const cpu* cpu);
@@ -87,7 +247,19 @@ void cpu_set_b_flag(cpu* cpu, const char val);
 void cpu_set_v_flag(cpu* cpu, const char val);
 void cpu_set_n_flag(cpu* cpu, const char val);
 
-void cpu_call_nmi(cpu* cpu);
+// Sets the level of the NMI line. Going up requests an NMI, which cpu_run takes at the next instruction boundary.
+void cpu_set_nmi(cpu* cpu, bool level);
+// Holds or releases the IRQ line for the devices owning the bits in source. cpu_run takes an IRQ at the next
+// instruction boundary while any device holds it and the I flag is clear.
+void cpu_set_irq(cpu* cpu, byte source, bool level);
+// Whether an NMI or an IRQ the I flag lets through is waiting. Batches, translated blocks and recompiled blocks
+// stop on it so that it is taken before the next instruction.
+bool cpu_interrupt_due(const cpu* cpu);
+// Runs the PPU up to cycles, see ppu_run. With NMI enabled in PPU_CTRL, the PPU holds the NMI line up during vblank.
+// Accesses to the PPU registers and OAM_DMA do it first, the frontend at the start of vblank.
+void cpu_sync_ppu(cpu* cpu);
+// The cycle in which the PPU starts the next vblank
+uint64_t cpu_next_vblank_cycle(const cpu* cpu);
 word cpu_stack_pop_16(cpu* cpu);
 byte cpu_stack_pop_8(cpu* cpu);
 void cpu_stack_push_16(cpu* cpu, const word val);
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include "disassembler.h"
+
+typedef struct
+{
+	const char* mnemonic;
+	address_mode address_mode;
+	bool official;
+} opcode_definition;
+
+#define OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) [0x##opcode] = { #mnemonic, address_mode, true },
+#define UNOFFICIAL_OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) [0x##opcode] = { #mnemonic, address_mode, false },
+static const opcode_definition opcode_definitions[256] =
+{
+#include "opcodes.h"
+};
+#undef UNOFFICIAL_OP
+#undef OP
+
+byte disassemble(const cpu* cpu, const word address, char* buffer, const size_t size)
+{
+	const opcode_definition* definition = &opcode_definitions[cpu_read_memory(cpu, address)];
+	const byte low = cpu_read_memory(cpu, (word)(address + 1));
+	const word operand = (word)(cpu_read_memory(cpu, (word)(address + 2)) << 8) | low;
+
+	switch (definition->address_mode)
+	{
+		case implicit:
+			snprintf(buffer, size, "%s", definition->mnemonic);
+			break;
+		case accumulator:
+			snprintf(buffer, size, "%s A", definition->mnemonic);
+			break;
+		case immediate:
+			snprintf(buffer, size, "%s #$%02X", definition->mnemonic, low);
+			break;
+		case zero_page:
+			snprintf(buffer, size, "%s $%02X", definition->mnemonic, low);
+			break;
+		case zero_page_x:
+			snprintf(buffer, size, "%s $%02X,X", definition->mnemonic, low);
+			break;
+		case zero_page_y:
+			snprintf(buffer, size, "%s $%02X,Y", definition->mnemonic, low);
+			break;
+		case relative:
+			snprintf(buffer, size, "%s $%04X", definition->mnemonic, (word)(address + 2 + (signed char)low));
+			break;
+		case absolute:
+			snprintf(buffer, size, "%s $%04X", definition->mnemonic, operand);
+			break;
+		case absolute_x:
+			snprintf(buffer, size, "%s $%04X,X", definition->mnemonic, operand);
+			break;
+		case absolute_y:
+			snprintf(buffer, size, "%s $%04X,Y", definition->mnemonic, operand);
+			break;
+		case indirect:
+			snprintf(buffer, size, "%s ($%04X)", definition->mnemonic, operand);
+			break;
+		case indexed_indirect:
+			snprintf(buffer, size, "%s ($%02X,X)", definition->mnemonic, low);
+			break;
+		case indirect_indexed:
+			snprintf(buffer, size, "%s ($%02X),Y", definition->mnemonic, low);
+			break;
+	}
+
+	return cpu_instruction_length(definition->address_mode);
+}
+
+void disassemble_trace(const cpu* cpu, const word address, char* buffer, const size_t size)
+{
+	char instruction[32];
+	const byte length = disassemble(cpu, address, instruction, sizeof(instruction));
+
+	char bytes[10] = "";
+	for (byte i = 0; i < length; i++)
+	{
+		snprintf(bytes + i * 3, sizeof(bytes) - i * 3, "%02X ", cpu_read_memory(cpu, (word)(address + i)));
+	}
+
+	// P as the 6502 pushes it from an interrupt: bit 5 always set, no B flag
+	const byte status = (byte)((cpu->p | UNUSED_FLAG) & ~B_FLAG);
+	snprintf(buffer, size, "%04X  %-9s%c%-32sA:%02X X:%02X Y:%02X P:%02X SP:%02X CYC:%llu", address, bytes,
+		opcode_definitions[cpu_read_memory(cpu, address)].official ? ' ' : '*', instruction,
+		cpu->a, cpu->x, cpu->y, status, cpu->sp, (unsigned long long)cpu->cycles);
+}
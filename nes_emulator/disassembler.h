@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "cpu.h"
+
+// Fits every line disassemble_trace writes
+#define TRACE_LINE_SIZE	128
+
+// Writes the instruction at address the way assemblers spell it, such as "LDA $0200,X" or "BNE $C0F2",
+// with branch targets resolved. Returns its length in bytes.
+byte disassemble(const cpu* cpu, word address, char* buffer, size_t size);
+
+// Writes the line nestest.log has for the instruction at address with the registers as they are now:
+// "C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7".
+// Unofficial opcodes are marked with a * in front of the mnemonic.
+void disassemble_trace(const cpu* cpu, word address, char* buffer, size_t size);
@@ -0,0 +1,26 @@
+// Superinstruction list. Each entry is
+// FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand)
+// first_operand limits the fusion to one operand value of the first instruction, -1 matches any operand.
+// The first instruction must not depend on pc, the fused handler runs it with pc already past the pair.
+// Triples are
+// FUSION_TRIPLE(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, third_opcode, third_operation, third_mode)
+// A cached entry holds two operands, so the first instruction of a triple takes none and only the third may depend on pc.
+// This file is an X-macro: define FUSION and FUSION_TRIPLE before including it and they expand once per pattern.
+
+#ifndef FUSION
+#error "Define FUSION(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, first_operand) before including fusions.h"
+#endif
+
+#ifndef FUSION_TRIPLE
+#error "Define FUSION_TRIPLE(name, first_opcode, first_operation, first_mode, second_opcode, second_operation, second_mode, third_opcode, third_operation, third_mode) before including fusions.h"
+#endif
+
+FUSION_TRIPLE(clc_adc_sta, 18, clc, implicit, 69, adc, immediate, 8D, sta, absolute)
+FUSION_TRIPLE(clc_adc_zero_page_sta, 18, clc, implicit, 65, adc, zero_page, 8D, sta, absolute)
+
+FUSION(lda_sta, AD, lda, absolute, 8D, sta, absolute, -1)
+FUSION(dex_bne, CA, dex, implicit, D0, bne, relative, -1)
+FUSION(lda_ppu_status_bpl, AD, lda, absolute, 10, bpl, relative, PPU_STATUS)
+FUSION(bit_ppu_status_bpl, 2C, bit, absolute, 10, bpl, relative, PPU_STATUS)
+FUSION(inc_bne, E6, inc, zero_page, D0, bne, relative, -1)
+FUSION(cmp_beq, C9, cmp, immediate, F0, beq, relative, -1)
@@ -0,0 +1,379 @@
+#include "config.h"
+
+#ifdef NATIVE_HOOKS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hooks.h"
+
+// Instructions HOOK_VERIFY lets a routine run before giving up on its RTS
+#define MAX_VERIFY_INSTRUCTIONS	1000000
+
+// Runs the routine at address from its first instruction through its RTS with the flags in p.
+// Returns false, without touching anything, when it can't, and the interpreter runs the routine instead.
+typedef bool (*native_routine)(cpu* cpu, word address);
+
+typedef struct
+{
+	const char* name;
+	// The 6502 code the routine replaces, RTS included
+	const byte* code;
+	byte length;
+	native_routine run;
+} known_routine;
+
+typedef struct
+{
+	word address;
+	const known_routine* routine;
+	unsigned int calls;
+} hook;
+
+struct hook_table
+{
+	hook hooks[MAX_HOOKS];
+	int count;
+
+#ifdef HOOK_VERIFY
+	// Copy of the cpu that runs every hooked routine through the interpreter
+	cpu shadow;
+	controller shadow_controller;
+	// The memory the shadow cpu writes to instead of the loader's
+	byte shadow_image[MAX_MEMORY];
+	byte shadow_prg_ram[PRG_RAM_SIZE];
+#endif
+};
+
+// Cycles of a taken branch from the instruction ending before next, one more when it lands on another page
+static byte taken_branch_cycles(const word next, const word target)
+{
+	return 3 + (((next ^ target) & 0xFF00) != 0);
+}
+
+// The RTS that ends every routine
+static bool return_from_routine(cpu* cpu, const uint64_t cycles)
+{
+	cpu->pc = cpu_stack_pop_16(cpu) + 1;
+	cpu->cycles += cycles + 6;
+	return true;
+}
+
+// 16-bit division by shift and subtract, the loop of rom/division.bin:
+// $FB/$FC divided by $58/$59 leaves the quotient in $FB/$FC and the remainder in $FD/$FE
+static const byte divide_16_code[] =
+{
+	0xA9, 0x00,			// LDA #$00
+	0x85, 0xFD,			// STA $FD
+	0x85, 0xFE,			// STA $FE
+	0xA2, 0x10,			// LDX #$10
+	0x06, 0xFB,			// ASL $FB
+	0x26, 0xFC,			// ROL $FC
+	0x26, 0xFD,			// ROL $FD
+	0x26, 0xFE,			// ROL $FE
+	0xA5, 0xFD,			// LDA $FD
+	0x38,				// SEC
+	0xE5, 0x58,			// SBC $58
+	0xA8,				// TAY
+	0xA5, 0xFE,			// LDA $FE
+	0xE5, 0x59,			// SBC $59
+	0x90, 0x06,			// BCC +6
+	0x85, 0xFE,			// STA $FE
+	0x84, 0xFD,			// STY $FD
+	0xE6, 0xFB,			// INC $FB
+	0xCA,				// DEX
+	0xD0, 0xE3,			// BNE -29
+	0x60				// RTS
+};
+
+static bool run_divide_16(cpu* cpu, const word address)
+{
+	word quotient = (word)(cpu_read_memory(cpu, 0xFC) << 8) | cpu_read_memory(cpu, 0xFB);
+	word remainder = 0;
+	const byte divisor_low = cpu_read_memory(cpu, 0x58);
+	const byte divisor_high = cpu_read_memory(cpu, 0x59);
+
+	// LDA, STA, STA, LDX
+	uint64_t cycles = 2 + 3 + 3 + 2;
+	byte a = 0, y = 0;
+	bool carry = false, overflow = false;
+
+	for (int bit = 0; bit < 16; bit++)
+	{
+		// The bit shifted out of $FE is lost to the SEC
+		remainder = (word)(remainder << 1) | (quotient >> 15);
+		quotient <<= 1;
+
+		// Both SBCs, exactly as the 6502 computes them
+		const int low = (remainder & 0xFF) - divisor_low;
+		const byte high = remainder >> 8;
+		const int difference = high - divisor_high - (low < 0);
+		y = (byte)low;
+		a = (byte)difference;
+		carry = difference >= 0;
+		overflow = ((high ^ divisor_high) & (high ^ a) & SIGN_BIT) != 0;
+		// ASL, ROL, ROL, ROL, LDA, SEC, SBC, TAY, LDA, SBC
+		cycles += 5 + 5 + 5 + 5 + 3 + 2 + 3 + 2 + 3 + 3;
+
+		if (carry)
+		{
+			// BCC not taken, STA, STY, INC
+			remainder = (word)(a << 8) | y;
+			quotient |= 1;
+			cycles += 2 + 3 + 3 + 5;
+		}
+		else
+		{
+			cycles += taken_branch_cycles(address + 0x1C, address + 0x22);
+		}
+
+		// DEX, BNE
+		cycles += 2 + (bit < 15 ? taken_branch_cycles(address + 0x25, address + 0x08) : 2);
+	}
+
+	cpu_write_memory(cpu, 0xFB, quotient & 0xFF);
+	cpu_write_memory(cpu, 0xFC, quotient >> 8);
+	cpu_write_memory(cpu, 0xFD, remainder & 0xFF);
+	cpu_write_memory(cpu, 0xFE, remainder >> 8);
+
+	cpu->a = a;
+	cpu->x = 0;
+	cpu->y = y;
+	// N and Z come from the last DEX, C and V from the last SBC
+	cpu->p = (cpu->p & ~(N_FLAG | Z_FLAG | C_FLAG | V_FLAG)) | Z_FLAG | (carry ? C_FLAG : 0) | (overflow ? V_FLAG : 0);
+	return return_from_routine(cpu, cycles);
+}
+
+// Where push_char keeps its zero-terminated string
+#define MESSAGE	0x0204
+
+// Inserts A in front of the string at $0204, from rom/bin_to_dec.bin
+static const byte push_char_code[] =
+{
+	0x48,				// PHA
+	0xA0, 0x00,			// LDY #$00
+	0xB9, 0x04, 0x02,	// LDA $0204,Y
+	0xAA,				// TAX
+	0x68,				// PLA
+	0x99, 0x04, 0x02,	// STA $0204,Y
+	0xC8,				// INY
+	0x8A,				// TXA
+	0x48,				// PHA
+	0xD0, 0xF3,			// BNE -13
+	0x68,				// PLA
+	0x99, 0x04, 0x02,	// STA $0204,Y
+	0x60				// RTS
+};
+
+static bool run_push_char(cpu* cpu, const word address)
+{
+	// Y would wrap around for a string that doesn't end within a page
+	int length = 0;
+	while (length < 0xFF && cpu_read_memory(cpu, MESSAGE + length) != 0)
+	{
+		length++;
+	}
+	if (length == 0xFF)
+	{
+		return false;
+	}
+
+	// The loop moves every byte one up, the terminator included, and ends on it
+	const int iterations = length + 1;
+	for (int i = iterations; i > 0; i--)
+	{
+		cpu_write_memory(cpu, MESSAGE + i, cpu_read_memory(cpu, MESSAGE + i - 1));
+	}
+	cpu_write_memory(cpu, MESSAGE, cpu->a);
+	// The last byte pushed and pulled is the terminator
+	cpu_write_memory(cpu, STACK_BASE + cpu->sp, 0x00);
+
+	// PHA, LDY, then LDA, TAX, PLA, STA, INY, TXA, PHA and BNE per iteration, then PLA and STA
+	uint64_t cycles = 3 + 2 + iterations * (4 + 2 + 4 + 5 + 2 + 2 + 3) + 2 + 4 + 5;
+	cycles += (iterations - 1) * taken_branch_cycles(address + 0x10, address + 0x03);
+	for (int i = 0; i < iterations; i++)
+	{
+		cycles += ((MESSAGE & 0xFF) + i) >> 8;
+	}
+
+	cpu->a = 0x00;
+	cpu->x = 0x00;
+	cpu->y = (byte)iterations;
+	cpu->p = (cpu->p & ~N_FLAG) | Z_FLAG;
+	return return_from_routine(cpu, cycles);
+}
+
+static const known_routine known_routines[] =
+{
+	{ "divide_16", divide_16_code, sizeof(divide_16_code), run_divide_16 },
+	{ "push_char", push_char_code, sizeof(push_char_code), run_push_char },
+};
+
+static bool code_matches(const cpu* cpu, const word address, const known_routine* routine)
+{
+	for (byte i = 0; i < routine->length; i++)
+	{
+		if (cpu_read_memory(cpu, (word)(address + i)) != routine->code[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+static hook* find_hook(hook_table* table, const word address)
+{
+	for (int i = 0; i < table->count; i++)
+	{
+		if (table->hooks[i].address == address)
+		{
+			return &table->hooks[i];
+		}
+	}
+	return NULL;
+}
+
+int hooks_attach(cpu* cpu)
+{
+	hook_table* table = cpu->hooks;
+
+	for (int address = PRG_ROM_START; address < MAX_MEMORY - 2; address++)
+	{
+		// JSR absolute
+		if (cpu_read_memory(cpu, (word)address) != 0x20)
+		{
+			continue;
+		}
+
+		const word target = (word)(cpu_read_memory(cpu, (word)(address + 2)) << 8) | cpu_read_memory(cpu, (word)(address + 1));
+		for (size_t i = 0; i < sizeof(known_routines) / sizeof(known_routines[0]); i++)
+		{
+			if (!code_matches(cpu, target, &known_routines[i]))
+			{
+				continue;
+			}
+
+			if (table == NULL)
+			{
+				table = calloc(1, sizeof(hook_table));
+				if (table == NULL)
+				{
+					return 0;
+				}
+				cpu->hooks = table;
+			}
+			if (find_hook(table, target) == NULL && table->count < MAX_HOOKS)
+			{
+				table->hooks[table->count++] = (hook){ target, &known_routines[i], 0 };
+			}
+		}
+	}
+
+	return table != NULL ? table->count : 0;
+}
+
+void hooks_destroy(cpu* cpu)
+{
+	free(cpu->hooks);
+	cpu->hooks = NULL;
+}
+
+#ifdef HOOK_VERIFY
+// Runs the routine natively, then through the interpreter on a copy of the cpu, and stops on any difference
+static bool verify_hook(cpu* cpu, const hook* hook)
+{
+	hook_table* table = cpu->hooks;
+
+	memcpy(&table->shadow, cpu, sizeof(table->shadow));
+	table->shadow_controller = *cpu->controller;
+	table->shadow.controller = &table->shadow_controller;
+	table->shadow.decode_cache = NULL;
+	table->shadow.jit = NULL;
+	table->shadow.hooks = NULL;
+	if (cpu->memory.image != NULL)
+	{
+		memcpy(table->shadow_image, cpu->memory.image, sizeof(table->shadow_image));
+		table->shadow.memory.image = table->shadow_image;
+	}
+	if (cpu->memory.prg_ram != NULL)
+	{
+		memcpy(table->shadow_prg_ram, cpu->memory.prg_ram, sizeof(table->shadow_prg_ram));
+		table->shadow.memory.prg_ram = table->shadow_prg_ram;
+	}
+	cpu_map_memory(&table->shadow);
+
+	if (!hook->routine->run(cpu, hook->address))
+	{
+		return false;
+	}
+
+	// The routine is over once its RTS took the return address JSR pushed
+	const byte return_sp = table->shadow.sp + 2;
+	const word return_pc = (word)(cpu_read_memory(&table->shadow, STACK_BASE + (byte)(table->shadow.sp + 2)) << 8) +
+		cpu_read_memory(&table->shadow, STACK_BASE + (byte)(table->shadow.sp + 1)) + 1;
+	int executed = 0;
+	while ((table->shadow.pc != return_pc || table->shadow.sp != return_sp) && executed < MAX_VERIFY_INSTRUCTIONS)
+	{
+		cpu_exec(&table->shadow, cpu_read_memory(&table->shadow, table->shadow.pc++));
+		executed++;
+	}
+
+	if (table->shadow.a != cpu->a || table->shadow.x != cpu->x || table->shadow.y != cpu->y ||
+		table->shadow.p != cpu->p || table->shadow.sp != cpu->sp || table->shadow.pc != cpu->pc || table->shadow.cycles != cpu->cycles ||
+		memcmp(table->shadow.memory.ram, cpu->memory.ram, sizeof(cpu->memory.ram)) != 0 ||
+		(cpu->memory.image != NULL && memcmp(table->shadow_image, cpu->memory.image, sizeof(table->shadow_image)) != 0) ||
+		(cpu->memory.prg_ram != NULL && memcmp(table->shadow_prg_ram, cpu->memory.prg_ram, sizeof(table->shadow_prg_ram)) != 0) ||
+		memcmp(&table->shadow.ppu, &cpu->ppu, sizeof(cpu->ppu)) != 0 ||
+		memcmp(&table->shadow_controller, cpu->controller, sizeof(table->shadow_controller)) != 0)
+	{
+		fprintf(stderr, "Hook mismatch in %s at %x after %d instructions\n", hook->routine->name, hook->address, executed);
+		fprintf(stderr, "Interpreter A:%02x X:%02x Y:%02x P:%02x SP:%02x PC:%04x CYC:%llu\n",
+			table->shadow.a, table->shadow.x, table->shadow.y, table->shadow.p, table->shadow.sp, table->shadow.pc,
+			(unsigned long long)table->shadow.cycles);
+		fprintf(stderr, "Native      A:%02x X:%02x Y:%02x P:%02x SP:%02x PC:%04x CYC:%llu\n",
+			cpu->a, cpu->x, cpu->y, cpu->p, cpu->sp, cpu->pc, (unsigned long long)cpu->cycles);
+		abort();
+	}
+
+	return true;
+}
+#endif
+
+bool hooks_call(cpu* cpu)
+{
+	hook* hook = find_hook(cpu->hooks, cpu->pc);
+	if (hook == NULL || !code_matches(cpu, hook->address, hook->routine))
+	{
+		return false;
+	}
+
+#ifdef HOOK_VERIFY
+	if (!verify_hook(cpu, hook))
+#else
+	if (!hook->routine->run(cpu, hook->address))
+#endif
+	{
+		return false;
+	}
+
+	hook->calls++;
+	return true;
+}
+
+void hooks_print_stats(const cpu* cpu)
+{
+	const hook_table* table = cpu->hooks;
+	if (table == NULL)
+	{
+		puts("Native hooks: none");
+		return;
+	}
+
+	puts("Native hooks:");
+	for (int i = 0; i < table->count; i++)
+	{
+		printf("  %-20s $%04X %u calls\n", table->hooks[i].routine->name, table->hooks[i].address, table->hooks[i].calls);
+	}
+}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "cpu.h"
+
+#ifdef NATIVE_HOOKS
+// Most routines hooked at once
+#define MAX_HOOKS	16
+
+// Looks for the known routines at the targets of the JSRs in $8000-$FFFF and attaches a hook table for them.
+// Returns the number of routines hooked, the table is left out when there are none.
+int hooks_attach(cpu* cpu);
+void hooks_destroy(cpu* cpu);
+
+// Called by JSR once pc is on the routine, with the flags in p. When a hook matches pc and the code at pc is still
+// the routine it was made for, runs the routine natively up to and including its RTS, cycles included, and
+// returns true. A hooked call counts as the JSR alone in cpu_exec_batch.
+bool hooks_call(cpu* cpu);
+
+void hooks_print_stats(const cpu* cpu);
+#endif
@@ -0,0 +1,1579 @@
+#ifndef _WIN32
+// MAP_ANONYMOUS is not in strict C or POSIX
+#define _DEFAULT_SOURCE
+#endif
+
+#include "config.h"
+
+#ifdef JIT
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#include "jit.h"
+
+// Executable memory for translated code. Everything is flushed when it fills up.
+#define CODE_BUFFER_SIZE		(4 * 1024 * 1024)
+
+// Longest basic block the translator builds
+#define MAX_BLOCK_INSTRUCTIONS	32
+
+// Room reserved for the code of one 6502 instruction, exit stubs included
+#define MAX_INSTRUCTION_CODE	512
+
+// Room reserved for a block, the exit after its last instruction included
+#define MAX_BLOCK_CODE			((MAX_BLOCK_INSTRUCTIONS + 1) * MAX_INSTRUCTION_CODE)
+
+// Code is translated from internal RAM at $0000-$07FF, PRG-RAM and PRG-ROM.
+// Accesses to internal RAM go straight to memory.ram, the rest of memory is found through the page table.
+#define RAM_OFFSET				((int32_t)offsetof(cpu, memory.ram))
+#define PAGES_OFFSET			((int32_t)offsetof(cpu, pages))
+
+// log2(sizeof(memory_page))
+#define PAGE_ENTRY_SHIFT		5
+
+// Runs translated blocks from pc until the next one is missing, doesn't fit in count instructions or an interrupt is due.
+// Returns the number of instructions executed.
+typedef int (*entry_function)(cpu* cpu, int count);
+
+// Marks an address the translator gave up on, the interpreter runs it without another attempt
+#define UNTRANSLATABLE			((const byte*)(uintptr_t)1)
+
+struct translation_cache
+{
+	byte* code;
+	size_t code_used;
+
+	// Entry, dispatcher and exit shared by every block, at the start of the code buffer
+	entry_function enter;
+	const byte* dispatch;
+	size_t dispatcher_size;
+
+	// Code and instruction count of the block starting at each address
+	const byte* blocks[MAX_MEMORY];
+	byte block_lengths[MAX_MEMORY];
+
+	// Non-zero for every byte that has been translated. Writing one flushes the cache.
+	byte code_map[MAX_MEMORY];
+
+	unsigned int blocks_translated;
+	unsigned int flushes;
+
+#ifdef JIT_VERIFY
+	// Copy of the cpu that runs every block through the interpreter
+	cpu shadow;
+	controller shadow_controller;
+	// The memory the shadow cpu writes to instead of the loader's
+	byte shadow_image[MAX_MEMORY];
+	byte shadow_prg_ram[PRG_RAM_SIZE];
+#endif
+};
+
+// x86-64 registers
+enum
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+};
+
+// The 6502 registers stay in callee-saved registers for the whole block so helper calls leave them alone.
+// eax, ecx, edx and r8-r10 are scratch. Every register holds a zero-extended byte.
+#define REG_CPU		RBX
+#define REG_A		R12
+#define REG_X		R13
+#define REG_Y		R14
+#define REG_P		R15
+#define REG_SP		RBP
+
+#ifdef _WIN32
+// Microsoft x64 calling convention, callees get 32 bytes of shadow space
+#define ARG0		RCX
+#define ARG1		RDX
+#define ARG2		R8
+#define FRAME_BASE	32
+#else
+// System V AMD64 calling convention
+#define ARG0		RDI
+#define ARG1		RSI
+#define ARG2		RDX
+#define FRAME_BASE	0
+#endif
+
+// Stack slots: an effective address kept across a helper call, the instructions left and the count at entry
+#define SPILL_SLOT	(FRAME_BASE)
+#define BUDGET_SLOT	(FRAME_BASE + 8)
+#define COUNT_SLOT	(FRAME_BASE + 16)
+
+// After six pushes and the return address this keeps helper calls 16-byte aligned
+#define FRAME_SIZE	(FRAME_BASE + 24)
+
+// Condition codes of jcc and setcc
+enum
+{
+	CC_O = 0x0,
+	CC_C = 0x2,
+	CC_NC = 0x3,
+	CC_Z = 0x4,
+	CC_NZ = 0x5,
+	CC_BE = 0x6,
+	CC_L = 0xC
+};
+
+// Group 1 arithmetic: the /n extension of 81 and 83, the r/m32, r32 form is n * 8 + 1
+enum
+{
+	ALU_ADD,
+	ALU_OR,
+	ALU_ADC,
+	ALU_SBB,
+	ALU_AND,
+	ALU_SUB,
+	ALU_XOR,
+	ALU_CMP
+};
+
+// Group 2 shifts, the /n extension of C1
+#define SHIFT_LEFT	4
+#define SHIFT_RIGHT	5
+
+typedef struct
+{
+	byte* code;
+	size_t size;
+
+	// Block exits jump here with the next pc in ecx
+	const byte* dispatch;
+
+	const byte* code_map;
+	// The cpu whose code is translated, NULL for the dispatcher
+	const cpu* cpu;
+
+	// Where the instruction being translated continues, and the instructions and base cycles run once it is done, used by exits
+	word next_pc;
+	int executed;
+	int cycles;
+	// The instruction being translated takes a cycle more when its indexed read crosses a page, see opcodes.h
+	bool page_cycle;
+	// The instruction being translated goes through the bus, where a PPU access can raise an NMI
+	bool bus_access;
+} emitter;
+
+typedef enum
+{
+	// Translated, the block goes on with the next instruction
+	translated,
+	// Translated, the instruction left the block
+	block_end,
+	// The interpreter has to run it. The block ends before the instruction.
+	untranslated
+} translation;
+
+// Effective address of a memory operand, either known at translation time or computed into edx
+typedef struct
+{
+	bool known;
+	// In internal RAM at value or at edx, like zero page and stack addresses. They need no bus check.
+	bool ram;
+	word value;
+} operand_address;
+
+static void emit(emitter* e, const byte value)
+{
+	e->code[e->size++] = value;
+}
+
+static void emit32(emitter* e, const uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		emit(e, (byte)(value >> (i * 8)));
+	}
+}
+
+static void emit64(emitter* e, const uint64_t value)
+{
+	emit32(e, (uint32_t)value);
+	emit32(e, (uint32_t)(value >> 32));
+}
+
+static void emit_opcode(emitter* e, const unsigned int opcode)
+{
+	if (opcode > 0xFF)
+	{
+		emit(e, (byte)(opcode >> 8));
+	}
+	emit(e, (byte)opcode);
+}
+
+// force is needed to address spl, bpl, sil and dil as byte registers
+static void emit_rex(emitter* e, const bool wide, const int reg, const int index, const int base, const bool force)
+{
+	const byte rex = 0x40 | (wide ? 0x08 : 0) | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+	if (rex != 0x40 || force)
+	{
+		emit(e, rex);
+	}
+}
+
+// opcode with both operands in registers
+static void emit_rr(emitter* e, const unsigned int opcode, const int reg, const int rm, const bool wide, const bool byte_registers)
+{
+	emit_rex(e, wide, reg, 0, rm, byte_registers);
+	emit_opcode(e, opcode);
+	emit(e, 0xC0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// opcode with a [base + index + displacement] operand, index is -1 when there is none
+static void emit_rm_sized(emitter* e, const unsigned int opcode, const int reg, const int base, const int index, const int32_t displacement, const bool wide, const bool byte_registers)
+{
+	emit_rex(e, wide, reg, index < 0 ? 0 : index, base, byte_registers);
+	emit_opcode(e, opcode);
+	if (index < 0 && (base & 7) != RSP)
+	{
+		emit(e, 0x80 | (reg & 7) << 3 | (base & 7));
+	}
+	else
+	{
+		// SIB byte, an index of 100 means none
+		emit(e, 0x84 | (reg & 7) << 3);
+		emit(e, ((index < 0 ? RSP : index) & 7) << 3 | (base & 7));
+	}
+	emit32(e, (uint32_t)displacement);
+}
+
+static void emit_rm(emitter* e, const unsigned int opcode, const int reg, const int base, const int index, const int32_t displacement, const bool byte_registers)
+{
+	emit_rm_sized(e, opcode, reg, base, index, displacement, false, byte_registers);
+}
+
+static void mov_rr(emitter* e, const int destination, const int source)
+{
+	emit_rr(e, 0x89, source, destination, false, false);
+}
+
+static void mov_ri(emitter* e, const int destination, const uint32_t value)
+{
+	emit_rex(e, false, 0, 0, destination, false);
+	emit(e, 0xB8 | (destination & 7));
+	emit32(e, value);
+}
+
+static void mov_ri64(emitter* e, const int destination, const uint64_t value)
+{
+	emit_rex(e, true, 0, 0, destination, false);
+	emit(e, 0xB8 | (destination & 7));
+	emit64(e, value);
+}
+
+// Zero-extends the low byte of source into destination
+static void movzx_rr(emitter* e, const int destination, const int source)
+{
+	emit_rr(e, 0x0FB6, destination, source, false, true);
+}
+
+static void movzx_rm(emitter* e, const int destination, const int base, const int index, const int32_t displacement)
+{
+	emit_rm(e, 0x0FB6, destination, base, index, displacement, false);
+}
+
+static void store_byte(emitter* e, const int source, const int base, const int index, const int32_t displacement)
+{
+	emit_rm(e, 0x88, source, base, index, displacement, true);
+}
+
+static void alu_rr(emitter* e, const int operation, const int destination, const int source)
+{
+	emit_rr(e, operation * 8 + 1, source, destination, false, false);
+}
+
+static void alu_ri(emitter* e, const int operation, const int destination, const int32_t value)
+{
+	emit_rex(e, false, 0, 0, destination, false);
+	if (value >= -128 && value <= 127)
+	{
+		emit(e, 0x83);
+		emit(e, 0xC0 | operation << 3 | (destination & 7));
+		emit(e, (byte)value);
+	}
+	else
+	{
+		emit(e, 0x81);
+		emit(e, 0xC0 | operation << 3 | (destination & 7));
+		emit32(e, (uint32_t)value);
+	}
+}
+
+static void shift_ri(emitter* e, const int operation, const int destination, const byte count)
+{
+	emit_rex(e, false, 0, 0, destination, false);
+	emit(e, 0xC1);
+	emit(e, 0xC0 | operation << 3 | (destination & 7));
+	emit(e, count);
+}
+
+static void test_rr(emitter* e, const int first, const int second)
+{
+	emit_rr(e, 0x85, second, first, false, false);
+}
+
+static void test_ri(emitter* e, const int destination, const uint32_t value)
+{
+	emit_rex(e, false, 0, 0, destination, false);
+	emit(e, 0xF7);
+	emit(e, 0xC0 | (destination & 7));
+	emit32(e, value);
+}
+
+static void setcc(emitter* e, const int condition, const int destination)
+{
+	emit_rr(e, 0x0F90 | condition, 0, destination, false, true);
+}
+
+// Copies a bit of a register into CF
+static void bt_ri(emitter* e, const int destination, const byte bit)
+{
+	emit_rr(e, 0x0FBA, 4, destination, false, false);
+	emit(e, bit);
+}
+
+static void push(emitter* e, const int reg)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit(e, 0x50 | (reg & 7));
+}
+
+static void pop(emitter* e, const int reg)
+{
+	emit_rex(e, false, 0, 0, reg, false);
+	emit(e, 0x58 | (reg & 7));
+}
+
+// Emits a jcc with a placeholder target and returns the position to patch
+static size_t jcc_forward(emitter* e, const int condition)
+{
+	emit(e, 0x0F);
+	emit(e, 0x80 | condition);
+	emit32(e, 0);
+	return e->size;
+}
+
+static size_t jmp_forward(emitter* e)
+{
+	emit(e, 0xE9);
+	emit32(e, 0);
+	return e->size;
+}
+
+// Points a forward jump at the current position
+static void patch_here(emitter* e, const size_t jump)
+{
+	const int32_t offset = (int32_t)(e->size - jump);
+	memcpy(&e->code[jump - 4], &offset, sizeof(offset));
+}
+
+static void emit_call(emitter* e, const void* function)
+{
+	mov_ri64(e, RAX, (uint64_t)(uintptr_t)function);
+	emit(e, 0xFF);
+	emit(e, 0xD0);
+}
+
+// Bus accesses the translated code can't do by itself
+static unsigned int read_helper(cpu* cpu, const unsigned int address)
+{
+	return cpu_read_bus(cpu, (word)address);
+}
+
+// Returns non-zero when the write flushed the translation cache, the running block has to stop right away
+static unsigned int write_helper(cpu* cpu, const unsigned int address, const unsigned int value)
+{
+	const unsigned int flushes = cpu->jit->flushes;
+	cpu_write_bus(cpu, (word)address, (byte)value);
+	return cpu->jit->flushes != flushes;
+}
+
+// add qword [cpu + cycles], value
+static void emit_add_cycles(emitter* e, const uint32_t value)
+{
+	emit_rex(e, true, 0, 0, REG_CPU, false);
+	emit(e, 0x81);
+	emit(e, 0x80 | ALU_ADD << 3 | (REG_CPU & 7));
+	emit32(e, offsetof(cpu, cycles));
+	emit32(e, value);
+}
+
+// Calls helper(cpu, address[, eax]). The base cycles of the block so far are in cycles during the call,
+// so that the bus sees the same count as with the interpreter, which an OAM DMA stall depends on.
+static void emit_helper_call(emitter* e, const void* helper, const operand_address address, const bool with_value)
+{
+	if (!address.known && ARG1 != RDX)
+	{
+		mov_rr(e, ARG1, RDX);
+	}
+	if (with_value)
+	{
+		mov_rr(e, ARG2, RAX);
+	}
+	if (address.known)
+	{
+		mov_ri(e, ARG1, address.value);
+	}
+	emit_rr(e, 0x89, REG_CPU, ARG0, true, false);
+	emit_add_cycles(e, (uint32_t)e->cycles);
+	emit_call(e, helper);
+	e->bus_access = true;
+	emit_add_cycles(e, (uint32_t)-e->cycles);
+}
+
+// Leaves the block for the dispatcher, which goes on with the block at pc if there is one
+static void emit_exit(emitter* e, const word pc, const int executed, const int cycles)
+{
+	emit_add_cycles(e, cycles);
+	mov_ri(e, RCX, pc);
+	emit_rm(e, 0x83, ALU_SUB, RSP, -1, BUDGET_SLOT, false);
+	emit(e, (byte)executed);
+	emit(e, 0xE9);
+	emit32(e, (uint32_t)(int32_t)(e->dispatch - (e->code + e->size + 4)));
+}
+
+// Leaves the block after the instruction when it raised an interrupt on the bus, the interpreter takes it there too
+static void emit_interrupt_check(emitter* e)
+{
+	emit_rm(e, 0x80, ALU_CMP, REG_CPU, -1, offsetof(cpu, interrupts), false);
+	emit(e, 0);
+	const size_t to_next = jcc_forward(e, CC_Z);
+	emit_exit(e, e->next_pc, e->executed, e->cycles);
+	patch_here(e, to_next);
+}
+
+// Replaces flag in P with the value of reg shifted into place
+static void emit_set_flag(emitter* e, const byte flag, const int reg, const byte shift)
+{
+	if (shift != 0)
+	{
+		shift_ri(e, SHIFT_LEFT, reg, shift);
+	}
+	alu_ri(e, ALU_AND, REG_P, (byte)~flag);
+	alu_rr(e, ALU_OR, REG_P, reg);
+}
+
+// Sets N and Z from the value in reg
+static void emit_set_nz(emitter* e, const int reg)
+{
+	alu_ri(e, ALU_AND, REG_P, (byte)~(N_FLAG | Z_FLAG));
+	mov_rr(e, R8, reg);
+	alu_ri(e, ALU_AND, R8, N_FLAG);
+	alu_rr(e, ALU_OR, REG_P, R8);
+	test_rr(e, reg, reg);
+	setcc(e, CC_Z, R8);
+	movzx_rr(e, R8, R8);
+	shift_ri(e, SHIFT_LEFT, R8, 1);
+	alu_rr(e, ALU_OR, REG_P, R8);
+}
+
+// Memory that gives back what was written to it: RAM, PRG-RAM or a raw image
+static bool is_writable_memory(const cpu* cpu, const word address)
+{
+	return cpu->pages[address >> PAGE_SHIFT].read != NULL && (address < PRG_ROM_START || cpu->memory.image != NULL);
+}
+
+static bool is_executable(const int address)
+{
+	return address < RAM_SIZE || (address >= PRG_RAM_START && address < MAX_MEMORY);
+}
+
+// Mirrors get_memory_address in cpu.c
+static operand_address emit_address(emitter* e, const address_mode address_mode, const word operand)
+{
+	operand_address address = { false, false, 0 };
+
+	switch (address_mode)
+	{
+		case zero_page:
+		case absolute:
+			address.known = true;
+			address.ram = operand < RAM_SIZE || (operand < RAM_END && e->cpu->memory.image == NULL);
+			// The mirrors of internal RAM are accessed at their address in $0000-$07FF
+			address.value = address.ram ? operand & (RAM_SIZE - 1) : operand;
+			break;
+
+		case zero_page_x:
+		case zero_page_y:
+			mov_rr(e, RDX, address_mode == zero_page_x ? REG_X : REG_Y);
+			alu_ri(e, ALU_ADD, RDX, operand);
+			movzx_rr(e, RDX, RDX);
+			address.ram = true;
+			break;
+
+		case absolute_x:
+		case absolute_y:
+			mov_rr(e, RDX, address_mode == absolute_x ? REG_X : REG_Y);
+			alu_ri(e, ALU_ADD, RDX, operand);
+			alu_ri(e, ALU_AND, RDX, 0xFFFF);
+			break;
+
+		case indexed_indirect:
+			mov_rr(e, RCX, REG_X);
+			alu_ri(e, ALU_ADD, RCX, operand);
+			movzx_rr(e, RCX, RCX);
+			movzx_rm(e, RDX, REG_CPU, RCX, RAM_OFFSET);
+			alu_ri(e, ALU_ADD, RCX, 1);
+			movzx_rr(e, RCX, RCX);
+			movzx_rm(e, RAX, REG_CPU, RCX, RAM_OFFSET);
+			shift_ri(e, SHIFT_LEFT, RAX, 8);
+			alu_rr(e, ALU_OR, RDX, RAX);
+			break;
+
+		case indirect_indexed:
+			movzx_rm(e, RDX, REG_CPU, -1, RAM_OFFSET + operand);
+			movzx_rm(e, RAX, REG_CPU, -1, RAM_OFFSET + ((operand + 1) & 0xFF));
+			shift_ri(e, SHIFT_LEFT, RAX, 8);
+			alu_rr(e, ALU_OR, RDX, RAX);
+			alu_rr(e, ALU_ADD, RDX, REG_Y);
+			alu_ri(e, ALU_AND, RDX, 0xFFFF);
+			break;
+
+		default:
+			assert(false);
+			break;
+	}
+
+	return address;
+}
+
+// Reads the byte at address into eax. Memory is read directly, registers go through the bus.
+static void emit_read(emitter* e, const operand_address address)
+{
+	if (address.ram)
+	{
+		if (address.known)
+		{
+			movzx_rm(e, RAX, REG_CPU, -1, RAM_OFFSET + address.value);
+		}
+		else
+		{
+			movzx_rm(e, RAX, REG_CPU, RDX, RAM_OFFSET);
+		}
+		return;
+	}
+
+	if (address.known)
+	{
+		// The page table doesn't change while a translation cache is attached
+		const byte* page = e->cpu->pages[address.value >> PAGE_SHIFT].read;
+		if (page != NULL)
+		{
+			mov_ri64(e, RCX, (uint64_t)(uintptr_t)&page[address.value & (PAGE_SIZE - 1)]);
+			movzx_rm(e, RAX, RCX, -1, 0);
+		}
+		else
+		{
+			emit_helper_call(e, read_helper, address, false);
+		}
+		return;
+	}
+
+	// rcx = pages[edx >> PAGE_SHIFT].read
+	mov_rr(e, RCX, RDX);
+	shift_ri(e, SHIFT_RIGHT, RCX, PAGE_SHIFT);
+	shift_ri(e, SHIFT_LEFT, RCX, PAGE_ENTRY_SHIFT);
+	emit_rm_sized(e, 0x8B, RCX, REG_CPU, RCX, PAGES_OFFSET + (int32_t)offsetof(memory_page, read), true, false);
+	emit_rr(e, 0x85, RCX, RCX, true, false);
+	const size_t to_bus = jcc_forward(e, CC_Z);
+	mov_rr(e, RAX, RDX);
+	alu_ri(e, ALU_AND, RAX, PAGE_SIZE - 1);
+	movzx_rm(e, RAX, RCX, RAX, 0);
+	const size_t to_done = jmp_forward(e);
+	patch_here(e, to_bus);
+	emit_helper_call(e, read_helper, address, false);
+	patch_here(e, to_done);
+}
+
+// Writes al to address. RAM writes are stored directly unless they hit translated code, the rest goes through the bus.
+// A write that flushed the cache ends the block right after the instruction.
+static void emit_write(emitter* e, const operand_address address)
+{
+	const bool may_be_ram = address.ram || !address.known;
+	size_t to_bus = 0;
+	size_t to_done = 0;
+
+	if (may_be_ram)
+	{
+		if (!address.ram)
+		{
+			alu_ri(e, ALU_CMP, RDX, RAM_SIZE);
+			to_bus = jcc_forward(e, CC_NC);
+		}
+
+		if (address.known)
+		{
+			mov_ri64(e, RCX, (uint64_t)(uintptr_t)&e->code_map[address.value]);
+			emit_rm(e, 0x80, ALU_CMP, RCX, -1, 0, false);
+		}
+		else
+		{
+			mov_ri64(e, RCX, (uint64_t)(uintptr_t)e->code_map);
+			emit_rm(e, 0x80, ALU_CMP, RCX, RDX, 0, false);
+		}
+		emit(e, 0);
+		const size_t to_code = jcc_forward(e, CC_NZ);
+
+		if (address.known)
+		{
+			store_byte(e, RAX, REG_CPU, -1, RAM_OFFSET + address.value);
+		}
+		else
+		{
+			store_byte(e, RAX, REG_CPU, RDX, RAM_OFFSET);
+		}
+		to_done = jmp_forward(e);
+
+		patch_here(e, to_code);
+		if (!address.ram)
+		{
+			patch_here(e, to_bus);
+		}
+	}
+
+	emit_helper_call(e, write_helper, address, true);
+	test_rr(e, RAX, RAX);
+	const size_t to_continue = jcc_forward(e, CC_Z);
+	emit_exit(e, e->next_pc, e->executed, e->cycles);
+	patch_here(e, to_continue);
+
+	if (may_be_ram)
+	{
+		patch_here(e, to_done);
+	}
+}
+
+// Adds a cycle when the index in reg carried into the high byte of the address in edx
+static void emit_page_cross_penalty(emitter* e, const int reg)
+{
+	mov_rr(e, RCX, RDX);
+	alu_rr(e, ALU_SUB, RCX, reg);
+	alu_rr(e, ALU_XOR, RCX, RDX);
+	test_ri(e, RCX, 0xFF00);
+	setcc(e, CC_NZ, RCX);
+	movzx_rr(e, RCX, RCX);
+	// add qword [cpu + cycles], rcx
+	emit_rex(e, true, RCX, 0, REG_CPU, false);
+	emit(e, 0x01);
+	emit(e, 0x80 | (RCX & 7) << 3 | (REG_CPU & 7));
+	emit32(e, offsetof(cpu, cycles));
+}
+
+// Puts the value an instruction works on into eax, like read_argument in cpu.c
+static void emit_load_argument(emitter* e, const address_mode address_mode, const word operand)
+{
+	if (address_mode == immediate)
+	{
+		mov_ri(e, RAX, operand);
+		return;
+	}
+
+	const operand_address address = emit_address(e, address_mode, operand);
+	if (e->page_cycle && (address_mode == absolute_x || address_mode == absolute_y || address_mode == indirect_indexed))
+	{
+		emit_page_cross_penalty(e, address_mode == absolute_x ? REG_X : REG_Y);
+	}
+	emit_read(e, address);
+}
+
+// Entry point, dispatcher and exit shared by every block. They sit at the start of the code buffer and survive flushes.
+static void emit_dispatcher(translation_cache* cache)
+{
+	emitter e = { cache->code, 0, NULL, cache->code_map, NULL, 0, 0, 0, false, false };
+
+	// int enter(cpu* cpu, int count)
+	push(&e, RBX);
+	push(&e, RBP);
+	push(&e, R12);
+	push(&e, R13);
+	push(&e, R14);
+	push(&e, R15);
+	emit_rex(&e, true, 0, 0, RSP, false);
+	emit(&e, 0x83);
+	emit(&e, 0xC0 | ALU_SUB << 3 | RSP);
+	emit(&e, FRAME_SIZE);
+
+	emit_rr(&e, 0x89, ARG0, REG_CPU, true, false);
+	emit_rm(&e, 0x89, ARG1, RSP, -1, BUDGET_SLOT, false);
+	emit_rm(&e, 0x89, ARG1, RSP, -1, COUNT_SLOT, false);
+	movzx_rm(&e, REG_A, REG_CPU, -1, offsetof(cpu, a));
+	movzx_rm(&e, REG_X, REG_CPU, -1, offsetof(cpu, x));
+	movzx_rm(&e, REG_Y, REG_CPU, -1, offsetof(cpu, y));
+	movzx_rm(&e, REG_P, REG_CPU, -1, offsetof(cpu, p));
+	movzx_rm(&e, REG_SP, REG_CPU, -1, offsetof(cpu, sp));
+	emit_rm(&e, 0x0FB7, RCX, REG_CPU, -1, offsetof(cpu, pc), false);
+
+	// Returns while an NMI or an IRQ the I flag lets through is waiting, the interpreter loop takes it
+	const size_t dispatch = e.size;
+	movzx_rm(&e, RAX, REG_CPU, -1, offsetof(cpu, interrupts));
+	test_ri(&e, RAX, INTERRUPT_NMI);
+	const size_t to_nmi = jcc_forward(&e, CC_NZ);
+	test_ri(&e, RAX, INTERRUPT_IRQ);
+	const size_t to_no_irq = jcc_forward(&e, CC_Z);
+	test_ri(&e, REG_P, I_FLAG);
+	const size_t to_irq = jcc_forward(&e, CC_Z);
+	patch_here(&e, to_no_irq);
+
+	// Jumps to the block at ecx when it is translated and fits in the instructions left
+	mov_ri64(&e, RAX, (uint64_t)(uintptr_t)cache->blocks);
+	// mov rax, [rax + rcx * 8]
+	emit(&e, 0x48);
+	emit(&e, 0x8B);
+	emit(&e, 0x04);
+	emit(&e, 0xC8);
+	// cmp rax, UNTRANSLATABLE
+	emit(&e, 0x48);
+	emit(&e, 0x83);
+	emit(&e, 0xC0 | ALU_CMP << 3 | RAX);
+	emit(&e, 1);
+	const size_t to_missing = jcc_forward(&e, CC_BE);
+	mov_ri64(&e, RDX, (uint64_t)(uintptr_t)cache->block_lengths);
+	movzx_rm(&e, RDX, RDX, RCX, 0);
+	emit_rm(&e, 0x39, RDX, RSP, -1, BUDGET_SLOT, false);
+	const size_t to_full = jcc_forward(&e, CC_L);
+	// jmp rax
+	emit(&e, 0xFF);
+	emit(&e, 0xE0);
+
+	// Writes the registers back with pc from ecx and returns the instructions executed
+	patch_here(&e, to_nmi);
+	patch_here(&e, to_irq);
+	patch_here(&e, to_missing);
+	patch_here(&e, to_full);
+	store_byte(&e, REG_A, REG_CPU, -1, offsetof(cpu, a));
+	store_byte(&e, REG_X, REG_CPU, -1, offsetof(cpu, x));
+	store_byte(&e, REG_Y, REG_CPU, -1, offsetof(cpu, y));
+	store_byte(&e, REG_P, REG_CPU, -1, offsetof(cpu, p));
+	store_byte(&e, REG_SP, REG_CPU, -1, offsetof(cpu, sp));
+	emit(&e, 0x66);
+	emit_rm(&e, 0x89, RCX, REG_CPU, -1, offsetof(cpu, pc), false);
+	emit_rm(&e, 0x8B, RAX, RSP, -1, COUNT_SLOT, false);
+	emit_rm(&e, 0x2B, RAX, RSP, -1, BUDGET_SLOT, false);
+
+	emit_rex(&e, true, 0, 0, RSP, false);
+	emit(&e, 0x83);
+	emit(&e, 0xC0 | ALU_ADD << 3 | RSP);
+	emit(&e, FRAME_SIZE);
+	pop(&e, R15);
+	pop(&e, R14);
+	pop(&e, R13);
+	pop(&e, R12);
+	pop(&e, RBP);
+	pop(&e, RBX);
+	emit(&e, 0xC3);
+
+	cache->enter = (entry_function)(void*)cache->code;
+	cache->dispatch = cache->code + dispatch;
+	cache->dispatcher_size = e.size;
+	cache->code_used = e.size;
+}
+
+static translation translate_load(emitter* e, const int reg, const address_mode address_mode, const word operand)
+{
+	emit_load_argument(e, address_mode, operand);
+	mov_rr(e, reg, RAX);
+	emit_set_nz(e, reg);
+	return translated;
+}
+
+static translation translate_store(emitter* e, const int reg, const address_mode address_mode, const word operand)
+{
+	const operand_address address = emit_address(e, address_mode, operand);
+	mov_rr(e, RAX, reg);
+	emit_write(e, address);
+	return translated;
+}
+
+// C and V after an 8-bit adc or sbb into A, then N and Z
+static void emit_arithmetic_flags(emitter* e, const int carry_condition)
+{
+	setcc(e, carry_condition, R9);
+	setcc(e, CC_O, R10);
+	movzx_rr(e, R9, R9);
+	movzx_rr(e, R10, R10);
+	emit_set_flag(e, C_FLAG, R9, 0);
+	emit_set_flag(e, V_FLAG, R10, 6);
+	emit_set_nz(e, REG_A);
+}
+
+static translation translate_logical(emitter* e, const int operation, const address_mode address_mode, const word operand)
+{
+	emit_load_argument(e, address_mode, operand);
+	alu_rr(e, operation, REG_A, RAX);
+	emit_set_nz(e, REG_A);
+	return translated;
+}
+
+static translation translate_compare(emitter* e, const int reg, const address_mode address_mode, const word operand)
+{
+	emit_load_argument(e, address_mode, operand);
+	mov_rr(e, RCX, reg);
+	alu_rr(e, ALU_SUB, RCX, RAX);
+	setcc(e, CC_NC, R9);
+	movzx_rr(e, R9, R9);
+	emit_set_flag(e, C_FLAG, R9, 0);
+	movzx_rr(e, RCX, RCX);
+	emit_set_nz(e, RCX);
+	return translated;
+}
+
+typedef enum
+{
+	modify_inc,
+	modify_dec,
+	modify_asl,
+	modify_lsr,
+	modify_rol,
+	modify_ror
+} modify_operation;
+
+// Turns the value in eax into the new one. Shifts and rotates leave the carry out in r9d.
+static void emit_modify(emitter* e, const modify_operation operation)
+{
+	switch (operation)
+	{
+		case modify_inc:
+			alu_ri(e, ALU_ADD, RAX, 1);
+			movzx_rr(e, RAX, RAX);
+			return;
+
+		case modify_dec:
+			alu_ri(e, ALU_SUB, RAX, 1);
+			movzx_rr(e, RAX, RAX);
+			return;
+
+		default:
+			break;
+	}
+
+	const bool left = operation == modify_asl || operation == modify_rol;
+	const bool rotate = operation == modify_rol || operation == modify_ror;
+
+	mov_rr(e, R9, RAX);
+	if (left)
+	{
+		shift_ri(e, SHIFT_RIGHT, R9, 7);
+	}
+	else
+	{
+		alu_ri(e, ALU_AND, R9, 1);
+	}
+
+	if (rotate)
+	{
+		mov_rr(e, R10, REG_P);
+		alu_ri(e, ALU_AND, R10, C_FLAG);
+		if (!left)
+		{
+			shift_ri(e, SHIFT_LEFT, R10, 7);
+		}
+	}
+
+	if (left)
+	{
+		shift_ri(e, SHIFT_LEFT, RAX, 1);
+		movzx_rr(e, RAX, RAX);
+	}
+	else
+	{
+		shift_ri(e, SHIFT_RIGHT, RAX, 1);
+	}
+
+	if (rotate)
+	{
+		alu_rr(e, ALU_OR, RAX, R10);
+	}
+
+	emit_set_flag(e, C_FLAG, R9, 0);
+}
+
+static translation translate_read_modify_write(emitter* e, const modify_operation operation, const address_mode address_mode, const word operand)
+{
+	if (address_mode == accumulator)
+	{
+		mov_rr(e, RAX, REG_A);
+		emit_modify(e, operation);
+		mov_rr(e, REG_A, RAX);
+		emit_set_nz(e, REG_A);
+		return translated;
+	}
+
+	// lsr in cpu.c reads the address again after the write. Only RAM and ROM are sure to give the written value back.
+	if (operation == modify_lsr &&
+		address_mode != zero_page && address_mode != zero_page_x &&
+		!(address_mode == absolute && is_writable_memory(e->cpu, operand)))
+	{
+		return untranslated;
+	}
+
+	const operand_address address = emit_address(e, address_mode, operand);
+	const bool spill = !address.known && !address.ram;
+
+	if (spill)
+	{
+		emit_rm(e, 0x89, RDX, RSP, -1, SPILL_SLOT, false);
+	}
+	emit_read(e, address);
+	emit_modify(e, operation);
+	emit_set_nz(e, RAX);
+	if (spill)
+	{
+		emit_rm(e, 0x8B, RDX, RSP, -1, SPILL_SLOT, false);
+	}
+	emit_write(e, address);
+	return translated;
+}
+
+static translation translate_increment(emitter* e, const int reg, const int operation)
+{
+	alu_ri(e, operation, reg, 1);
+	movzx_rr(e, reg, reg);
+	emit_set_nz(e, reg);
+	return translated;
+}
+
+static translation translate_transfer(emitter* e, const int destination, const int source, const bool set_flags)
+{
+	mov_rr(e, destination, source);
+	if (set_flags)
+	{
+		emit_set_nz(e, destination);
+	}
+	return translated;
+}
+
+static translation translate_flag(emitter* e, const byte flag, const bool value)
+{
+	if (value)
+	{
+		alu_ri(e, ALU_OR, REG_P, flag);
+	}
+	else
+	{
+		alu_ri(e, ALU_AND, REG_P, (byte)~flag);
+	}
+	return translated;
+}
+
+static translation translate_push(emitter* e, const int reg, const byte extra_bits)
+{
+	const operand_address address = { false, true, 0 };
+
+	// sp is updated before the write in case the write ends the block
+	mov_rr(e, RDX, REG_SP);
+	alu_ri(e, ALU_ADD, RDX, STACK_BASE);
+	alu_ri(e, ALU_SUB, REG_SP, 1);
+	movzx_rr(e, REG_SP, REG_SP);
+	mov_rr(e, RAX, reg);
+	if (extra_bits != 0)
+	{
+		alu_ri(e, ALU_OR, RAX, extra_bits);
+	}
+	emit_write(e, address);
+	return translated;
+}
+
+static translation translate_pull(emitter* e, const int reg, const bool set_flags)
+{
+	alu_ri(e, ALU_ADD, REG_SP, 1);
+	movzx_rr(e, REG_SP, REG_SP);
+	movzx_rm(e, reg, REG_CPU, REG_SP, RAM_OFFSET + STACK_BASE);
+	if (set_flags)
+	{
+		emit_set_nz(e, reg);
+	}
+	return translated;
+}
+
+static translation translate_branch(emitter* e, const byte flag, const bool taken_when_set, const word operand)
+{
+	test_ri(e, REG_P, flag);
+	const size_t to_taken = jcc_forward(e, taken_when_set ? CC_NZ : CC_Z);
+	emit_exit(e, e->next_pc, e->executed, e->cycles);
+	patch_here(e, to_taken);
+	// Taken branches take a cycle more, two when they land in another page
+	const word target = e->next_pc + (char)operand;
+	emit_exit(e, target, e->executed, e->cycles + (((target ^ e->next_pc) & 0xFF00) ? 2 : 1));
+	return block_end;
+}
+
+static translation translate_lda(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_load(e, REG_A, address_mode, operand);
+}
+
+static translation translate_ldx(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_load(e, REG_X, address_mode, operand);
+}
+
+static translation translate_ldy(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_load(e, REG_Y, address_mode, operand);
+}
+
+static translation translate_sta(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_store(e, REG_A, address_mode, operand);
+}
+
+static translation translate_stx(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_store(e, REG_X, address_mode, operand);
+}
+
+static translation translate_sty(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_store(e, REG_Y, address_mode, operand);
+}
+
+static translation translate_adc(emitter* e, const address_mode address_mode, const word operand)
+{
+	emit_load_argument(e, address_mode, operand);
+	bt_ri(e, REG_P, 0);
+	emit_rr(e, ALU_ADC * 8, RAX, REG_A, false, true);
+	emit_arithmetic_flags(e, CC_C);
+	return translated;
+}
+
+// A + ~M + C is A - M - !C: sbb with an inverted carry, and the 6502 carry is the inverted borrow
+static translation translate_sbc(emitter* e, const address_mode address_mode, const word operand)
+{
+	emit_load_argument(e, address_mode, operand);
+	bt_ri(e, REG_P, 0);
+	emit(e, 0xF5);
+	emit_rr(e, ALU_SBB * 8, RAX, REG_A, false, true);
+	emit_arithmetic_flags(e, CC_NC);
+	return translated;
+}
+
+static translation translate_AND(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_logical(e, ALU_AND, address_mode, operand);
+}
+
+static translation translate_ora(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_logical(e, ALU_OR, address_mode, operand);
+}
+
+static translation translate_eor(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_logical(e, ALU_XOR, address_mode, operand);
+}
+
+static translation translate_cmp(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_compare(e, REG_A, address_mode, operand);
+}
+
+static translation translate_cpx(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_compare(e, REG_X, address_mode, operand);
+}
+
+static translation translate_cpy(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_compare(e, REG_Y, address_mode, operand);
+}
+
+static translation translate_bit(emitter* e, const address_mode address_mode, const word operand)
+{
+	emit_read(e, emit_address(e, address_mode, operand));
+	alu_ri(e, ALU_AND, REG_P, (byte)~(N_FLAG | V_FLAG | Z_FLAG));
+	mov_rr(e, R8, RAX);
+	alu_ri(e, ALU_AND, R8, N_FLAG | V_FLAG);
+	alu_rr(e, ALU_OR, REG_P, R8);
+	test_rr(e, REG_A, RAX);
+	setcc(e, CC_Z, R8);
+	movzx_rr(e, R8, R8);
+	shift_ri(e, SHIFT_LEFT, R8, 1);
+	alu_rr(e, ALU_OR, REG_P, R8);
+	return translated;
+}
+
+static translation translate_inc(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_read_modify_write(e, modify_inc, address_mode, operand);
+}
+
+static translation translate_dec(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_read_modify_write(e, modify_dec, address_mode, operand);
+}
+
+static translation translate_asl(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_read_modify_write(e, modify_asl, address_mode, operand);
+}
+
+static translation translate_lsr(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_read_modify_write(e, modify_lsr, address_mode, operand);
+}
+
+static translation translate_rol(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_read_modify_write(e, modify_rol, address_mode, operand);
+}
+
+static translation translate_ror(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_read_modify_write(e, modify_ror, address_mode, operand);
+}
+
+static translation translate_inx(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_increment(e, REG_X, ALU_ADD);
+}
+
+static translation translate_iny(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_increment(e, REG_Y, ALU_ADD);
+}
+
+static translation translate_dex(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_increment(e, REG_X, ALU_SUB);
+}
+
+static translation translate_dey(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_increment(e, REG_Y, ALU_SUB);
+}
+
+static translation translate_tax(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_transfer(e, REG_X, REG_A, true);
+}
+
+static translation translate_tay(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_transfer(e, REG_Y, REG_A, true);
+}
+
+static translation translate_tsx(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_transfer(e, REG_X, REG_SP, true);
+}
+
+static translation translate_txa(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_transfer(e, REG_A, REG_X, true);
+}
+
+static translation translate_txs(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_transfer(e, REG_SP, REG_X, false);
+}
+
+static translation translate_tya(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_transfer(e, REG_A, REG_Y, true);
+}
+
+static translation translate_clc(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_flag(e, C_FLAG, false);
+}
+
+static translation translate_cld(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_flag(e, D_FLAG, false);
+}
+
+// CLI and PLP can let a waiting IRQ through, the block ends for the dispatcher to see it
+static translation translate_cli(emitter* e, const address_mode address_mode, const word operand)
+{
+	translate_flag(e, I_FLAG, false);
+	emit_exit(e, e->next_pc, e->executed, e->cycles);
+	return block_end;
+}
+
+static translation translate_clv(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_flag(e, V_FLAG, false);
+}
+
+static translation translate_sec(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_flag(e, C_FLAG, true);
+}
+
+static translation translate_sed(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_flag(e, D_FLAG, true);
+}
+
+static translation translate_sei(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_flag(e, I_FLAG, true);
+}
+
+static translation translate_nop(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translated;
+}
+
+static translation translate_pha(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_push(e, REG_A, 0);
+}
+
+static translation translate_php(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_push(e, REG_P, UNUSED_FLAG | B_FLAG);
+}
+
+static translation translate_pla(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_pull(e, REG_A, true);
+}
+
+static translation translate_plp(emitter* e, const address_mode address_mode, const word operand)
+{
+	translate_pull(e, REG_P, false);
+	emit_exit(e, e->next_pc, e->executed, e->cycles);
+	return block_end;
+}
+
+static translation translate_bcc(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, C_FLAG, false, operand);
+}
+
+static translation translate_bcs(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, C_FLAG, true, operand);
+}
+
+static translation translate_beq(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, Z_FLAG, true, operand);
+}
+
+static translation translate_bne(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, Z_FLAG, false, operand);
+}
+
+static translation translate_bmi(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, N_FLAG, true, operand);
+}
+
+static translation translate_bpl(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, N_FLAG, false, operand);
+}
+
+static translation translate_bvc(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, V_FLAG, false, operand);
+}
+
+static translation translate_bvs(emitter* e, const address_mode address_mode, const word operand)
+{
+	return translate_branch(e, V_FLAG, true, operand);
+}
+
+static translation translate_jmp(emitter* e, const address_mode address_mode, const word operand)
+{
+	if (address_mode != absolute)
+	{
+		return untranslated;
+	}
+
+	emit_exit(e, operand, e->executed, e->cycles);
+	return block_end;
+}
+
+// Stack based control flow stays in the interpreter
+static translation translate_brk(emitter* e, const address_mode address_mode, const word operand)
+{
+	return untranslated;
+}
+
+static translation translate_jsr(emitter* e, const address_mode address_mode, const word operand)
+{
+	return untranslated;
+}
+
+static translation translate_rti(emitter* e, const address_mode address_mode, const word operand)
+{
+	return untranslated;
+}
+
+static translation translate_rts(emitter* e, const address_mode address_mode, const word operand)
+{
+	return untranslated;
+}
+
+static translation translate_instruction(emitter* e, const cpu* cpu, const word pc, byte* length)
+{
+	switch (cpu_read_memory(cpu, pc))
+	{
+	// Unofficial opcodes are left to the interpreter
+#define OP(opcode, mnemonic, operation, address_mode, base_cycles, takes_page_cycle) \
+		case 0x##opcode: \
+		{ \
+			*length = cpu_instruction_length(address_mode); \
+			if (!is_executable(pc + *length - 1)) \
+			{ \
+				return untranslated; \
+			} \
+			const word operand = *length == 3 ? (word)(cpu_read_memory(cpu, pc + 2) << 8) | cpu_read_memory(cpu, pc + 1) : \
+				*length == 2 ? cpu_read_memory(cpu, pc + 1) : 0; \
+			e->next_pc = (word)(pc + *length); \
+			e->cycles += base_cycles; \
+			e->page_cycle = takes_page_cycle; \
+			return translate_##operation(e, address_mode, operand); \
+		}
+#define UNOFFICIAL_OP(opcode, mnemonic, operation, address_mode, base_cycles, page_cycle)
+#include "opcodes.h"
+#undef UNOFFICIAL_OP
+#undef OP
+
+		default:
+			return untranslated;
+	}
+}
+
+static void flush(translation_cache* cache)
+{
+	memset(cache->blocks, 0, sizeof(cache->blocks));
+	memset(cache->code_map, 0, sizeof(cache->code_map));
+	cache->code_used = cache->dispatcher_size;
+	cache->flushes++;
+}
+
+static const byte* translate_block(cpu* cpu, const word start)
+{
+	translation_cache* cache = cpu->jit;
+
+	// Blocks never start in the I/O registers, and the whole instruction must be in translatable memory.
+	// Idle loops in PRG-ROM are left to the interpreter, which skips them.
+	cache->code_map[start] = 1;
+	if (!is_executable(start) || (start >= PRG_ROM_START && cpu_idle_loop_length(cpu, start) != 0))
+	{
+		cache->blocks[start] = UNTRANSLATABLE;
+		return UNTRANSLATABLE;
+	}
+
+	if (cache->code_used + MAX_BLOCK_CODE > CODE_BUFFER_SIZE)
+	{
+		flush(cache);
+		cache->code_map[start] = 1;
+	}
+
+	emitter e = { cache->code + cache->code_used, 0, cache->dispatch, cache->code_map, cpu, start, 0, 0, false, false };
+	word pc = start;
+	int count = 0;
+	translation result = translated;
+
+	while (result == translated && count < MAX_BLOCK_INSTRUCTIONS)
+	{
+		const size_t instruction_start = e.size;
+		const int cycles_before = e.cycles;
+		byte length = 1;
+
+		e.executed = count + 1;
+		e.bus_access = false;
+		result = translate_instruction(&e, cpu, pc, &length);
+		if (result == untranslated)
+		{
+			e.size = instruction_start;
+			e.cycles = cycles_before;
+			break;
+		}
+
+		if (result == translated && e.bus_access)
+		{
+			emit_interrupt_check(&e);
+		}
+		assert(e.size - instruction_start <= MAX_INSTRUCTION_CODE);
+
+		memset(&cache->code_map[pc], 1, length);
+		pc += length;
+		count++;
+	}
+
+	if (count == 0)
+	{
+		cache->blocks[start] = UNTRANSLATABLE;
+		return UNTRANSLATABLE;
+	}
+
+	if (result != block_end)
+	{
+		emit_exit(&e, pc, count, e.cycles);
+	}
+
+	cache->code_used += e.size;
+	cache->blocks[start] = e.code;
+	cache->block_lengths[start] = (byte)count;
+	cache->blocks_translated++;
+	return e.code;
+}
+
+#ifdef JIT_VERIFY
+// Runs one block, then the same instructions on a copy of the cpu through the interpreter, and stops on any difference
+static int verify_block(cpu* cpu)
+{
+	translation_cache* cache = cpu->jit;
+	const word start = cpu->pc;
+
+	memcpy(&cache->shadow, cpu, sizeof(cache->shadow));
+	cache->shadow_controller = *cpu->controller;
+	cache->shadow.controller = &cache->shadow_controller;
+	cache->shadow.decode_cache = NULL;
+	cache->shadow.jit = NULL;
+	if (cpu->memory.image != NULL)
+	{
+		memcpy(cache->shadow_image, cpu->memory.image, sizeof(cache->shadow_image));
+		cache->shadow.memory.image = cache->shadow_image;
+	}
+	if (cpu->memory.prg_ram != NULL)
+	{
+		memcpy(cache->shadow_prg_ram, cpu->memory.prg_ram, sizeof(cache->shadow_prg_ram));
+		cache->shadow.memory.prg_ram = cache->shadow_prg_ram;
+	}
+	cpu_map_memory(&cache->shadow);
+
+	// With no instructions left after the block the dispatcher returns right away
+	const int executed = cache->enter(cpu, cache->block_lengths[start]);
+	for (int i = 0; i < executed; i++)
+	{
+		cpu_exec(&cache->shadow, cpu_read_memory(&cache->shadow, cache->shadow.pc++));
+	}
+
+	if (cache->shadow.a != cpu->a || cache->shadow.x != cpu->x || cache->shadow.y != cpu->y ||
+		cache->shadow.p != cpu->p || cache->shadow.sp != cpu->sp || cache->shadow.pc != cpu->pc || cache->shadow.cycles != cpu->cycles ||
+		memcmp(cache->shadow.memory.ram, cpu->memory.ram, sizeof(cpu->memory.ram)) != 0 ||
+		(cpu->memory.image != NULL && memcmp(cache->shadow_image, cpu->memory.image, sizeof(cache->shadow_image)) != 0) ||
+		(cpu->memory.prg_ram != NULL && memcmp(cache->shadow_prg_ram, cpu->memory.prg_ram, sizeof(cache->shadow_prg_ram)) != 0) ||
+		memcmp(&cache->shadow.ppu, &cpu->ppu, sizeof(cpu->ppu)) != 0 ||
+		memcmp(&cache->shadow_controller, cpu->controller, sizeof(cache->shadow_controller)) != 0)
+	{
+		fprintf(stderr, "JIT mismatch in the block at %x after %d instructions\n", start, executed);
+		fprintf(stderr, "Interpreter A:%02x X:%02x Y:%02x P:%02x SP:%02x PC:%04x CYC:%llu\n",
+			cache->shadow.a, cache->shadow.x, cache->shadow.y, cache->shadow.p, cache->shadow.sp, cache->shadow.pc,
+			(unsigned long long)cache->shadow.cycles);
+		fprintf(stderr, "Translated  A:%02x X:%02x Y:%02x P:%02x SP:%02x PC:%04x CYC:%llu\n",
+			cpu->a, cpu->x, cpu->y, cpu->p, cpu->sp, cpu->pc, (unsigned long long)cpu->cycles);
+		abort();
+	}
+
+	return executed;
+}
+#endif
+
+int jit_exec(cpu* cpu, const int count)
+{
+	translation_cache* cache = cpu->jit;
+	const byte* block = cache->blocks[cpu->pc];
+
+	if (block == NULL)
+	{
+		block = translate_block(cpu, cpu->pc);
+	}
+
+	if (block == UNTRANSLATABLE || cache->block_lengths[cpu->pc] > count)
+	{
+		return 0;
+	}
+
+#ifdef JIT_VERIFY
+	return verify_block(cpu);
+#else
+	return cache->enter(cpu, count);
+#endif
+}
+
+void jit_invalidate(translation_cache* cache, const word address)
+{
+	if (cache->code_map[address])
+	{
+		flush(cache);
+	}
+}
+
+bool jit_create(cpu* cpu)
+{
+	// Translated code indexes the page table with a shift
+	assert(sizeof(memory_page) == 1 << PAGE_ENTRY_SHIFT);
+
+	translation_cache* cache = calloc(1, sizeof(translation_cache));
+	if (cache == NULL)
+	{
+		return false;
+	}
+
+#ifdef _WIN32
+	cache->code = VirtualAlloc(NULL, CODE_BUFFER_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	cache->code = mmap(NULL, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (cache->code == MAP_FAILED)
+	{
+		cache->code = NULL;
+	}
+#endif
+
+	if (cache->code == NULL)
+	{
+		free(cache);
+		return false;
+	}
+
+	emit_dispatcher(cache);
+	cpu->jit = cache;
+	cpu_map_memory(cpu);
+	return true;
+}
+
+void jit_destroy(cpu* cpu)
+{
+	translation_cache* cache = cpu->jit;
+	if (cache == NULL)
+	{
+		return;
+	}
+
+#ifdef _WIN32
+	VirtualFree(cache->code, 0, MEM_RELEASE);
+#else
+	munmap(cache->code, CODE_BUFFER_SIZE);
+#endif
+	free(cache);
+	cpu->jit = NULL;
+	cpu_map_memory(cpu);
+}
+
+void jit_print_stats(const cpu* cpu)
+{
+	const translation_cache* cache = cpu->jit;
+	if (cache == NULL)
+	{
+		puts("JIT: not available");
+		return;
+	}
+
+	printf("JIT: %u blocks translated, %u flushes, %zu bytes of code\n", cache->blocks_translated, cache->flushes, cache->code_used);
+}
+
+#endif
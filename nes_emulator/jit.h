@@ -0,0 +1,18 @@
+#pragma once
+
+#include "cpu.h"
+
+#ifdef JIT
+// Allocates the translation cache and attaches it to the cpu. Returns false when executable memory is not available.
+bool jit_create(cpu* cpu);
+void jit_destroy(cpu* cpu);
+
+// Runs translated blocks from pc, one after another, while they fit in count instructions and no interrupt is due.
+// Returns the number of instructions executed, 0 when the interpreter has to run the next instruction.
+int jit_exec(cpu* cpu, int count);
+
+// Drops every translation if address belongs to translated code
+void jit_invalidate(translation_cache* cache, word address);
+
+void jit_print_stats(const cpu* cpu);
+#endif
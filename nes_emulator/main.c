@@ -2,12 +2,22 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
 
 #include "cpu.h"
+#include "hooks.h"
+#include "jit.h"
+#include "recompiler.h"
+#include "tile_decode.h"
 #include "input.h"
 #include "ppu.h"
 #include "nes.h"
 
+#define BENCHMARK_CYCLES	300000000
+#define NTSC_CPU_CLOCK		1789773
+#define DECODE_BENCHMARK_PASSES	20000
+
 int load_file(char** text, const char* filename, uint32_t* size_out);
 
 void print_header_info(const char* rom, word* prg_size_out, word* chr_size_out)
@@ -26,11 +36,11 @@ void print_header_info(const char* rom, word* prg_size_out, word* chr_size_out)
 	const byte flags_6 = rom[6];
 	if (flags_6 & 0b00000001)
 	{
-		puts("Mirroring: horizontal (vertical arrangement) (CIRAM A10 = PPU A11)");
+		puts("Mirroring: vertical (horizontal arrangement) (CIRAM A10 = PPU A10)");
 	}
 	else
 	{
-		puts("Mirroring: vertical (horizontal arrangement) (CIRAM A10 = PPU A10)");
+		puts("Mirroring: horizontal (vertical arrangement) (CIRAM A10 = PPU A11)");
 	}
 
 	if (flags_6 & 0b00000010)
@@ -83,6 +93,186 @@ void print_header_info(const char* rom, word* prg_size_out, word* chr_size_out)
 	}
 }
 
+// A whole frame in CPU cycles, rounded up, the most cpu_run goes before it returns
+#define FRAME_CYCLES	29781
+
+// Runs the CPU until the PPU starts the next vblank, which raises NMI when it is enabled.
+// The PPU only catches up when the CPU accesses it and at the start of vblank, drawing the frame into framebuffer
+// on the way. Drawing is skipped when it is NULL.
+void run_frame(nes* nes, uint32_t* framebuffer)
+{
+	const uint64_t frames = nes->cpu.ppu.frames;
+	nes->cpu.ppu.framebuffer = framebuffer;
+
+	// A register access can catch the PPU up past the start of vblank before the event is reached
+	while (nes->cpu.ppu.frames == frames)
+	{
+		nes->cpu.event_cycle = cpu_next_vblank_cycle(&nes->cpu);
+		while (cpu_run(&nes->cpu, FRAME_CYCLES) != run_event_reached)
+		{
+		}
+		cpu_sync_ppu(&nes->cpu);
+	}
+}
+
+// Uploads the frame to the streaming texture in one go and lets SDL scale it to the window
+void present_frame(SDL_Renderer* renderer, SDL_Texture* texture, const uint32_t* framebuffer)
+{
+	SDL_UpdateTexture(texture, NULL, framebuffer, SCREEN_WIDTH * sizeof(uint32_t));
+	SDL_RenderCopy(renderer, texture, NULL, NULL);
+	SDL_RenderPresent(renderer);
+}
+
+// Runs the CPU headless and prints the throughput in CPU cycles.
+// Build with SWITCH_DISPATCH, THREADED_DISPATCH, JIT or RECOMPILED defined in config.h to measure the other dispatchers.
+void run_benchmark(nes* nes)
+{
+	const uint64_t start_cycles = nes->cpu.cycles;
+	const clock_t start = clock();
+
+	while (nes->cpu.cycles - start_cycles < BENCHMARK_CYCLES)
+	{
+		run_frame(nes, NULL);
+	}
+
+	const double executed = (double)(nes->cpu.cycles - start_cycles);
+	const double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+#if defined(RECOMPILED)
+	puts(nes->cpu.recompiled ? "Dispatch: recompiled" : "Dispatch: handler table (recompiled.c is for another ROM)");
+#elif defined(JIT)
+	puts("Dispatch: JIT");
+	jit_print_stats(&nes->cpu);
+#elif defined(THREADED_DISPATCH)
+	puts("Dispatch: threaded");
+#elif defined(SWITCH_DISPATCH)
+	puts("Dispatch: switch");
+#else
+	puts("Dispatch: handler table");
+#endif
+	printf("%.0f cycles in %.3f s (%.0f cycles/s, %.1f times NTSC speed)\n",
+		executed, seconds, executed / seconds, executed / seconds / NTSC_CPU_CLOCK);
+	printf("Idle loops: %.0f cycles skipped\n", (double)nes->cpu.idle_cycles);
+	cpu_print_fusion_hits(&nes->cpu);
+#ifdef NATIVE_HOOKS
+	hooks_print_stats(&nes->cpu);
+#endif
+}
+
+// Decodes every row of the pattern tables with each tile decoding kernel the CPU supports, and compares their time
+// and output with the bit by bit loop
+void run_decode_benchmark(const nes* nes)
+{
+	static byte planes_0[TILE_ROWS];
+	static byte planes_1[TILE_ROWS];
+	static byte bit_by_bit[TILE_ROWS * TILE_WIDTH];
+	static byte pixels[TILE_ROWS * TILE_WIDTH];
+
+	const byte* chr = nes->cpu.ppu.memory.chr;
+	if (chr == NULL)
+	{
+		puts("No pattern tables to decode");
+		return;
+	}
+
+	for (int row = 0; row < TILE_ROWS; row++)
+	{
+		const int pattern = (row / TILE_HEIGHT) * 16 + row % TILE_HEIGHT;
+		planes_0[row] = chr[pattern];
+		planes_1[row] = chr[pattern + 8];
+	}
+
+	double bit_by_bit_seconds = 0;
+	for (int i = 0; i < tile_decode_kernel_count; i++)
+	{
+		const tile_decode_kernel* kernel = &tile_decode_kernels[i];
+		if (!kernel->supported())
+		{
+			printf("%-12s not supported by this CPU\n", kernel->name);
+			continue;
+		}
+
+		const clock_t start = clock();
+		for (int pass = 0; pass < DECODE_BENCHMARK_PASSES; pass++)
+		{
+			kernel->decode(planes_0, planes_1, TILE_ROWS, pixels);
+		}
+		const double seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+		// The bit by bit loop comes first
+		if (i == 0)
+		{
+			memcpy(bit_by_bit, pixels, sizeof(pixels));
+			bit_by_bit_seconds = seconds;
+		}
+
+		printf("%-12s %.2f ns/row, %.1f times the bit by bit loop%s\n", kernel->name,
+			seconds * 1e9 / ((double)TILE_ROWS * DECODE_BENCHMARK_PASSES), bit_by_bit_seconds / seconds,
+			memcmp(bit_by_bit, pixels, sizeof(pixels)) == 0 ? "" : ", DIFFERENT OUTPUT");
+	}
+}
+
+// Writes the C translation of the loaded PRG-ROM to path, see recompiler.h
+int write_recompiled(const cpu* cpu, const char* rom_name, const char* path)
+{
+	FILE* out = fopen(path, "w");
+	if (out == NULL)
+	{
+		printf("Could not open %s\n", path);
+		return 1;
+	}
+
+	const int blocks = recompile_prg_rom(cpu, out, rom_name);
+	if (fclose(out) != 0 || blocks < 0)
+	{
+		printf("Could not write %s\n", path);
+		return 1;
+	}
+
+	printf("%d blocks written to %s\n", blocks, path);
+	return 0;
+}
+
+// Memory of the loaded cartridge or raw image, the cpu only keeps pointers to it
+static byte prg_ram[PRG_RAM_SIZE];
+static byte chr_ram[CHR_SIZE];
+static byte raw_image[MAX_MEMORY];
+
+static uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+// PRG-ROM and CHR-ROM are used where they are in the file. Every cartridge gets PRG-RAM, like with iNES files
+// that leave its size at 0, and CHR-RAM when it has no CHR-ROM.
+void load_cartridge(nes* nes, const char* rom, const word prg_size, const word chr_size)
+{
+	cpu_load_cartridge(&nes->cpu, (const byte*)&rom[0x10], prg_size, prg_ram);
+
+	nes->cpu.controller = &nes->controller;
+	cpu_init(&nes->cpu, prg_size);
+
+	vram* vram = &nes->cpu.ppu.memory;
+	vram->chr = chr_size != 0 ? (byte*)&rom[prg_size + 0x10] : chr_ram;
+	vram->chr_writable = chr_size == 0;
+	vram->mirroring = rom[6] & 0b00000001 ? mirroring_vertical : mirroring_horizontal;
+	ppu_decode_chr(&nes->cpu.ppu);
+}
+
+// Loads a binary without an iNES header, such as the 6502 test programs in rom/.
+// A 64KB image fills the whole address space and starts at $0400 like 6502_functional_test.bin,
+// smaller images end at $FFFF and start at their reset vector.
+void load_raw_image(nes* nes, const char* image, const uint32_t size)
+{
+	const uint32_t length = size < MAX_MEMORY ? size : MAX_MEMORY;
+	memcpy(&raw_image[MAX_MEMORY - length], image, length);
+	cpu_load_image(&nes->cpu, raw_image);
+
+	nes->cpu.controller = &nes->controller;
+	cpu_init(&nes->cpu, 0x8000);
+
+	if (length == MAX_MEMORY)
+	{
+		nes->cpu.pc = 0x0400;
+	}
+}
+
 int main(const int argc, char** argv)
 {
 	char* rom = NULL;
@@ -103,20 +293,57 @@ int main(const int argc, char** argv)
 
 	cpu_clear_memory(&nes.cpu);
 
-	print_header_info(rom, &prg_size, &chr_size);
+	if (size >= 16 && memcmp(rom, "NES\x1A", 4) == 0)
+	{
+		print_header_info(rom, &prg_size, &chr_size);
+		load_cartridge(&nes, rom, prg_size, chr_size);
+	}
+	else
+	{
+		load_raw_image(&nes, rom, size);
+	}
+	cpu_decode_prg_rom(&nes.cpu);
+#ifdef NATIVE_HOOKS
+	hooks_attach(&nes.cpu);
+#endif
 
+	if (argc > 3 && strcmp(argv[2], "--recompile") == 0)
+	{
+		const int recompile_result = write_recompiled(&nes.cpu, argv[1], argv[3]);
+		cpu_free(&nes.cpu);
+		free(rom);
+		return recompile_result;
+	}
 
-	memcpy(&nes.cpu.memory.data[0x8000], &rom[0x10], prg_size);
+#ifdef RECOMPILED
+	if (!recompiled_attach(&nes.cpu))
+	{
+		puts("recompiled.c was generated from another ROM, running the interpreter only");
+	}
+#endif
 
-	if (prg_size == 0x4000)
+#ifdef JIT
+	if (!jit_create(&nes.cpu))
 	{
-		memcpy(&nes.cpu.memory.data[0xC000], &rom[0x10], prg_size);
+		puts("JIT: no executable memory, running the interpreter only");
 	}
+#endif
 
-	nes.cpu.controller = &nes.controller;
+	if (argc > 2 && strcmp(argv[2], "--bench") == 0)
+	{
+		run_benchmark(&nes);
+		cpu_free(&nes.cpu);
+		free(rom);
+		return 0;
+	}
 
-	cpu_init(&nes.cpu, prg_size);
-	memcpy(nes.cpu.ppu.memory.data, &rom[prg_size + 0x10], chr_size);
+	if (argc > 2 && strcmp(argv[2], "--bench-decode") == 0)
+	{
+		run_decode_benchmark(&nes);
+		cpu_free(&nes.cpu);
+		free(rom);
+		return 0;
+	}
 
 	SDL_Init(SDL_INIT_EVERYTHING);
 	SDL_Window* window = SDL_CreateWindow(
@@ -127,10 +354,10 @@ int main(const int argc, char** argv)
 		SCREEN_HEIGHT * PIXEL_WIDTH,
 		SDL_WINDOW_SHOWN);
 
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_TEXTUREACCESS_TARGET);
-
-	int x = 0;
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
 
+	// Input is polled once per frame
 	while (true)
 	{
 		SDL_Event event;
@@ -143,33 +370,15 @@ int main(const int argc, char** argv)
 			handle_input(&nes.controller, &event);
 		}
 
-		cpu_exec(&nes.cpu, nes.cpu.memory.data[nes.cpu.pc++]);
-
-		if (x == 4000)
-		{
-			render_background(&nes.cpu.ppu, renderer);
-			render_sprites(&nes.cpu.ppu, renderer);
-		}
-
-		if (x >= 1200)
-		{
-			nes.cpu.ppu.registers.ppu_status ^= (0 ^ nes.cpu.ppu.registers.ppu_status) & 0b10000000;
-		}
-
-		if (x == 4001)
-		{
-			nes.cpu.ppu.registers.ppu_status |= 0b10000000;
-			if (nes.cpu.ppu.registers.ppu_ctrl & 0b10000000)
-			{
-				cpu_call_nmi(&nes.cpu);
-			}
-			x = 0;
-		}
-		x++;
+		run_frame(&nes, framebuffer);
+		present_frame(renderer, texture, framebuffer);
 	}
 
 out:
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
+	cpu_free(&nes.cpu);
 	free(rom);
 	return 0;
 }
@@ -177,7 +386,7 @@ out:
 
 int load_file(char** text, const char* filename, uint32_t* size_out)
 {
-	FILE* fp = fopen(filename, "r");
+	FILE* fp = fopen(filename, "rb");
 	if (fp != NULL)
 	{
 		if (fseek(fp, 0L, SEEK_END) == 0)
@@ -188,8 +397,8 @@ int load_file(char** text, const char* filename, uint32_t* size_out)
 				fclose(fp);
 				return 1;
 			}
-			*size_out = sizeof(char) * (bufsize + 1) + 100;
-			*text = malloc(*size_out);
+			*size_out = (uint32_t)bufsize;
+			*text = malloc(sizeof(char) * (bufsize + 1) + 100);
 
 			if (fseek(fp, 0L, SEEK_SET) != 0)
 			{
@@ -0,0 +1,359 @@
+// Opcode definition list, one entry for each of the 256 opcodes:
+// OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle)
+// where cycles is the documented base cycle count and page_cycle is 1 when an indexed read takes a cycle more
+// when the index carries into the high byte of the address. Branches add their own cycles.
+// The instruction length follows from the address mode, see cpu_instruction_length.
+// This file is an X-macro: define OP before including it and it expands once per opcode.
+// Unofficial opcodes expand through UNOFFICIAL_OP, which defaults to OP. Define it empty to leave them out.
+// https://www.nesdev.org/obelisk-6502-guide/reference.html
+// https://www.nesdev.org/wiki/CPU_unofficial_opcodes
+
+#ifndef OP
+#error "Define OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) before including opcodes.h"
+#endif
+
+#ifndef UNOFFICIAL_OP
+#define UNOFFICIAL_OP OP
+#define UNOFFICIAL_OP_IS_OP
+#endif
+
+OP(A9, LDA, lda, immediate, 2, 0)
+OP(A5, LDA, lda, zero_page, 3, 0)
+OP(B5, LDA, lda, zero_page_x, 4, 0)
+OP(AD, LDA, lda, absolute, 4, 0)
+OP(BD, LDA, lda, absolute_x, 4, 1)
+OP(B9, LDA, lda, absolute_y, 4, 1)
+OP(A1, LDA, lda, indexed_indirect, 6, 0)
+OP(B1, LDA, lda, indirect_indexed, 5, 1)
+
+OP(A2, LDX, ldx, immediate, 2, 0)
+OP(A6, LDX, ldx, zero_page, 3, 0)
+OP(B6, LDX, ldx, zero_page_y, 4, 0)
+OP(AE, LDX, ldx, absolute, 4, 0)
+OP(BE, LDX, ldx, absolute_y, 4, 1)
+
+OP(A0, LDY, ldy, immediate, 2, 0)
+OP(A4, LDY, ldy, zero_page, 3, 0)
+OP(B4, LDY, ldy, zero_page_x, 4, 0)
+OP(AC, LDY, ldy, absolute, 4, 0)
+OP(BC, LDY, ldy, absolute_x, 4, 1)
+
+OP(69, ADC, adc, immediate, 2, 0)
+OP(65, ADC, adc, zero_page, 3, 0)
+OP(75, ADC, adc, zero_page_x, 4, 0)
+OP(6D, ADC, adc, absolute, 4, 0)
+OP(7D, ADC, adc, absolute_x, 4, 1)
+OP(79, ADC, adc, absolute_y, 4, 1)
+OP(61, ADC, adc, indexed_indirect, 6, 0)
+OP(71, ADC, adc, indirect_indexed, 5, 1)
+
+OP(29, AND, AND, immediate, 2, 0)
+OP(25, AND, AND, zero_page, 3, 0)
+OP(35, AND, AND, zero_page_x, 4, 0)
+OP(2D, AND, AND, absolute, 4, 0)
+OP(3D, AND, AND, absolute_x, 4, 1)
+OP(39, AND, AND, absolute_y, 4, 1)
+OP(21, AND, AND, indexed_indirect, 6, 0)
+OP(31, AND, AND, indirect_indexed, 5, 1)
+
+OP(0A, ASL, asl, accumulator, 2, 0)
+OP(06, ASL, asl, zero_page, 5, 0)
+OP(16, ASL, asl, zero_page_x, 6, 0)
+OP(0E, ASL, asl, absolute, 6, 0)
+OP(1E, ASL, asl, absolute_x, 7, 0)
+
+OP(90, BCC, bcc, relative, 2, 0)
+
+OP(B0, BCS, bcs, relative, 2, 0)
+
+OP(F0, BEQ, beq, relative, 2, 0)
+
+OP(24, BIT, bit, zero_page, 3, 0)
+OP(2C, BIT, bit, absolute, 4, 0)
+
+OP(30, BMI, bmi, relative, 2, 0)
+
+OP(D0, BNE, bne, relative, 2, 0)
+
+OP(10, BPL, bpl, relative, 2, 0)
+
+OP(00, BRK, brk, implicit, 7, 0)
+
+OP(50, BVC, bvc, relative, 2, 0)
+
+OP(70, BVS, bvs, relative, 2, 0)
+
+OP(18, CLC, clc, implicit, 2, 0)
+
+OP(D8, CLD, cld, implicit, 2, 0)
+
+OP(58, CLI, cli, implicit, 2, 0)
+
+OP(B8, CLV, clv, implicit, 2, 0)
+
+OP(C9, CMP, cmp, immediate, 2, 0)
+OP(C5, CMP, cmp, zero_page, 3, 0)
+OP(D5, CMP, cmp, zero_page_x, 4, 0)
+OP(CD, CMP, cmp, absolute, 4, 0)
+OP(DD, CMP, cmp, absolute_x, 4, 1)
+OP(D9, CMP, cmp, absolute_y, 4, 1)
+OP(C1, CMP, cmp, indexed_indirect, 6, 0)
+OP(D1, CMP, cmp, indirect_indexed, 5, 1)
+
+OP(E0, CPX, cpx, immediate, 2, 0)
+OP(E4, CPX, cpx, zero_page, 3, 0)
+OP(EC, CPX, cpx, absolute, 4, 0)
+
+OP(C0, CPY, cpy, immediate, 2, 0)
+OP(C4, CPY, cpy, zero_page, 3, 0)
+OP(CC, CPY, cpy, absolute, 4, 0)
+
+OP(C6, DEC, dec, zero_page, 5, 0)
+OP(D6, DEC, dec, zero_page_x, 6, 0)
+OP(CE, DEC, dec, absolute, 6, 0)
+OP(DE, DEC, dec, absolute_x, 7, 0)
+
+OP(CA, DEX, dex, implicit, 2, 0)
+
+OP(88, DEY, dey, implicit, 2, 0)
+
+OP(49, EOR, eor, immediate, 2, 0)
+OP(45, EOR, eor, zero_page, 3, 0)
+OP(55, EOR, eor, zero_page_x, 4, 0)
+OP(4D, EOR, eor, absolute, 4, 0)
+OP(5D, EOR, eor, absolute_x, 4, 1)
+OP(59, EOR, eor, absolute_y, 4, 1)
+OP(41, EOR, eor, indexed_indirect, 6, 0)
+OP(51, EOR, eor, indirect_indexed, 5, 1)
+
+OP(E6, INC, inc, zero_page, 5, 0)
+OP(F6, INC, inc, zero_page_x, 6, 0)
+OP(EE, INC, inc, absolute, 6, 0)
+OP(FE, INC, inc, absolute_x, 7, 0)
+
+OP(E8, INX, inx, implicit, 2, 0)
+
+OP(C8, INY, iny, implicit, 2, 0)
+
+OP(4C, JMP, jmp, absolute, 3, 0)
+OP(6C, JMP, jmp, indirect, 5, 0)
+
+OP(20, JSR, jsr, absolute, 6, 0)
+
+OP(4A, LSR, lsr, accumulator, 2, 0)
+OP(46, LSR, lsr, zero_page, 5, 0)
+OP(56, LSR, lsr, zero_page_x, 6, 0)
+OP(4E, LSR, lsr, absolute, 6, 0)
+OP(5E, LSR, lsr, absolute_x, 7, 0)
+
+OP(EA, NOP, nop, implicit, 2, 0)
+
+OP(09, ORA, ora, immediate, 2, 0)
+OP(05, ORA, ora, zero_page, 3, 0)
+OP(15, ORA, ora, zero_page_x, 4, 0)
+OP(0D, ORA, ora, absolute, 4, 0)
+OP(1D, ORA, ora, absolute_x, 4, 1)
+OP(19, ORA, ora, absolute_y, 4, 1)
+OP(01, ORA, ora, indexed_indirect, 6, 0)
+OP(11, ORA, ora, indirect_indexed, 5, 1)
+
+OP(48, PHA, pha, implicit, 3, 0)
+
+OP(08, PHP, php, implicit, 3, 0)
+
+OP(68, PLA, pla, implicit, 4, 0)
+
+OP(28, PLP, plp, implicit, 4, 0)
+
+OP(2A, ROL, rol, accumulator, 2, 0)
+OP(26, ROL, rol, zero_page, 5, 0)
+OP(36, ROL, rol, zero_page_x, 6, 0)
+OP(2E, ROL, rol, absolute, 6, 0)
+OP(3E, ROL, rol, absolute_x, 7, 0)
+
+OP(6A, ROR, ror, accumulator, 2, 0)
+OP(66, ROR, ror, zero_page, 5, 0)
+OP(76, ROR, ror, zero_page_x, 6, 0)
+OP(6E, ROR, ror, absolute, 6, 0)
+OP(7E, ROR, ror, absolute_x, 7, 0)
+
+OP(40, RTI, rti, implicit, 6, 0)
+
+OP(60, RTS, rts, implicit, 6, 0)
+
+OP(E9, SBC, sbc, immediate, 2, 0)
+OP(E5, SBC, sbc, zero_page, 3, 0)
+OP(F5, SBC, sbc, zero_page_x, 4, 0)
+OP(ED, SBC, sbc, absolute, 4, 0)
+OP(FD, SBC, sbc, absolute_x, 4, 1)
+OP(F9, SBC, sbc, absolute_y, 4, 1)
+OP(E1, SBC, sbc, indexed_indirect, 6, 0)
+OP(F1, SBC, sbc, indirect_indexed, 5, 1)
+
+OP(38, SEC, sec, implicit, 2, 0)
+
+OP(F8, SED, sed, implicit, 2, 0)
+
+OP(78, SEI, sei, implicit, 2, 0)
+
+OP(85, STA, sta, zero_page, 3, 0)
+OP(95, STA, sta, zero_page_x, 4, 0)
+OP(8D, STA, sta, absolute, 4, 0)
+OP(9D, STA, sta, absolute_x, 5, 0)
+OP(99, STA, sta, absolute_y, 5, 0)
+OP(81, STA, sta, indexed_indirect, 6, 0)
+OP(91, STA, sta, indirect_indexed, 6, 0)
+
+OP(86, STX, stx, zero_page, 3, 0)
+OP(96, STX, stx, zero_page_y, 4, 0)
+OP(8E, STX, stx, absolute, 4, 0)
+
+OP(84, STY, sty, zero_page, 3, 0)
+OP(94, STY, sty, zero_page_x, 4, 0)
+OP(8C, STY, sty, absolute, 4, 0)
+
+OP(AA, TAX, tax, implicit, 2, 0)
+
+OP(A8, TAY, tay, implicit, 2, 0)
+
+OP(BA, TSX, tsx, implicit, 2, 0)
+
+OP(8A, TXA, txa, implicit, 2, 0)
+
+OP(9A, TXS, txs, implicit, 2, 0)
+
+OP(98, TYA, tya, implicit, 2, 0)
+
+// Unofficial opcodes
+
+UNOFFICIAL_OP(04, NOP, nop, zero_page, 3, 0)
+UNOFFICIAL_OP(0C, NOP, nop, absolute, 4, 0)
+UNOFFICIAL_OP(14, NOP, nop, zero_page_x, 4, 0)
+UNOFFICIAL_OP(1A, NOP, nop, implicit, 2, 0)
+UNOFFICIAL_OP(1C, NOP, nop, absolute_x, 4, 1)
+UNOFFICIAL_OP(34, NOP, nop, zero_page_x, 4, 0)
+UNOFFICIAL_OP(3A, NOP, nop, implicit, 2, 0)
+UNOFFICIAL_OP(3C, NOP, nop, absolute_x, 4, 1)
+UNOFFICIAL_OP(44, NOP, nop, zero_page, 3, 0)
+UNOFFICIAL_OP(54, NOP, nop, zero_page_x, 4, 0)
+UNOFFICIAL_OP(5A, NOP, nop, implicit, 2, 0)
+UNOFFICIAL_OP(5C, NOP, nop, absolute_x, 4, 1)
+UNOFFICIAL_OP(64, NOP, nop, zero_page, 3, 0)
+UNOFFICIAL_OP(74, NOP, nop, zero_page_x, 4, 0)
+UNOFFICIAL_OP(7A, NOP, nop, implicit, 2, 0)
+UNOFFICIAL_OP(7C, NOP, nop, absolute_x, 4, 1)
+UNOFFICIAL_OP(80, NOP, nop, immediate, 2, 0)
+UNOFFICIAL_OP(82, NOP, nop, immediate, 2, 0)
+UNOFFICIAL_OP(89, NOP, nop, immediate, 2, 0)
+UNOFFICIAL_OP(C2, NOP, nop, immediate, 2, 0)
+UNOFFICIAL_OP(D4, NOP, nop, zero_page_x, 4, 0)
+UNOFFICIAL_OP(DA, NOP, nop, implicit, 2, 0)
+UNOFFICIAL_OP(DC, NOP, nop, absolute_x, 4, 1)
+UNOFFICIAL_OP(E2, NOP, nop, immediate, 2, 0)
+UNOFFICIAL_OP(F4, NOP, nop, zero_page_x, 4, 0)
+UNOFFICIAL_OP(FA, NOP, nop, implicit, 2, 0)
+UNOFFICIAL_OP(FC, NOP, nop, absolute_x, 4, 1)
+
+UNOFFICIAL_OP(EB, SBC, sbc, immediate, 2, 0)
+
+UNOFFICIAL_OP(A3, LAX, lax, indexed_indirect, 6, 0)
+UNOFFICIAL_OP(A7, LAX, lax, zero_page, 3, 0)
+UNOFFICIAL_OP(AF, LAX, lax, absolute, 4, 0)
+UNOFFICIAL_OP(B3, LAX, lax, indirect_indexed, 5, 1)
+UNOFFICIAL_OP(B7, LAX, lax, zero_page_y, 4, 0)
+UNOFFICIAL_OP(BF, LAX, lax, absolute_y, 4, 1)
+
+UNOFFICIAL_OP(83, SAX, sax, indexed_indirect, 6, 0)
+UNOFFICIAL_OP(87, SAX, sax, zero_page, 3, 0)
+UNOFFICIAL_OP(8F, SAX, sax, absolute, 4, 0)
+UNOFFICIAL_OP(97, SAX, sax, zero_page_y, 4, 0)
+
+UNOFFICIAL_OP(C3, DCP, dcp, indexed_indirect, 8, 0)
+UNOFFICIAL_OP(C7, DCP, dcp, zero_page, 5, 0)
+UNOFFICIAL_OP(CF, DCP, dcp, absolute, 6, 0)
+UNOFFICIAL_OP(D3, DCP, dcp, indirect_indexed, 8, 0)
+UNOFFICIAL_OP(D7, DCP, dcp, zero_page_x, 6, 0)
+UNOFFICIAL_OP(DB, DCP, dcp, absolute_y, 7, 0)
+UNOFFICIAL_OP(DF, DCP, dcp, absolute_x, 7, 0)
+
+UNOFFICIAL_OP(E3, ISC, isc, indexed_indirect, 8, 0)
+UNOFFICIAL_OP(E7, ISC, isc, zero_page, 5, 0)
+UNOFFICIAL_OP(EF, ISC, isc, absolute, 6, 0)
+UNOFFICIAL_OP(F3, ISC, isc, indirect_indexed, 8, 0)
+UNOFFICIAL_OP(F7, ISC, isc, zero_page_x, 6, 0)
+UNOFFICIAL_OP(FB, ISC, isc, absolute_y, 7, 0)
+UNOFFICIAL_OP(FF, ISC, isc, absolute_x, 7, 0)
+
+UNOFFICIAL_OP(03, SLO, slo, indexed_indirect, 8, 0)
+UNOFFICIAL_OP(07, SLO, slo, zero_page, 5, 0)
+UNOFFICIAL_OP(0F, SLO, slo, absolute, 6, 0)
+UNOFFICIAL_OP(13, SLO, slo, indirect_indexed, 8, 0)
+UNOFFICIAL_OP(17, SLO, slo, zero_page_x, 6, 0)
+UNOFFICIAL_OP(1B, SLO, slo, absolute_y, 7, 0)
+UNOFFICIAL_OP(1F, SLO, slo, absolute_x, 7, 0)
+
+UNOFFICIAL_OP(23, RLA, rla, indexed_indirect, 8, 0)
+UNOFFICIAL_OP(27, RLA, rla, zero_page, 5, 0)
+UNOFFICIAL_OP(2F, RLA, rla, absolute, 6, 0)
+UNOFFICIAL_OP(33, RLA, rla, indirect_indexed, 8, 0)
+UNOFFICIAL_OP(37, RLA, rla, zero_page_x, 6, 0)
+UNOFFICIAL_OP(3B, RLA, rla, absolute_y, 7, 0)
+UNOFFICIAL_OP(3F, RLA, rla, absolute_x, 7, 0)
+
+UNOFFICIAL_OP(43, SRE, sre, indexed_indirect, 8, 0)
+UNOFFICIAL_OP(47, SRE, sre, zero_page, 5, 0)
+UNOFFICIAL_OP(4F, SRE, sre, absolute, 6, 0)
+UNOFFICIAL_OP(53, SRE, sre, indirect_indexed, 8, 0)
+UNOFFICIAL_OP(57, SRE, sre, zero_page_x, 6, 0)
+UNOFFICIAL_OP(5B, SRE, sre, absolute_y, 7, 0)
+UNOFFICIAL_OP(5F, SRE, sre, absolute_x, 7, 0)
+
+UNOFFICIAL_OP(63, RRA, rra, indexed_indirect, 8, 0)
+UNOFFICIAL_OP(67, RRA, rra, zero_page, 5, 0)
+UNOFFICIAL_OP(6F, RRA, rra, absolute, 6, 0)
+UNOFFICIAL_OP(73, RRA, rra, indirect_indexed, 8, 0)
+UNOFFICIAL_OP(77, RRA, rra, zero_page_x, 6, 0)
+UNOFFICIAL_OP(7B, RRA, rra, absolute_y, 7, 0)
+UNOFFICIAL_OP(7F, RRA, rra, absolute_x, 7, 0)
+
+UNOFFICIAL_OP(0B, ANC, anc, immediate, 2, 0)
+UNOFFICIAL_OP(2B, ANC, anc, immediate, 2, 0)
+
+UNOFFICIAL_OP(4B, ALR, alr, immediate, 2, 0)
+
+UNOFFICIAL_OP(6B, ARR, arr, immediate, 2, 0)
+
+UNOFFICIAL_OP(CB, AXS, axs, immediate, 2, 0)
+
+UNOFFICIAL_OP(BB, LAS, las, absolute_y, 4, 1)
+
+UNOFFICIAL_OP(8B, XAA, xaa, immediate, 2, 0)
+
+UNOFFICIAL_OP(AB, LXA, lxa, immediate, 2, 0)
+
+UNOFFICIAL_OP(93, SHA, sha, indirect_indexed, 6, 0)
+UNOFFICIAL_OP(9F, SHA, sha, absolute_y, 5, 0)
+
+UNOFFICIAL_OP(9E, SHX, shx, absolute_y, 5, 0)
+
+UNOFFICIAL_OP(9C, SHY, shy, absolute_x, 5, 0)
+
+UNOFFICIAL_OP(9B, TAS, tas, absolute_y, 5, 0)
+
+UNOFFICIAL_OP(02, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(12, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(22, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(32, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(42, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(52, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(62, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(72, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(92, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(B2, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(D2, JAM, jam, implicit, 2, 0)
+UNOFFICIAL_OP(F2, JAM, jam, implicit, 2, 0)
+
+#ifdef UNOFFICIAL_OP_IS_OP
+#undef UNOFFICIAL_OP
+#undef UNOFFICIAL_OP_IS_OP
+#endif
@@ -1,300 +1,601 @@
-#include <assert.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ppu.h"
+#include "tile_decode.h"
 
-word get_background_palette(const word attribute)
+// The byte behind a PPU address, NULL for pattern tables the cartridge doesn't have.
+// $3000-$3EFF mirror the name tables, and $3F10/$3F14/$3F18/$3F1C the backdrop entries of the background palettes.
+static byte* vram_address(const ppu* ppu, word address)
 {
-	switch (attribute) {
-		case 0:
-			return 0x3F00;
-		case 1:
-			return 0x3F04;
-		case 2:
-			return 0x3F08;
-		case 3:
-			return 0x3F0C;
-		default:
-			assert(false);
-			return 0;
+	address &= 0x3FFF;
+
+	if (address < NAME_TABLE_0)
+	{
+		return ppu->memory.chr != NULL ? &ppu->memory.chr[address] : NULL;
+	}
+
+	if (address < PALETTE_BASE)
+	{
+		const word table = (address >> 10) & 0x3;
+		const word physical_table = ppu->memory.mirroring == mirroring_vertical ? table & 0x1 : table >> 1;
+		return (byte*)&ppu->memory.name_tables[physical_table][address & (NAME_TABLE_SIZE - 1)];
+	}
+
+	address &= PALETTE_SIZE - 1;
+	if ((address & 0x13) == 0x10)
+	{
+		address &= 0x0F;
 	}
+	return (byte*)&ppu->memory.palette[address];
 }
 
-word get_sprite_palette(const word attribute)
+// Rows decoded in one go when the whole cache is built
+#define DECODE_BATCH_ROWS 256
+
+static void flip_tile_row(tile_row* row)
 {
-	switch (attribute) {
-		case 0:
-			return 0x3F10;
-		case 1:
-			return 0x3F14;
-		case 2:
-			return 0x3F18;
-		case 3:
-			return 0x3F1C;
-		default:
-			assert(false);
-			return 0;
+	for (int i = 0; i < TILE_WIDTH; i++)
+	{
+		row->flipped[TILE_WIDTH - 1 - i] = row->pixels[i];
 	}
 }
 
-void get_rgb_color(Uint8* r, Uint8* g, Uint8* b, const word index)
+static void decode_tile_row(const byte plane_0, const byte plane_1, tile_row* row)
 {
-	const uint32_t colors = ppu_colors[index];
-	*r = (colors >> 16) & 0xFF;
-	*g = (colors >> 8) & 0xFF;
-	*b = colors & 0xFF;
+	tile_decode(&plane_0, &plane_1, 1, row->pixels);
+	flip_tile_row(row);
 }
 
-void draw_bg_tile_row(const ppu* ppu, SDL_Renderer* renderer, const byte lo_byte, const byte hi_byte, const int x, const int y, const word palette_base)
+// Rows are numbered tile by tile, the two planes of a row are 8 bytes apart
+static word get_tile_row_index(const word pattern)
 {
-	int rx = x;
-	for (int i = 0; i < 8; i++)
-	{
-		const bool is_lo_set = lo_byte & (0b10000000 >> i);
-		const bool is_hi_set = hi_byte & (0b10000000 >> i);
+	return (word)(((pattern >> 1) & 0x0FF8) | (pattern & 0x7));
+}
 
-		Uint8 red;
-		Uint8 green;
-		Uint8 blue;
+// The decoded row at a pattern table address, decoded into scratch when there is no cache
+static const tile_row* get_tile_row(const ppu* ppu, const word pattern, tile_row* scratch)
+{
+	if (ppu->memory.tile_rows != NULL)
+	{
+		return &ppu->memory.tile_rows[get_tile_row_index(pattern)];
+	}
 
-		if (!is_hi_set && !is_lo_set) // 0
-		{
-			const word value = ppu->memory.data[palette_base + 0];
-			get_rgb_color(&red, &green, &blue, value);
-			SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
-		}
-		else if (!is_hi_set && is_lo_set) // 1
-		{
-			const word value = ppu->memory.data[palette_base + 2];
-			get_rgb_color(&red, &green, &blue, value);
-			SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
-		}
-		else if (is_hi_set && !is_lo_set) // 2
-		{
-			const word value = ppu->memory.data[palette_base + 1];
-			get_rgb_color(&red, &green, &blue, value);
-			SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
-		}
-		else if (is_hi_set && is_lo_set) // 3
-		{
-			const word value = ppu->memory.data[palette_base + 3];
-			get_rgb_color(&red, &green, &blue, value);
-			SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
-		}
+	decode_tile_row(ppu_read_vram(ppu, pattern), ppu_read_vram(ppu, pattern + 8), scratch);
+	return scratch;
+}
 
-		SDL_Rect r;
-		r.x = rx;
-		r.y = y;
-		r.w = PIXEL_WIDTH;
-		r.h = PIXEL_HEIGHT;
-		SDL_RenderFillRect(renderer, &r);
-		rx += PIXEL_WIDTH;
-	}
+byte ppu_read_vram(const ppu* ppu, const word address)
+{
+	const byte* data = vram_address(ppu, address);
+	return data != NULL ? *data : 0;
 }
 
-void draw_sprite_row_pixel(const ppu* ppu, SDL_Renderer* renderer, const byte lo_byte, const byte hi_byte, const int y, int* x, const word attribute, const int bit)
+void ppu_write_vram(ppu* ppu, const word address, const byte value)
 {
-	const bool is_lo_set = lo_byte & (0b10000000 >> bit);
-	const bool is_hi_set = hi_byte & (0b10000000 >> bit);
+	byte* data = vram_address(ppu, address);
 
-	Uint8 red;
-	Uint8 green;
-	Uint8 blue;
-	const word palette_base = get_sprite_palette(attribute & 0b00000011);
+	// CHR-ROM can't be written
+	if (data != NULL && ((address & 0x3FFF) >= NAME_TABLE_0 || ppu->memory.chr_writable))
+	{
+		*data = value;
+	}
 
-	if (!is_hi_set && is_lo_set) // 1
+	if ((address & 0x3FFF) < NAME_TABLE_0 && ppu->memory.chr_writable && ppu->memory.tile_rows != NULL)
 	{
-		const word index = ppu->memory.data[palette_base + 2];
-		get_rgb_color(&red, &green, &blue, index);
-		SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
+		const word pattern = address & 0x1FF7;
+		decode_tile_row(ppu->memory.chr[pattern], ppu->memory.chr[pattern + 8], &ppu->memory.tile_rows[get_tile_row_index(pattern)]);
 	}
-	else if (is_hi_set && !is_lo_set) // 2
+}
+
+void ppu_decode_chr(ppu* ppu)
+{
+	if (ppu->memory.chr == NULL)
 	{
-		const word index = ppu->memory.data[palette_base + 1];
-		get_rgb_color(&red, &green, &blue, index);
-		SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
+		return;
 	}
-	else if (is_hi_set && is_lo_set) // 3
+
+	if (ppu->memory.tile_rows == NULL)
 	{
-		const word index = ppu->memory.data[palette_base + 3];
-		get_rgb_color(&red, &green, &blue, index);
-		SDL_SetRenderDrawColor(renderer, red, green, blue, 255);
+		ppu->memory.tile_rows = malloc(TILE_ROWS * sizeof(tile_row));
+		if (ppu->memory.tile_rows == NULL)
+		{
+			return;
+		}
 	}
 
-	SDL_Rect r;
-	r.x = *x;
-	r.y = y;
-	r.w = PIXEL_WIDTH;
-	r.h = PIXEL_HEIGHT;
-	if (is_hi_set || is_lo_set)
+	for (int first = 0; first < TILE_ROWS; first += DECODE_BATCH_ROWS)
 	{
-		SDL_RenderFillRect(renderer, &r);
+		byte planes_0[DECODE_BATCH_ROWS];
+		byte planes_1[DECODE_BATCH_ROWS];
+		byte pixels[DECODE_BATCH_ROWS * TILE_WIDTH];
+
+		for (int i = 0; i < DECODE_BATCH_ROWS; i++)
+		{
+			const int row = first + i;
+			const word pattern = (word)((row / TILE_HEIGHT) * 16 + row % TILE_HEIGHT);
+			planes_0[i] = ppu->memory.chr[pattern];
+			planes_1[i] = ppu->memory.chr[pattern + 8];
+		}
+		tile_decode(planes_0, planes_1, DECODE_BATCH_ROWS, pixels);
+
+		for (int i = 0; i < DECODE_BATCH_ROWS; i++)
+		{
+			tile_row* row = &ppu->memory.tile_rows[first + i];
+			memcpy(row->pixels, &pixels[i * TILE_WIDTH], TILE_WIDTH);
+			flip_tile_row(row);
+		}
 	}
-	*x += PIXEL_WIDTH;
 }
 
-void draw_sprite_tile_row(const ppu* ppu, SDL_Renderer* renderer, const byte lo_byte, const byte hi_byte, const int x, const int y, const word attribute)
+void ppu_free(ppu* ppu)
 {
-	const bool flip_horizontally = attribute & 0b01000000;
+	free(ppu->memory.tile_rows);
+	ppu->memory.tile_rows = NULL;
+}
 
-	int rx = x;
+// ARGB of the color at a palette address, palette entries are 6 bits
+static uint32_t get_argb_color(const ppu* ppu, const word palette_address)
+{
+	return 0xFF000000 | ppu_colors[ppu_read_vram(ppu, palette_address) & 0x3F];
+}
 
-	if (flip_horizontally)
+static word get_bg_pattern_table(const ppu* ppu)
+{
+	return ppu->registers.ppu_ctrl & BG_PT_ADDR_FLAG ? PATTERN_TABLE_1 : PATTERN_TABLE_0;
+}
+
+static word get_sprite_pattern_table(const ppu* ppu)
+{
+	return ppu->registers.ppu_ctrl & SPRITE_PT_ADDR_FLAG ? PATTERN_TABLE_1 : PATTERN_TABLE_0;
+}
+
+// Scanline pixels are palette addresses relative to PALETTE_BASE, 0 where they are transparent.
+// The flags of sprite pixels sit above them.
+#define LINE_PIXEL_COLOR	0x1F
+#define LINE_PIXEL_BEHIND	0x40
+#define LINE_PIXEL_SPRITE_0	0x80
+
+// The tiles a scanline can show, one more than fit on the screen when fine x is not 0
+#define BG_ROW_TILES (SCREEN_WIDTH / TILE_WIDTH + 1)
+
+// Fetches the 33 tiles a scanline starting at v can show, from left to right, into the 264 pixels at pixels.
+// https://www.nesdev.org/wiki/PPU_scrolling#Tile_and_attribute_fetching
+static void fetch_bg_row(const ppu* ppu, word v, byte* pixels)
+{
+	const word pattern_table = get_bg_pattern_table(ppu) + ((v >> 12) & 0x7);
+	word patterns[BG_ROW_TILES];
+	byte palettes[BG_ROW_TILES];
+
+	for (int tile = 0; tile < BG_ROW_TILES; tile++)
 	{
-		for (int i = 7; i > -1; i--)
+		const byte tile_index = ppu_read_vram(ppu, NAME_TABLE_0 | (v & 0x0FFF));
+		const byte attribute = ppu_read_vram(ppu, (NAME_TABLE_0 + 960) | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+		palettes[tile] = (byte)(((attribute >> (((v >> 4) & 0x4) | (v & 0x2))) & 0x3) << 2);
+		patterns[tile] = pattern_table + tile_index * 16;
+
+		// Coarse x wraps around into the name table on the right
+		if ((v & 0x001F) == 31)
+		{
+			v = (v & ~0x001F) ^ 0x0400;
+		}
+		else
 		{
-			draw_sprite_row_pixel(ppu, renderer, lo_byte, hi_byte, y, &rx, attribute, i);
+			v++;
+		}
+	}
+
+	// The colors within the palettes come from the cache, or are decoded for the whole scanline at once
+	if (ppu->memory.tile_rows != NULL)
+	{
+		for (int tile = 0; tile < BG_ROW_TILES; tile++)
+		{
+			memcpy(&pixels[tile * TILE_WIDTH], ppu->memory.tile_rows[get_tile_row_index(patterns[tile])].pixels, TILE_WIDTH);
 		}
 	}
 	else
 	{
-		for (int i = 0; i < 8; i++)
+		byte planes_0[BG_ROW_TILES];
+		byte planes_1[BG_ROW_TILES];
+		for (int tile = 0; tile < BG_ROW_TILES; tile++)
 		{
-			draw_sprite_row_pixel(ppu, renderer, lo_byte, hi_byte, y, &rx, attribute, i);
+			planes_0[tile] = ppu_read_vram(ppu, patterns[tile]);
+			planes_1[tile] = ppu_read_vram(ppu, patterns[tile] + 8);
 		}
+		tile_decode(planes_0, planes_1, BG_ROW_TILES, pixels);
+	}
+
+	// Color 0 is transparent whatever the palette
+	for (int i = 0; i < BG_ROW_TILES * TILE_WIDTH; i++)
+	{
+		pixels[i] = pixels[i] != 0 ? palettes[i / TILE_WIDTH] | pixels[i] : 0;
 	}
 }
 
-void draw_bg_tile(const ppu* ppu, SDL_Renderer* renderer, int x, int y, const word pattern_pos, const word attr_tb_addr, const word nt_pos)
+// Draws the sprites on scanline y into the SCREEN_WIDTH pixels at pixels. Sprites are drawn a scanline below their
+// OAM y, the first MAX_LINE_SPRITES of them in OAM order, and the lower one wins where two overlap.
+// Returns whether sprite 0 is one of them.
+static bool fetch_sprite_row(ppu* ppu, const int y, byte* pixels)
 {
-	// https://www.nesdev.org/wiki/PPU_scrolling#Tile_and_attribute_fetching
-	const word attribute_address = attr_tb_addr | (nt_pos & 0x0C00) | ((nt_pos >> 4) & 0x38) | ((nt_pos >> 2) & 0x07);
+	const int height = ppu->registers.ppu_ctrl & SPRITE_SIZE_FLAG ? TILE_HEIGHT * 2 : TILE_HEIGHT;
+	int count = 0;
+	bool sprite_0 = false;
 
-	const byte attribute = ppu->memory.data[attribute_address];
+	memset(pixels, 0, SCREEN_WIDTH);
 
-	const byte attribute_shift = ((nt_pos & 0x40) >> 4) | (nt_pos & 0x2);
-	const byte palette_selector = (attribute >> attribute_shift) & 0x3;
+	for (int i = 0; i < OAM_SIZE; i += 4)
+	{
+		const byte* sprite = &ppu->oam.data[i];
+		int row = y - (sprite[0] + 1);
+		if (row < 0 || row >= height)
+		{
+			continue;
+		}
+
+		if (count == MAX_LINE_SPRITES)
+		{
+			ppu->registers.ppu_status |= SPRITE_OVERFLOW_FLAG;
+			break;
+		}
+		count++;
+		sprite_0 |= i == 0;
 
+		const byte attributes = sprite[2];
+		if (attributes & 0b10000000)
+		{
+			row = height - 1 - row;
+		}
 
-	const word palette_base = get_background_palette(palette_selector);
+		// 8x16 sprites take the pattern table from bit 0 of the tile index, and the tile below for their lower half
+		word pattern;
+		if (height == TILE_HEIGHT)
+		{
+			pattern = get_sprite_pattern_table(ppu) + sprite[1] * 16 + row;
+		}
+		else
+		{
+			pattern = (sprite[1] & 0x1 ? PATTERN_TABLE_1 : PATTERN_TABLE_0) + (sprite[1] & 0xFE) * 16 + (row & 0x8) * 2 + (row & 0x7);
+		}
+		tile_row scratch;
+		const tile_row* tile = get_tile_row(ppu, pattern, &scratch);
 
-	for (word i = 0; i < 8; i++)
-	{
-		const byte tile_hi_byte = ppu->memory.data[pattern_pos + i];
-		const byte tile_lo_byte = ppu->memory.data[pattern_pos + i + 8];
+		const byte flags = (byte)(0x10 | ((attributes & 0x3) << 2) | (attributes & 0b00100000 ? LINE_PIXEL_BEHIND : 0) | (i == 0 ? LINE_PIXEL_SPRITE_0 : 0));
+		const byte* values = attributes & 0b01000000 ? tile->flipped : tile->pixels;
 
-		draw_bg_tile_row(ppu, renderer, tile_lo_byte, tile_hi_byte, x, y, palette_base);
-		y += PIXEL_HEIGHT;
+		// Sprites are clipped at the right edge of the screen
+		for (int x = 0; x < TILE_WIDTH && sprite[3] + x < SCREEN_WIDTH; x++)
+		{
+			const byte value = values[x];
+			if (value != 0 && pixels[sprite[3] + x] == 0)
+			{
+				pixels[sprite[3] + x] = flags | value;
+			}
+		}
 	}
-}
 
-word get_name_table(const ppu* ppu)
-{
-	switch (ppu->registers.ppu_ctrl & NAME_TABLE_ADDR_FLAGS)
-	{
-		case 0:
-			return NAME_TABLE_0;
-		case 1:
-			return  NAME_TABLE_1;
-		case 2:
-			return NAME_TABLE_2;
-		case 3:
-			return  NAME_TABLE_3;
-		default:
-			assert(false);
-			return 0;
-	}
+	return sprite_0;
 }
 
-word get_pattern_table(const ppu* ppu)
+// Dot 256 moves v down a row, from row 29 of a name table to the one below it
+static void increment_y(ppu* ppu)
 {
-	if (ppu->registers.ppu_ctrl & BG_PT_ADDR_FLAG)
+	word v = ppu->ppu_data_addr;
+
+	if ((v & 0x7000) != 0x7000)
 	{
-		return PATTERN_TABLE_1;
+		v += 0x1000;
 	}
 	else
 	{
-		return PATTERN_TABLE_0;
+		v &= ~0x7000;
+		word coarse_y = (v & 0x03E0) >> 5;
+		if (coarse_y == 29)
+		{
+			coarse_y = 0;
+			v ^= 0x0800;
+		}
+		else if (coarse_y == 31)
+		{
+			// Rows 30 and 31 hold the attribute table, a scroll into them wraps without switching tables
+			coarse_y = 0;
+		}
+		else
+		{
+			coarse_y++;
+		}
+		v = (v & ~0x03E0) | (coarse_y << 5);
 	}
+
+	ppu->ppu_data_addr = v;
 }
 
-void draw_tiles(const ppu* ppu, SDL_Renderer* renderer)
+static bool is_rendering(const ppu* ppu)
 {
-	int x = 0;
-	int y = 0;
+	return ppu->registers.ppu_mask & (SHOW_BG_FLAG | SHOW_SPRITES_FLAG);
+}
+
+// Dot 1 of visible scanline y: draws the row into the framebuffer, raises the sprite overflow flag and finds the dot
+// of the sprite 0 hit
+static void draw_scanline(ppu* ppu, const int y)
+{
+	const byte mask = ppu->registers.ppu_mask;
+	uint32_t* line = ppu->framebuffer != NULL ? &ppu->framebuffer[y * SCREEN_WIDTH] : NULL;
 
-	const word bg_pattern_table_addr = get_pattern_table(ppu);
-	const word name_table_address = get_name_table(ppu);
+	// With rendering off the PPU shows the backdrop color
+	if (!is_rendering(ppu))
+	{
+		if (line != NULL)
+		{
+			const uint32_t backdrop = get_argb_color(ppu, PALETTE_BASE);
+			for (int x = 0; x < SCREEN_WIDTH; x++)
+			{
+				line[x] = backdrop;
+			}
+		}
+		return;
+	}
 
-	const word attribute_table_address = name_table_address + 960;
+	byte sprite_pixels[SCREEN_WIDTH];
+	const bool sprites = mask & SHOW_SPRITES_FLAG;
+	const bool sprite_0 = fetch_sprite_row(ppu, y, sprite_pixels) && sprites && (mask & SHOW_BG_FLAG) &&
+		!(ppu->registers.ppu_status & SPRITE_0_HIT_FLAG);
 
-	for (word i = 0; i < NAME_TABLE_SIZE; i++)
+	// Without a line to draw the background only matters to the sprite 0 hit
+	if (line == NULL && !sprite_0)
 	{
-		const word name_table_pos = name_table_address + i;
-		const word tile_index = ppu->memory.data[name_table_pos];
+		return;
+	}
 
-		const word pattern_pos = bg_pattern_table_addr + (tile_index * 16);
+	byte bg_row[SCREEN_WIDTH + TILE_WIDTH];
+	if (mask & SHOW_BG_FLAG)
+	{
+		fetch_bg_row(ppu, ppu->ppu_data_addr, bg_row);
+	}
+	else
+	{
+		memset(bg_row, 0, sizeof(bg_row));
+	}
 
-		draw_bg_tile(ppu, renderer, x * (TILE_WIDTH * PIXEL_WIDTH), y * (TILE_HEIGHT * PIXEL_HEIGHT), pattern_pos, attribute_table_address, name_table_address + i);
+	byte* bg_pixels = &bg_row[ppu->fine_x & 0x7];
+	if (!(mask & SHOW_BG_LEFT_FLAG))
+	{
+		memset(bg_pixels, 0, TILE_WIDTH);
+	}
+	if (!sprites)
+	{
+		memset(sprite_pixels, 0, SCREEN_WIDTH);
+	}
+	else if (!(mask & SHOW_SPRITES_LEFT_FLAG))
+	{
+		memset(sprite_pixels, 0, TILE_WIDTH);
+	}
 
-		if (x >= 31)
+	// The pixel at x comes out at dot x + 1, and the hit is never at the last one
+	if (sprite_0)
+	{
+		for (int x = 0; x < SCREEN_WIDTH - 1; x++)
 		{
-			y += 1;
-			x = 0;
+			if ((sprite_pixels[x] & LINE_PIXEL_SPRITE_0) && bg_pixels[x] != 0)
+			{
+				ppu->sprite_0_hit_dot = (word)(x + 1);
+				break;
+			}
 		}
-		else
+	}
+
+	if (line != NULL)
+	{
+		uint32_t colors[PALETTE_SIZE];
+		for (word i = 0; i < PALETTE_SIZE; i++)
 		{
-			x += 1;
+			colors[i] = get_argb_color(ppu, PALETTE_BASE + i);
+		}
+
+		for (int x = 0; x < SCREEN_WIDTH; x++)
+		{
+			const byte sprite = sprite_pixels[x];
+			const bool sprite_shown = sprite != 0 && !((sprite & LINE_PIXEL_BEHIND) && bg_pixels[x] != 0);
+			line[x] = colors[sprite_shown ? sprite & LINE_PIXEL_COLOR : bg_pixels[x]];
 		}
 	}
 }
 
-void draw_sprite_tile(const ppu* ppu, SDL_Renderer* renderer, word x, word y, word tile_index, byte attributes)
+// The pre-render scanline of odd frames skips its last dot while rendering
+static word scanline_length(const ppu* ppu)
+{
+	return ppu->scanline == PRE_RENDER_SCANLINE && ppu->odd_frame && is_rendering(ppu) ? SCANLINE_DOTS - 1 : SCANLINE_DOTS;
+}
+
+// The next dot of the scanline at which the PPU has something to do, or the end of the scanline
+static word next_dot(const ppu* ppu)
 {
-	const bool flip_vertically = attributes & 0b10000000;
+	const word dot = ppu->dot;
 
-	if(flip_vertically)
+	if (ppu->scanline < SCREEN_HEIGHT)
 	{
-		for (int i = 7; i > -1; i--)
+		if (dot < 1)
 		{
-			const byte tile_hi_byte = ppu->memory.data[tile_index + i];
-			const byte tile_lo_byte = ppu->memory.data[tile_index + i + 8];
-
-			draw_sprite_tile_row(ppu, renderer, tile_lo_byte, tile_hi_byte, x, y, attributes);
-			y += PIXEL_HEIGHT;
+			return 1;
+		}
+		if (ppu->sprite_0_hit_dot > dot)
+		{
+			return ppu->sprite_0_hit_dot;
+		}
+		if (dot < 257)
+		{
+			return 257;
 		}
 	}
-	else
+	else if (ppu->scanline == VBLANK_SCANLINE || ppu->scanline == PRE_RENDER_SCANLINE)
 	{
-		for (word i = 0; i < 8; i++)
+		if (dot < 1)
 		{
-			const byte tile_hi_byte = ppu->memory.data[tile_index + i];
-			const byte tile_lo_byte = ppu->memory.data[tile_index + i + 8];
-
-			draw_sprite_tile_row(ppu, renderer, tile_lo_byte, tile_hi_byte, x, y, attributes);
-			y += PIXEL_HEIGHT;
+			return 1;
+		}
+		if (ppu->scanline == PRE_RENDER_SCANLINE && dot < 304)
+		{
+			return 304;
 		}
 	}
+
+	return scanline_length(ppu);
 }
 
-void draw_sprites(const ppu* ppu, SDL_Renderer* renderer)
+// Does what the PPU does at the dot it has just reached
+static void run_dot(ppu* ppu)
 {
-	word sprite_pattern_table_addr;
-	if (ppu->registers.ppu_ctrl & SPRITE_PT_ADDR_FLAG)
+	if (ppu->dot == scanline_length(ppu))
 	{
-		sprite_pattern_table_addr = PATTERN_TABLE_1;
+		ppu->dot = 0;
+		if (++ppu->scanline == FRAME_SCANLINES)
+		{
+			ppu->scanline = 0;
+			ppu->odd_frame = !ppu->odd_frame;
+		}
+		return;
 	}
-	else
+
+	if (ppu->scanline < SCREEN_HEIGHT)
 	{
-		sprite_pattern_table_addr = PATTERN_TABLE_0;
+		if (ppu->dot == 1)
+		{
+			draw_scanline(ppu, ppu->scanline);
+		}
+		if (ppu->dot == ppu->sprite_0_hit_dot)
+		{
+			ppu->registers.ppu_status |= SPRITE_0_HIT_FLAG;
+			ppu->sprite_0_hit_dot = 0;
+		}
+		if (ppu->dot == 257 && is_rendering(ppu))
+		{
+			// Coarse x and the horizontal name table come back from t
+			increment_y(ppu);
+			ppu->ppu_data_addr = (ppu->ppu_data_addr & ~0x041F) | (ppu->ppu_temp_addr & 0x041F);
+		}
+	}
+	else if (ppu->scanline == VBLANK_SCANLINE)
+	{
+		ppu->registers.ppu_status |= VBLANK_FLAG;
+		ppu->frames++;
+	}
+	else if (ppu->scanline == PRE_RENDER_SCANLINE)
+	{
+		if (ppu->dot == 1)
+		{
+			ppu->registers.ppu_status &= ~(VBLANK_FLAG | SPRITE_0_HIT_FLAG | SPRITE_OVERFLOW_FLAG);
+		}
+		else if (is_rendering(ppu))
+		{
+			// Dot 304, v takes all of t
+			ppu->ppu_data_addr = ppu->ppu_temp_addr;
+		}
 	}
+}
 
-	for (int i = 0; i < 256; i += 4)
+void ppu_run(ppu* ppu, const uint64_t clock)
+{
+	// Skips from one dot with something to do to the next
+	while (ppu->clock < clock)
 	{
-		const byte sprite_y = ppu->oam.data[i];
-		const word sprite_tile_index = sprite_pattern_table_addr + (word)(ppu->oam.data[i + 1] << 4);
-		const byte sprite_attributes = ppu->oam.data[i + 2];
-		const byte sprite_x = ppu->oam.data[i + 3];
+		const word dot = next_dot(ppu);
+		const uint64_t dot_clock = ppu->clock + (dot - ppu->dot);
+		if (dot_clock > clock)
+		{
+			ppu->dot += (word)(clock - ppu->clock);
+			ppu->clock = clock;
+			return;
+		}
+
+		ppu->clock = dot_clock;
+		ppu->dot = dot;
+		run_dot(ppu);
+	}
+}
 
-		draw_sprite_tile(ppu, renderer, (word)(sprite_x * PIXEL_WIDTH), (word)(sprite_y * PIXEL_HEIGHT), sprite_tile_index, sprite_attributes);
+// Clock at which the PPU gets to dot of scanline next, in this frame or the next one
+static uint64_t get_dot_clock(const ppu* ppu, const word scanline, const word dot)
+{
+	int scanlines = scanline - ppu->scanline;
+	if (scanlines < 0 || (scanlines == 0 && dot <= ppu->dot))
+	{
+		scanlines += FRAME_SCANLINES;
+	}
+
+	// The pre-render scanline on the way may be a dot short
+	uint64_t dots = (uint64_t)scanlines * SCANLINE_DOTS + dot - ppu->dot;
+	if (ppu->scanline + scanlines >= FRAME_SCANLINES && ppu->odd_frame && is_rendering(ppu))
+	{
+		dots--;
 	}
+	return ppu->clock + dots;
 }
 
-void render_background(const ppu* ppu, SDL_Renderer* renderer)
+uint64_t ppu_next_vblank(const ppu* ppu)
 {
-	draw_tiles(ppu, renderer);
+	return get_dot_clock(ppu, VBLANK_SCANLINE, 1);
 }
 
-void render_sprites(const ppu* ppu, SDL_Renderer* renderer)
+// First visible scanline from first on that raises a sprite flag when it is drawn, SCREEN_HEIGHT when there is none
+static int find_sprite_flag_scanline(const ppu* ppu, const int first)
 {
-	draw_sprites(ppu, renderer);
-	SDL_RenderPresent(renderer);
-}
\ No newline at end of file
+	const byte mask = ppu->registers.ppu_mask;
+	const byte status = ppu->registers.ppu_status;
+	const int height = ppu->registers.ppu_ctrl & SPRITE_SIZE_FLAG ? TILE_HEIGHT * 2 : TILE_HEIGHT;
+
+	// Sprites on each scanline, up to the first one with too many of them
+	byte counts[SCREEN_HEIGHT] = { 0 };
+	int overflow = SCREEN_HEIGHT;
+	if (!(status & SPRITE_OVERFLOW_FLAG))
+	{
+		for (int i = 0; i < OAM_SIZE; i += 4)
+		{
+			for (int y = ppu->oam.data[i] + 1; y < ppu->oam.data[i] + 1 + height && y < SCREEN_HEIGHT; y++)
+			{
+				if (++counts[y] > MAX_LINE_SPRITES && y >= first && y < overflow)
+				{
+					overflow = y;
+				}
+			}
+		}
+	}
+
+	// Sprite 0 can only hit on the scanlines it is on, and only with both the background and the sprites shown
+	int hit = SCREEN_HEIGHT;
+	if (!(status & SPRITE_0_HIT_FLAG) && (mask & SHOW_BG_FLAG) && (mask & SHOW_SPRITES_FLAG))
+	{
+		const int top = ppu->oam.data[0] + 1;
+		if (top + height > first && top < SCREEN_HEIGHT)
+		{
+			hit = top > first ? top : first;
+		}
+	}
+
+	return hit < overflow ? hit : overflow;
+}
+
+uint64_t ppu_next_status_change(const ppu* ppu)
+{
+	if (ppu->sprite_0_hit_dot > ppu->dot)
+	{
+		return ppu->clock + (ppu->sprite_0_hit_dot - ppu->dot);
+	}
+
+	// Vblank starts, and the pre-render scanline clears the flags
+	const uint64_t vblank = ppu_next_vblank(ppu);
+	const uint64_t pre_render = get_dot_clock(ppu, PRE_RENDER_SCANLINE, 1);
+	uint64_t next = vblank < pre_render ? vblank : pre_render;
+
+	// Drawing a scanline may raise the sprite flags. Scanlines after vblank come after the pre-render scanline.
+	if (is_rendering(ppu))
+	{
+		const int first = ppu->scanline < SCREEN_HEIGHT ? ppu->scanline + (ppu->dot >= 1) : ppu->scanline == PRE_RENDER_SCANLINE ? 0 : SCREEN_HEIGHT;
+		const int scanline = find_sprite_flag_scanline(ppu, first);
+		if (scanline < SCREEN_HEIGHT)
+		{
+			const uint64_t draw = get_dot_clock(ppu, (word)scanline, 1);
+			next = draw < next ? draw : next;
+		}
+	}
+
+	return next;
+}
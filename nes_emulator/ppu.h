@@ -2,17 +2,47 @@
 
 #include <stdbool.h>
 #include <stdint.h>
-#include "SDL.h"
 
 #include "config.h"
 
-#define VRAM_SIZE 0x3FFF
 #define OAM_SIZE 256
+#define CHR_SIZE 0x2000
+#define PALETTE_SIZE 0x20
+#define NAME_TABLE_SIZE 0x0400
 
+// How the cartridge wires the two name tables in VRAM to $2000-$2FFF
+typedef enum
+{
+	mirroring_horizontal,
+	mirroring_vertical
+} mirroring;
+
+// A row of a pattern table tile decoded to the color of each pixel within its palette, 0 to 3.
+// Sprites flipped horizontally take the flipped pixels.
 typedef struct
 {
-	byte data[VRAM_SIZE];
-} vram_rom;
+	byte pixels[8];
+	byte flipped[8];
+} tile_row;
+
+// Each row of a tile is 2 bytes of CHR, one per bit plane
+#define TILE_ROWS (CHR_SIZE / 2)
+
+typedef struct
+{
+	// Pattern tables: CHR-ROM of the cartridge, or CHR-RAM when chr_writable. Owned by whoever loaded the cartridge.
+	byte* chr;
+	bool chr_writable;
+
+	// The TILE_ROWS rows of chr decoded, NULL until ppu_decode_chr is called. Writes to CHR-RAM decode their row again.
+	tile_row* tile_rows;
+
+	// VRAM has room for two name tables
+	byte name_tables[2][NAME_TABLE_SIZE];
+	mirroring mirroring;
+
+	byte palette[PALETTE_SIZE];
+} vram;
 
 typedef struct
 {
@@ -26,8 +56,6 @@ typedef struct
 	byte ppu_status;
 	byte oam_addr;
 	byte oam_data;
-	byte ppu_scroll_x;
-	byte ppu_scroll_y;
 	byte ppu_addr;
 	byte ppu_data;
 	byte oam_dma;
@@ -36,23 +64,66 @@ typedef struct
 } registers;
 
 
+// The registers, latch and address come first: the CPU touches them far more often than the tables, see cpu.h
 typedef struct
 {
-	vram_rom memory;
-	oam	oam;
 	registers registers;
 
 	// w
 	bool ppu_latch;
+
+	// v: the address PPU_DATA goes through, and the scroll position of the next pixel while rendering.
+	// Bits yyy NN YYYYY XXXXX: fine y, name table, coarse y, coarse x.
 	word ppu_data_addr;
+
+	// t: PPU_CTRL, PPU_SCROLL and PPU_ADDR writes go here first, with the same bits as v
+	word ppu_temp_addr;
+
+	// x: the pixel within the tile the scanline starts at
+	byte fine_x;
+#ifdef BUS_ACCURATE
+	// The last value on the bus between the CPU and the PPU registers, read back from the write-only ones
+	byte io_latch;
+#endif
+
+	// The PPU only runs when ppu_run catches it up. clock counts the dots it has run since power-up,
+	// scanline and dot are where that leaves it in the frame.
+	uint64_t clock;
+	word scanline;
+	word dot;
+
+	// Odd frames are a dot shorter while rendering
+	bool odd_frame;
+
+	// Dot of the current scanline at which sprite 0 hits the background, 0 when it doesn't
+	word sprite_0_hit_dot;
+
+	// Frames whose vblank has started
+	uint64_t frames;
+
+	// Where the visible scanlines are drawn, SCREEN_WIDTH x SCREEN_HEIGHT ARGB8888 pixels row by row, the layout of an
+	// SDL_PIXELFORMAT_ARGB8888 texture. NULL to leave them undrawn, the timing and the flags stay the same.
+	uint32_t* framebuffer;
+
+	oam	oam;
+	vram memory;
 } ppu;
 
 #define SCREEN_HEIGHT		240
 #define SCREEN_WIDTH		256
 
+// An NTSC frame is 262 scanlines of 341 dots, and the PPU runs 3 dots per CPU cycle
+#define SCANLINE_DOTS		341
+#define FRAME_SCANLINES		262
+#define DOTS_PER_CPU_CYCLE	3
+
+#define VBLANK_SCANLINE		241
+#define PRE_RENDER_SCANLINE	261
+
 #define TILE_HEIGHT			8
 #define TILE_WIDTH			8
 
+// Window pixels per NES pixel, SDL_RenderCopy scales the frame up
 #define PIXEL_HEIGHT		4
 #define PIXEL_WIDTH			4
 
@@ -65,7 +136,6 @@ typedef struct
 #define NAME_TABLE_3		0x2C00
 
 #define PATTERN_TABLE_SIZE	0x1000
-#define NAME_TABLE_SIZE		0x0400
 
 // Background pattern table address (0: $0000; 1: $1000)
 #define BG_PT_ADDR_FLAG		0b00010000
@@ -75,12 +145,30 @@ typedef struct
 #define SPRITE_PT_ADDR_FLAG		0b00001000
 
 
+// Sprite size (0: 8x8; 1: 8x16)
+#define SPRITE_SIZE_FLAG	0b00100000
+
 // Base name table address
 // (0 = $2000; 1 = $2400; 2 = $2800; 3 = $2C00)
 #define NAME_TABLE_ADDR_FLAGS 0b00000011
 
 #define PALETTE_BASE		  0X3F00
 
+// PPU_MASK: background and sprites in the leftmost 8 pixels, and at all
+#define SHOW_BG_LEFT_FLAG		0b00000010
+#define SHOW_SPRITES_LEFT_FLAG	0b00000100
+#define SHOW_BG_FLAG			0b00001000
+#define SHOW_SPRITES_FLAG		0b00010000
+
+// PPU_STATUS: more than MAX_LINE_SPRITES sprites on a scanline, an opaque pixel of sprite 0 over an opaque
+// background pixel, and vblank. All three stay up until the pre-render scanline, vblank also until PPU_STATUS is read.
+#define SPRITE_OVERFLOW_FLAG	0b00100000
+#define SPRITE_0_HIT_FLAG		0b01000000
+#define VBLANK_FLAG				0b10000000
+
+// Sprites the PPU draws on one scanline, the ones after them in OAM are dropped
+#define MAX_LINE_SPRITES		8
+
 static const uint32_t ppu_colors[64] =
 {
 	0x757575, 0x271B8F, 0x0000AB, 0x47009F, 0x8F0077, 0xAB0013, 0xA70000, 0x7F0B00,
@@ -93,5 +181,21 @@ static const uint32_t ppu_colors[64] =
 	0xFFE7A3, 0xE3FFA3, 0xABF3BF, 0xB3FFCF, 0x9FFFF3, 0x000000, 0x000000, 0x000000
 };
 
-void render_background(const ppu* ppu, SDL_Renderer* renderer);
-void render_sprites(const ppu* ppu, SDL_Renderer* renderer);
\ No newline at end of file
+// PPU address space: pattern tables, name tables and palettes with their mirrors
+byte ppu_read_vram(const ppu* ppu, word address);
+void ppu_write_vram(ppu* ppu, word address, byte value);
+
+// Decodes every row of the pattern tables. Call once chr is set, drawing reads the planes row by row without it.
+void ppu_decode_chr(ppu* ppu);
+void ppu_free(ppu* ppu);
+
+// Runs the PPU until its clock reaches clock. Each visible scanline is drawn at its dot 1 from v and fine x, and v moves
+// to the next row at dot 257. Vblank starts at dot 1 of scanline 241, and the pre-render scanline 261 clears the flags
+// at its dot 1 and loads the scroll position from t at dot 304.
+void ppu_run(ppu* ppu, uint64_t clock);
+
+// Clock at which the next vblank starts
+uint64_t ppu_next_vblank(const ppu* ppu);
+
+// Clock at which PPU_STATUS may change next, if the registers stay as they are
+uint64_t ppu_next_status_change(const ppu* ppu);
\ No newline at end of file
@@ -0,0 +1,1033 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "recompiler.h"
+
+#define PRG_ROM_SIZE			(MAX_MEMORY - PRG_ROM_START)
+
+// Longer runs are split so that blocks still fit in the short batches run between frame events
+#define MAX_BLOCK_INSTRUCTIONS	64
+
+// Longest address expression the generator builds
+#define MAX_EXPRESSION			64
+
+// How a memory operand reaches the bus, decided from the addresses it can take
+typedef enum
+{
+	// Straight to memory.ram
+	access_ram,
+	// Straight to memory.prg_rom, for reads only
+	access_rom,
+	// Through cpu_read_bus or cpu_write_bus
+	access_bus,
+	// Decided at run time by recompiled_read or recompiled_write
+	access_checked
+} access;
+
+typedef struct
+{
+	FILE* out;
+	address_mode address_mode;
+	word operand;
+	// Address of the instruction that follows
+	word next_pc;
+	// C expression of the effective address
+	char address[MAX_EXPRESSION];
+	access read;
+	access write;
+	// The address may land in the mirrors of internal RAM at $0800-$1FFF
+	bool mirrored;
+	// Base cycles of the block up to and including this instruction that are not in cpu->cycles yet
+	int cycles;
+	// An indexed read takes a cycle more when it crosses a page, see opcodes.h
+	bool page_cycle;
+} instruction;
+
+// What an instruction does to the flow of control, used to find the blocks
+typedef enum
+{
+	flow_next,
+	flow_branch,
+	flow_jump,
+	flow_indirect_jump,
+	flow_call,
+	flow_return
+} flow_kind;
+
+// Writes the C code of one instruction. Returns true when the instruction sets pc and ends the block.
+typedef bool (*recompile_function)(instruction* instruction);
+
+typedef struct
+{
+	const char* mnemonic;
+	recompile_function recompile;
+	address_mode address_mode;
+	byte cycles;
+	bool page_cycle;
+} recompiled_opcode;
+
+static access classify_read(const word first, const word last)
+{
+	if (last < RAM_END)
+	{
+		return access_ram;
+	}
+	if (first >= PRG_ROM_START)
+	{
+		return access_rom;
+	}
+	if (first >= RECOMPILED_IO_START && last < RECOMPILED_IO_END)
+	{
+		return access_bus;
+	}
+	return access_checked;
+}
+
+// Writes outside RAM go through the bus so the decode cache sees PRG-ROM changes
+static access classify_write(const word first, const word last)
+{
+	if (last < RAM_END)
+	{
+		return access_ram;
+	}
+	if (first >= RAM_END)
+	{
+		return access_bus;
+	}
+	return access_checked;
+}
+
+static void describe_indexed(instruction* i, const char* index)
+{
+	const int last = i->operand + 0xFF;
+
+	snprintf(i->address, sizeof(i->address), "(word)(0x%04X + %s)", i->operand, index);
+	i->mirrored = last >= RAM_SIZE;
+	if (last < MAX_MEMORY)
+	{
+		i->read = classify_read(i->operand, (word)last);
+		i->write = classify_write(i->operand, (word)last);
+	}
+	else
+	{
+		// The part that wraps around lands in the zero page
+		i->read = access_checked;
+		i->write = access_checked;
+	}
+}
+
+// Fills in the address expression and access kinds of the operand
+static void describe_operand(instruction* i)
+{
+	i->address[0] = '\0';
+	i->read = access_ram;
+	i->write = access_ram;
+	i->mirrored = false;
+
+	switch (i->address_mode)
+	{
+		case zero_page:
+			snprintf(i->address, sizeof(i->address), "0x%02X", i->operand);
+			break;
+		case zero_page_x:
+			snprintf(i->address, sizeof(i->address), "(byte)(0x%02X + x)", i->operand);
+			break;
+		case zero_page_y:
+			snprintf(i->address, sizeof(i->address), "(byte)(0x%02X + y)", i->operand);
+			break;
+		case absolute:
+		case indirect:
+			i->read = classify_read(i->operand, i->operand);
+			i->write = classify_write(i->operand, i->operand);
+			// The mirrors of internal RAM are accessed at their address in $0000-$07FF
+			snprintf(i->address, sizeof(i->address), "0x%04X", i->read == access_ram ? i->operand & (RAM_SIZE - 1) : i->operand);
+			break;
+		case absolute_x:
+			describe_indexed(i, "x");
+			break;
+		case absolute_y:
+			describe_indexed(i, "y");
+			break;
+		case indexed_indirect:
+			snprintf(i->address, sizeof(i->address), "recompiled_pointer(cpu, (byte)(0x%02X + x))", i->operand);
+			i->read = access_checked;
+			i->write = access_checked;
+			break;
+		case indirect_indexed:
+			snprintf(i->address, sizeof(i->address), "(word)(recompiled_pointer(cpu, 0x%02X) + y)", i->operand);
+			i->read = access_checked;
+			i->write = access_checked;
+			break;
+		default:
+			break;
+	}
+}
+
+static void format_ram(char* buffer, const size_t size, const instruction* i, const char* address)
+{
+	if (i->mirrored)
+	{
+		snprintf(buffer, size, "cpu->memory.ram[%s & (RAM_SIZE - 1)]", address);
+	}
+	else
+	{
+		snprintf(buffer, size, "cpu->memory.ram[%s]", address);
+	}
+}
+
+static void format_read(char* buffer, const size_t size, const instruction* i, const char* address)
+{
+	switch (i->read)
+	{
+		case access_ram:
+			format_ram(buffer, size, i, address);
+			break;
+		case access_rom:
+			snprintf(buffer, size, "recompiled_rom(cpu, %s)", address);
+			break;
+		case access_bus:
+			snprintf(buffer, size, "cpu_read_bus(cpu, %s)", address);
+			break;
+		case access_checked:
+			snprintf(buffer, size, "recompiled_read(cpu, %s)", address);
+			break;
+	}
+}
+
+// Brings cpu->cycles up to date with the end of the instruction, before an access that may reach the registers.
+// The PPU catches up to cpu->cycles on those, and an OAM DMA stall depends on it.
+static void emit_cycles(instruction* i, const char* indent)
+{
+	fprintf(i->out, "%scpu->cycles += %d + penalty;\n%spenalty = 0;\n", indent, i->cycles, indent);
+	i->cycles = 0;
+}
+
+static bool reaches_registers(const access access)
+{
+	return access == access_bus || access == access_checked;
+}
+
+static void emit_write(instruction* i, const char* indent, const char* address, const char* value)
+{
+	if (i->write != access_ram)
+	{
+		emit_cycles(i, indent);
+	}
+
+	switch (i->write)
+	{
+		case access_ram:
+		{
+			char ram[MAX_EXPRESSION * 2];
+			format_ram(ram, sizeof(ram), i, address);
+			fprintf(i->out, "%s%s = %s;\n", indent, ram, value);
+			break;
+		}
+		case access_rom:
+		case access_bus:
+			fprintf(i->out, "%scpu_write_bus(cpu, %s, %s);\n", indent, address, value);
+			break;
+		case access_checked:
+			fprintf(i->out, "%srecompiled_write(cpu, %s, %s);\n", indent, address, value);
+			break;
+	}
+}
+
+// C expression of the value an instruction operates on.
+// Indexed reads first write the cycle they take more when the index carries into the high byte.
+static void prepare_argument(char* buffer, const size_t size, instruction* i)
+{
+	if (i->address_mode == immediate)
+	{
+		snprintf(buffer, size, "0x%02X", i->operand);
+		return;
+	}
+
+	if (i->page_cycle)
+	{
+		switch (i->address_mode)
+		{
+			case absolute_x:
+				fprintf(i->out, "	penalty += (0x%02X + x) >> 8;\n", i->operand & 0xFF);
+				break;
+			case absolute_y:
+				fprintf(i->out, "	penalty += (0x%02X + y) >> 8;\n", i->operand & 0xFF);
+				break;
+			case indirect_indexed:
+				fprintf(i->out, "	penalty += (cpu->memory.ram[0x%02X] + y) >> 8;\n", i->operand);
+				break;
+			default:
+				break;
+		}
+	}
+
+	if (reaches_registers(i->read))
+	{
+		emit_cycles(i, "\t");
+	}
+	format_read(buffer, size, i, i->address);
+}
+
+static void emit_load(instruction* i, const char* reg)
+{
+	char argument[MAX_EXPRESSION * 2];
+	prepare_argument(argument, sizeof(argument), i);
+	fprintf(i->out, "\t%s = %s;\n\tp = recompiled_nz(p, %s);\n", reg, argument, reg);
+}
+
+static void emit_store(instruction* i, const char* reg)
+{
+	emit_write(i, "\t", i->address, reg);
+}
+
+// Read-modify-write on the accumulator or the operand. operation updates value, and C where it applies.
+static void emit_modify(instruction* i, const char* operation, const bool read_back)
+{
+	if (i->address_mode == accumulator)
+	{
+		fprintf(i->out, "\t{\n\t\tbyte value = a;\n%s\t\ta = value;\n", operation);
+	}
+	else
+	{
+		char value[MAX_EXPRESSION * 2];
+		if (reaches_registers(i->read))
+		{
+			emit_cycles(i, "\t");
+		}
+		format_read(value, sizeof(value), i, "address");
+		fprintf(i->out, "\t{\n\t\tconst word address = %s;\n\t\tbyte value = %s;\n%s", i->address, value, operation);
+		emit_write(i, "\t\t", "address", "value");
+
+		// The interpreter's LSR takes the flags from a second read of the operand
+		if (read_back && reaches_registers(i->read))
+		{
+			fprintf(i->out, "\t\tvalue = %s;\n", value);
+		}
+	}
+	fputs("\t\tp = recompiled_nz(p, value);\n\t}\n", i->out);
+}
+
+// Taken branches take a cycle more, two when they land in another page
+static bool emit_branch(instruction* i, const char* condition)
+{
+	const word target = i->next_pc + (char)i->operand;
+	const int penalty = ((target ^ i->next_pc) & 0xFF00) ? 2 : 1;
+	fprintf(i->out, "\tif (%s)\n\t{\n\t\tpc = 0x%04X;\n\t\tpenalty += %d;\n\t}\n", condition, target, penalty);
+	fprintf(i->out, "\telse\n\t{\n\t\tpc = 0x%04X;\n\t}\n", i->next_pc);
+	return true;
+}
+
+static bool recompile_lda(instruction* i)
+{
+	emit_load(i, "a");
+	return false;
+}
+
+static bool recompile_ldx(instruction* i)
+{
+	emit_load(i, "x");
+	return false;
+}
+
+static bool recompile_ldy(instruction* i)
+{
+	emit_load(i, "y");
+	return false;
+}
+
+static bool recompile_adc(instruction* i)
+{
+	char argument[MAX_EXPRESSION * 2];
+	prepare_argument(argument, sizeof(argument), i);
+	fprintf(i->out, "\trecompiled_adc(&a, &p, %s);\n", argument);
+	return false;
+}
+
+static bool recompile_sbc(instruction* i)
+{
+	char argument[MAX_EXPRESSION * 2];
+	prepare_argument(argument, sizeof(argument), i);
+	fprintf(i->out, "\trecompiled_adc(&a, &p, (byte)~%s);\n", argument);
+	return false;
+}
+
+static void emit_logical(instruction* i, const char* operator)
+{
+	char argument[MAX_EXPRESSION * 2];
+	prepare_argument(argument, sizeof(argument), i);
+	fprintf(i->out, "\ta %s= %s;\n\tp = recompiled_nz(p, a);\n", operator, argument);
+}
+
+static bool recompile_AND(instruction* i)
+{
+	emit_logical(i, "&");
+	return false;
+}
+
+static bool recompile_ora(instruction* i)
+{
+	emit_logical(i, "|");
+	return false;
+}
+
+static bool recompile_eor(instruction* i)
+{
+	emit_logical(i, "^");
+	return false;
+}
+
+static bool recompile_asl(instruction* i)
+{
+	emit_modify(i, "\t\tp = (p & ~C_FLAG) | (value >> 7);\n\t\tvalue <<= 1;\n", false);
+	return false;
+}
+
+static bool recompile_lsr(instruction* i)
+{
+	emit_modify(i, "\t\tp = (p & ~C_FLAG) | (value & C_FLAG);\n\t\tvalue >>= 1;\n", true);
+	return false;
+}
+
+static bool recompile_rol(instruction* i)
+{
+	emit_modify(i, "\t\tconst byte carry = p & C_FLAG;\n\t\tp = (p & ~C_FLAG) | (value >> 7);\n\t\tvalue = (byte)(value << 1) | carry;\n", false);
+	return false;
+}
+
+static bool recompile_ror(instruction* i)
+{
+	emit_modify(i, "\t\tconst byte carry = p & C_FLAG;\n\t\tp = (p & ~C_FLAG) | (value & C_FLAG);\n\t\tvalue = (value >> 1) | (byte)(carry << 7);\n", false);
+	return false;
+}
+
+static bool recompile_inc(instruction* i)
+{
+	emit_modify(i, "\t\tvalue++;\n", false);
+	return false;
+}
+
+static bool recompile_dec(instruction* i)
+{
+	emit_modify(i, "\t\tvalue--;\n", false);
+	return false;
+}
+
+static bool recompile_bit(instruction* i)
+{
+	char argument[MAX_EXPRESSION * 2];
+	prepare_argument(argument, sizeof(argument), i);
+	fprintf(i->out, "\t{\n\t\tconst byte value = %s;\n", argument);
+	fputs("\t\tp = (p & ~(N_FLAG | V_FLAG | Z_FLAG)) | (value & (N_FLAG | V_FLAG)) | ((a & value) == 0 ? Z_FLAG : 0);\n\t}\n", i->out);
+	return false;
+}
+
+static void emit_compare(instruction* i, const char* reg)
+{
+	char argument[MAX_EXPRESSION * 2];
+	prepare_argument(argument, sizeof(argument), i);
+	fprintf(i->out, "\tp = recompiled_compare(p, %s, %s);\n", reg, argument);
+}
+
+static bool recompile_cmp(instruction* i)
+{
+	emit_compare(i, "a");
+	return false;
+}
+
+static bool recompile_cpx(instruction* i)
+{
+	emit_compare(i, "x");
+	return false;
+}
+
+static bool recompile_cpy(instruction* i)
+{
+	emit_compare(i, "y");
+	return false;
+}
+
+static void emit_step(instruction* i, const char* reg, const char* operator)
+{
+	fprintf(i->out, "\t%s%s;\n\tp = recompiled_nz(p, %s);\n", reg, operator, reg);
+}
+
+static bool recompile_inx(instruction* i)
+{
+	emit_step(i, "x", "++");
+	return false;
+}
+
+static bool recompile_iny(instruction* i)
+{
+	emit_step(i, "y", "++");
+	return false;
+}
+
+static bool recompile_dex(instruction* i)
+{
+	emit_step(i, "x", "--");
+	return false;
+}
+
+static bool recompile_dey(instruction* i)
+{
+	emit_step(i, "y", "--");
+	return false;
+}
+
+static bool recompile_bcc(instruction* i)
+{
+	return emit_branch(i, "!(p & C_FLAG)");
+}
+
+static bool recompile_bcs(instruction* i)
+{
+	return emit_branch(i, "(p & C_FLAG)");
+}
+
+static bool recompile_beq(instruction* i)
+{
+	return emit_branch(i, "(p & Z_FLAG)");
+}
+
+static bool recompile_bne(instruction* i)
+{
+	return emit_branch(i, "!(p & Z_FLAG)");
+}
+
+static bool recompile_bmi(instruction* i)
+{
+	return emit_branch(i, "(p & N_FLAG)");
+}
+
+static bool recompile_bpl(instruction* i)
+{
+	return emit_branch(i, "!(p & N_FLAG)");
+}
+
+static bool recompile_bvc(instruction* i)
+{
+	return emit_branch(i, "!(p & V_FLAG)");
+}
+
+static bool recompile_bvs(instruction* i)
+{
+	return emit_branch(i, "(p & V_FLAG)");
+}
+
+static void emit_flag(instruction* i, const char* flag, const bool set)
+{
+	if (set)
+	{
+		fprintf(i->out, "\tp |= %s;\n", flag);
+	}
+	else
+	{
+		fprintf(i->out, "\tp &= ~%s;\n", flag);
+	}
+}
+
+static bool recompile_clc(instruction* i)
+{
+	emit_flag(i, "C_FLAG", false);
+	return false;
+}
+
+static bool recompile_cld(instruction* i)
+{
+	emit_flag(i, "D_FLAG", false);
+	return false;
+}
+
+static bool recompile_cli(instruction* i)
+{
+	emit_flag(i, "I_FLAG", false);
+	return false;
+}
+
+static bool recompile_clv(instruction* i)
+{
+	emit_flag(i, "V_FLAG", false);
+	return false;
+}
+
+static bool recompile_sec(instruction* i)
+{
+	emit_flag(i, "C_FLAG", true);
+	return false;
+}
+
+static bool recompile_sed(instruction* i)
+{
+	emit_flag(i, "D_FLAG", true);
+	return false;
+}
+
+static bool recompile_sei(instruction* i)
+{
+	emit_flag(i, "I_FLAG", true);
+	return false;
+}
+
+static bool recompile_jmp(instruction* i)
+{
+	if (i->address_mode == absolute)
+	{
+		fprintf(i->out, "\tpc = 0x%04X;\n", i->operand);
+		return true;
+	}
+
+	// Indirect jumps are resolved at run time, targets without a block go back to the interpreter
+	char low[MAX_EXPRESSION * 2];
+	char high[MAX_EXPRESSION * 2];
+	char high_address[MAX_EXPRESSION];
+	const word high_operand = i->operand + 1;
+	instruction high_byte = *i;
+	high_byte.read = classify_read(high_operand, high_operand);
+	snprintf(high_address, sizeof(high_address), "0x%04X", high_byte.read == access_ram ? high_operand & (RAM_SIZE - 1) : high_operand);
+	if (reaches_registers(i->read) || reaches_registers(high_byte.read))
+	{
+		emit_cycles(i, "\t");
+	}
+	format_read(low, sizeof(low), i, i->address);
+	format_read(high, sizeof(high), &high_byte, high_address);
+	fprintf(i->out, "\t{\n\t\tconst byte low = %s;\n\t\tpc = ((word)(%s << 8)) | low;\n\t}\n", low, high);
+	return true;
+}
+
+static bool recompile_jsr(instruction* i)
+{
+	fprintf(i->out, "\trecompiled_push_16(cpu, &sp, 0x%04X);\n\tpc = 0x%04X;\n", (word)(i->next_pc - 1), i->operand);
+	return true;
+}
+
+static bool recompile_rts(instruction* i)
+{
+	fputs("\tpc = recompiled_pop_16(cpu, &sp) + 1;\n", i->out);
+	return true;
+}
+
+static bool recompile_rti(instruction* i)
+{
+	fputs("\tp = recompiled_pop_8(cpu, &sp);\n\tpc = recompiled_pop_16(cpu, &sp);\n", i->out);
+	return true;
+}
+
+static bool recompile_brk(instruction* i)
+{
+	fprintf(i->out, "\trecompiled_push_16(cpu, &sp, 0x%04X);\n", (word)(i->next_pc + 1));
+	fputs("\tp |= B_FLAG | I_FLAG;\n\trecompiled_push_8(cpu, &sp, p);\n\tpc = cpu->irq_prt;\n", i->out);
+	return true;
+}
+
+static bool recompile_nop(instruction* i)
+{
+	return false;
+}
+
+static bool recompile_sta(instruction* i)
+{
+	emit_store(i, "a");
+	return false;
+}
+
+static bool recompile_stx(instruction* i)
+{
+	emit_store(i, "x");
+	return false;
+}
+
+static bool recompile_sty(instruction* i)
+{
+	emit_store(i, "y");
+	return false;
+}
+
+static bool recompile_pha(instruction* i)
+{
+	fputs("\trecompiled_push_8(cpu, &sp, a);\n", i->out);
+	return false;
+}
+
+static bool recompile_php(instruction* i)
+{
+	fputs("\trecompiled_push_8(cpu, &sp, p | UNUSED_FLAG | B_FLAG);\n", i->out);
+	return false;
+}
+
+static bool recompile_pla(instruction* i)
+{
+	fputs("\ta = recompiled_pop_8(cpu, &sp);\n\tp = recompiled_nz(p, a);\n", i->out);
+	return false;
+}
+
+static bool recompile_plp(instruction* i)
+{
+	fputs("\tp = recompiled_pop_8(cpu, &sp);\n", i->out);
+	return false;
+}
+
+static void emit_transfer(instruction* i, const char* to, const char* from)
+{
+	fprintf(i->out, "\t%s = %s;\n\tp = recompiled_nz(p, %s);\n", to, from, to);
+}
+
+static bool recompile_tax(instruction* i)
+{
+	emit_transfer(i, "x", "a");
+	return false;
+}
+
+static bool recompile_tay(instruction* i)
+{
+	emit_transfer(i, "y", "a");
+	return false;
+}
+
+static bool recompile_tsx(instruction* i)
+{
+	emit_transfer(i, "x", "sp");
+	return false;
+}
+
+static bool recompile_txa(instruction* i)
+{
+	emit_transfer(i, "a", "x");
+	return false;
+}
+
+static bool recompile_tya(instruction* i)
+{
+	emit_transfer(i, "a", "y");
+	return false;
+}
+
+static bool recompile_txs(instruction* i)
+{
+	fputs("\tsp = x;\n", i->out);
+	return false;
+}
+
+// Unofficial opcodes are left to the interpreter
+#define OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle) [0x##opcode] = { #mnemonic, recompile_##operation, address_mode, cycles, page_cycle },
+#define UNOFFICIAL_OP(opcode, mnemonic, operation, address_mode, cycles, page_cycle)
+static const recompiled_opcode recompiled_opcodes[256] =
+{
+#include "opcodes.h"
+};
+#undef UNOFFICIAL_OP
+#undef OP
+
+static flow_kind instruction_flow(const byte opcode)
+{
+	switch (opcode)
+	{
+		// JMP absolute, JMP indirect and JSR
+		case 0x4C:
+			return flow_jump;
+		case 0x6C:
+			return flow_indirect_jump;
+		case 0x20:
+			return flow_call;
+		// BRK, RTI and RTS
+		case 0x00:
+		case 0x40:
+		case 0x60:
+			return flow_return;
+		default:
+			return recompiled_opcodes[opcode].address_mode == relative ? flow_branch : flow_next;
+	}
+}
+
+// Length of the supported instruction at address, 0 when it is unsupported or runs past the end of memory
+static byte decoded_length(const cpu* cpu, const word address)
+{
+	const recompiled_opcode* opcode = &recompiled_opcodes[cpu_read_memory(cpu, address)];
+	if (opcode->recompile == NULL)
+	{
+		return 0;
+	}
+
+	const byte length = cpu_instruction_length(opcode->address_mode);
+	return address + length <= MAX_MEMORY ? length : 0;
+}
+
+static word decoded_operand(const cpu* cpu, const word address, const byte length)
+{
+	switch (length)
+	{
+		case 2:
+			return cpu_read_memory(cpu, address + 1);
+		case 3:
+			return ((word)(cpu_read_memory(cpu, address + 2) << 8)) | cpu_read_memory(cpu, address + 1);
+		default:
+			return 0;
+	}
+}
+
+typedef struct
+{
+	// A block starts at every address reached by a vector, jump, branch, call or return
+	bool leaders[PRG_ROM_SIZE];
+	// Addresses already walked
+	bool visited[PRG_ROM_SIZE];
+	word pending[PRG_ROM_SIZE];
+	int pending_count;
+} control_flow;
+
+static void add_leader(control_flow* flow, const word address)
+{
+	if (address < PRG_ROM_START || flow->leaders[address - PRG_ROM_START])
+	{
+		return;
+	}
+
+	flow->leaders[address - PRG_ROM_START] = true;
+	flow->pending[flow->pending_count++] = address;
+}
+
+// Follows straight-line code from address, adding every target it finds as a leader
+static void walk(const cpu* cpu, control_flow* flow, word address)
+{
+	while (address >= PRG_ROM_START && !flow->visited[address - PRG_ROM_START])
+	{
+		flow->visited[address - PRG_ROM_START] = true;
+
+		const byte length = decoded_length(cpu, address);
+		if (length == 0)
+		{
+			return;
+		}
+
+		const byte opcode = cpu_read_memory(cpu, address);
+		const word operand = decoded_operand(cpu, address, length);
+		const word next = (word)(address + length);
+
+		switch (instruction_flow(opcode))
+		{
+			case flow_next:
+				address = next;
+				break;
+			case flow_branch:
+				add_leader(flow, (word)(next + (char)operand));
+				add_leader(flow, next);
+				return;
+			case flow_jump:
+				add_leader(flow, operand);
+				return;
+			case flow_call:
+				add_leader(flow, operand);
+				// RTS comes back right after the JSR
+				add_leader(flow, next);
+				return;
+			case flow_indirect_jump:
+			case flow_return:
+				return;
+		}
+	}
+
+	// Fell into code that was already walked: it needs a block of its own
+	if (address >= PRG_ROM_START)
+	{
+		add_leader(flow, address);
+	}
+}
+
+static void find_leaders(const cpu* cpu, control_flow* flow)
+{
+	add_leader(flow, cpu->pc);
+	add_leader(flow, cpu->nmi_prt);
+	add_leader(flow, cpu->irq_prt);
+
+	while (flow->pending_count > 0)
+	{
+		walk(cpu, flow, flow->pending[--flow->pending_count]);
+	}
+}
+
+// Adds the cycles not in cpu->cycles yet, writes the registers back and returns the instructions run
+static void emit_block_exit(FILE* out, const char* indent, const int cycles, const int executed)
+{
+	fprintf(out, "%scpu->cycles += %d + penalty;\n", indent, cycles);
+	fprintf(out, "%scpu->a = a;\n%scpu->x = x;\n%scpu->y = y;\n%scpu->sp = sp;\n%scpu->p = p;\n%scpu->pc = pc;\n",
+		indent, indent, indent, indent, indent, indent);
+	fprintf(out, "%sreturn %d;\n", indent, executed);
+}
+
+// A register access can raise an NMI, CLI and PLP can let an IRQ through
+static bool may_raise_interrupt(const recompiled_opcode* definition, const instruction* i)
+{
+	return reaches_registers(i->read) || reaches_registers(i->write) ||
+		definition->recompile == recompile_cli || definition->recompile == recompile_plp;
+}
+
+// Writes the block starting at start, which must hold a supported instruction. Returns the number of instructions in it.
+static int recompile_block(const cpu* cpu, control_flow* flow, const word start, FILE* out)
+{
+	int address = start;
+	int count = 0;
+	// Base cycles not added to cpu->cycles yet
+	int cycles = 0;
+	bool ended = false;
+	// The last instruction can raise an interrupt or let one through
+	bool check_interrupts = false;
+
+	fprintf(out, "static int block_%04X(cpu* cpu)\n{\n", start);
+	fputs("\tbyte a = cpu->a, x = cpu->x, y = cpu->y, sp = cpu->sp, p = cpu->p;\n\tword pc;\n", out);
+	// Cycles on top of the base cycles of the block
+	fputs("\tunsigned int penalty = 0;\n\n", out);
+
+	while (!ended && count < MAX_BLOCK_INSTRUCTIONS)
+	{
+		const byte length = decoded_length(cpu, (word)address);
+		if (length == 0)
+		{
+			break;
+		}
+
+		// The block stops before the next instruction for recompiled_exec to see the interrupt, as the interpreter would
+		if (check_interrupts)
+		{
+			fprintf(out, "\tif (cpu->interrupts != 0)\n\t{\n\t\tpc = 0x%04X;\n", (word)address);
+			emit_block_exit(out, "\t\t", cycles, count);
+			fputs("\t}\n", out);
+		}
+
+		const recompiled_opcode* definition = &recompiled_opcodes[cpu_read_memory(cpu, (word)address)];
+		instruction i =
+		{
+			.out = out,
+			.address_mode = definition->address_mode,
+			.operand = decoded_operand(cpu, (word)address, length),
+			.next_pc = (word)(address + length),
+			.cycles = cycles + definition->cycles,
+			.page_cycle = definition->page_cycle
+		};
+		describe_operand(&i);
+
+		fprintf(out, "\t// %04X: %s\n", address, definition->mnemonic);
+		ended = definition->recompile(&i);
+		cycles = i.cycles;
+		count++;
+		address += length;
+		check_interrupts = !ended && may_raise_interrupt(definition, &i);
+
+		if (address >= MAX_MEMORY || flow->leaders[address - PRG_ROM_START])
+		{
+			break;
+		}
+	}
+
+	if (!ended)
+	{
+		// The rest of a block cut at MAX_BLOCK_INSTRUCTIONS is written later since it starts at a higher address
+		if (address < MAX_MEMORY)
+		{
+			flow->leaders[address - PRG_ROM_START] = true;
+		}
+		fprintf(out, "\tpc = 0x%04X;\n", (word)address);
+	}
+
+	fputs("\n", out);
+	emit_block_exit(out, "\t", cycles, count);
+	fputs("}\n\n", out);
+	return count;
+}
+
+// FNV-1a over $8000-$FFFF
+uint32_t recompiler_checksum(const cpu* cpu)
+{
+	uint32_t hash = 2166136261u;
+	for (int address = PRG_ROM_START; address < MAX_MEMORY; address++)
+	{
+		hash = (hash ^ cpu_read_memory(cpu, (word)address)) * 16777619u;
+	}
+	return hash;
+}
+
+int recompile_prg_rom(const cpu* cpu, FILE* out, const char* rom_name)
+{
+	control_flow* flow = calloc(1, sizeof(control_flow));
+	byte* lengths = calloc(PRG_ROM_SIZE, sizeof(byte));
+	if (flow == NULL || lengths == NULL)
+	{
+		free(flow);
+		free(lengths);
+		return -1;
+	}
+
+	find_leaders(cpu, flow);
+
+	fprintf(out, "// Generated by nes_emulator --recompile from %s. Do not edit.\n", rom_name);
+	fputs("// Add this file to the build and define RECOMPILED in config.h to run it.\n\n", out);
+	fputs("#include \"config.h\"\n\n#ifdef RECOMPILED\n\n#include \"recompiler.h\"\n\n", out);
+
+	int blocks = 0;
+	for (int offset = 0; offset < PRG_ROM_SIZE; offset++)
+	{
+		const word address = (word)(PRG_ROM_START + offset);
+		// Idle loops are left to the interpreter, which skips them
+		if (flow->leaders[offset] && decoded_length(cpu, address) != 0 && cpu_idle_loop_length(cpu, address) == 0)
+		{
+			lengths[offset] = (byte)recompile_block(cpu, flow, address, out);
+			blocks++;
+		}
+	}
+
+	fputs("const recompiled_function recompiled_blocks[MAX_MEMORY - PRG_ROM_START] =\n{\n", out);
+	for (int offset = 0; offset < PRG_ROM_SIZE; offset++)
+	{
+		if (lengths[offset] != 0)
+		{
+			fprintf(out, "\t[0x%04X] = block_%04X,\n", offset, PRG_ROM_START + offset);
+		}
+	}
+
+	fputs("};\n\nconst byte recompiled_block_lengths[MAX_MEMORY - PRG_ROM_START] =\n{\n", out);
+	for (int offset = 0; offset < PRG_ROM_SIZE; offset++)
+	{
+		if (lengths[offset] != 0)
+		{
+			fprintf(out, "\t[0x%04X] = %d,\n", offset, lengths[offset]);
+		}
+	}
+
+	fprintf(out, "};\n\nconst uint32_t recompiled_prg_checksum = 0x%08X;\n\n#endif\n", recompiler_checksum(cpu));
+
+	free(flow);
+	free(lengths);
+	return ferror(out) ? -1 : blocks;
+}
+
+#ifdef RECOMPILED
+bool recompiled_attach(cpu* cpu)
+{
+	cpu->recompiled = recompiler_checksum(cpu) == recompiled_prg_checksum;
+	return cpu->recompiled;
+}
+
+int recompiled_exec(cpu* cpu, const int count)
+{
+	int executed = 0;
+
+	while (cpu->pc >= PRG_ROM_START)
+	{
+		if (cpu->interrupts != 0 && cpu_interrupt_due(cpu))
+		{
+			break;
+		}
+
+		const word offset = cpu->pc - PRG_ROM_START;
+		const recompiled_function block = recompiled_blocks[offset];
+		if (block == NULL || executed + recompiled_block_lengths[offset] > count)
+		{
+			break;
+		}
+
+		executed += block(cpu);
+	}
+
+	return executed;
+}
+#endif
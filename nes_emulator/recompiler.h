@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu.h"
+
+// Walks PRG-ROM from the reset, NMI and IRQ vectors and writes a C file with one function per basic block.
+// Build the emulator with that file and RECOMPILED defined to run the blocks natively.
+// Returns the number of blocks written, -1 when the file could not be written.
+int recompile_prg_rom(const cpu* cpu, FILE* out, const char* rom_name);
+
+// Identifies the PRG-ROM a recompiled file was generated from
+uint32_t recompiler_checksum(const cpu* cpu);
+
+// $2000-$40FF holds the PPU, APU and controller registers
+#define RECOMPILED_IO_START	0x2000
+#define RECOMPILED_IO_END	0x4100
+
+#ifdef RECOMPILED
+// Returns the instructions run, fewer than the block has when one of them raised an interrupt or let one through
+typedef int (*recompiled_function)(cpu* cpu);
+
+// Written by recompile_prg_rom, indexed by address - PRG_ROM_START. NULL where no block starts.
+extern const recompiled_function recompiled_blocks[MAX_MEMORY - PRG_ROM_START];
+extern const byte recompiled_block_lengths[MAX_MEMORY - PRG_ROM_START];
+extern const uint32_t recompiled_prg_checksum;
+
+// Enables the recompiled blocks if the PRG-ROM in memory is the one they were generated from
+bool recompiled_attach(cpu* cpu);
+
+// Runs recompiled blocks from pc while they fit in count instructions and no interrupt is due.
+// Returns the number of instructions executed, 0 when the interpreter has to run the next instruction.
+int recompiled_exec(cpu* cpu, int count);
+
+// Helpers for the generated code. Registers live in locals of the block function.
+
+// PRG-ROM at $8000-$FFFF, where 16KB are mirrored at $C000
+static FORCE_INLINE byte recompiled_rom(const cpu* cpu, const word address)
+{
+	return cpu->memory.prg_rom[(address - PRG_ROM_START) & (cpu->memory.prg_rom_size - 1)];
+}
+
+static FORCE_INLINE byte recompiled_read(cpu* cpu, const word address)
+{
+	const byte* page = cpu->pages[address >> PAGE_SHIFT].read;
+	if (page == NULL)
+	{
+		return cpu_read_bus(cpu, address);
+	}
+	return page[address & (PAGE_SIZE - 1)];
+}
+
+static FORCE_INLINE void recompiled_write(cpu* cpu, const word address, const byte value)
+{
+	if (address < RAM_END)
+	{
+		cpu->memory.ram[address & (RAM_SIZE - 1)] = value;
+	}
+	else
+	{
+		cpu_write_bus(cpu, address, value);
+	}
+}
+
+// Little-endian pointer in the zero page, wrapping at $FF
+static FORCE_INLINE word recompiled_pointer(const cpu* cpu, const byte address)
+{
+	return ((word)(cpu->memory.ram[(byte)(address + 1)] << 8)) | cpu->memory.ram[address];
+}
+
+static FORCE_INLINE byte recompiled_nz(const byte p, const byte value)
+{
+	return (p & ~(N_FLAG | Z_FLAG)) | (value & N_FLAG) | (value == 0 ? Z_FLAG : 0);
+}
+
+static FORCE_INLINE void recompiled_adc(byte* a, byte* p, const byte value)
+{
+	const word result = *a + value + (*p & C_FLAG);
+	const byte overflow = ~(*a ^ value) & (*a ^ result) & SIGN_BIT;
+	*a = (byte)result;
+	*p = recompiled_nz((*p & ~(C_FLAG | V_FLAG)) | (result > 0xFF ? C_FLAG : 0) | (overflow ? V_FLAG : 0), *a);
+}
+
+static FORCE_INLINE byte recompiled_compare(const byte p, const byte reg, const byte value)
+{
+	return recompiled_nz((p & ~C_FLAG) | (reg >= value ? C_FLAG : 0), (byte)(reg - value));
+}
+
+// Same stack accesses as cpu_stack_push_* and cpu_stack_pop_*
+static FORCE_INLINE void recompiled_push_8(cpu* cpu, byte* sp, const byte value)
+{
+	cpu->memory.ram[STACK_BASE + *sp] = value;
+	(*sp)--;
+}
+
+static FORCE_INLINE void recompiled_push_16(cpu* cpu, byte* sp, const word value)
+{
+	cpu->memory.ram[STACK_BASE + *sp] = (value >> 8) & 0xFF;
+	cpu->memory.ram[(word)(STACK_BASE + (*sp - 1))] = value & 0xFF;
+	*sp -= 2;
+}
+
+static FORCE_INLINE byte recompiled_pop_8(const cpu* cpu, byte* sp)
+{
+	(*sp)++;
+	return cpu->memory.ram[STACK_BASE + *sp];
+}
+
+static FORCE_INLINE word recompiled_pop_16(const cpu* cpu, byte* sp)
+{
+	const word result = (word)(cpu->memory.ram[STACK_BASE + (*sp + 2)] << 8) | cpu->memory.ram[STACK_BASE + (*sp + 1)];
+	*sp += 2;
+	return result;
+}
+#endif
@@ -0,0 +1,247 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "tile_decode.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define X64_KERNELS
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET(isa)
+#define BYTE_SWAP_64(value) _byteswap_uint64(value)
+#else
+#include <cpuid.h>
+// GCC and Clang only emit AVX2 and BMI2 instructions in functions that ask for them
+#define TARGET(isa) __attribute__((target(isa)))
+#define BYTE_SWAP_64(value) __builtin_bswap64(value)
+#endif
+#endif
+
+#define ROW_PIXELS 8
+
+// The loop drawing did before the kernels: one bit of each plane per pixel, from bit 7 on the left
+static void decode_bits(const byte* planes_0, const byte* planes_1, const int count, byte* pixels)
+{
+	for (int i = 0; i < count; i++)
+	{
+		for (int x = 0; x < ROW_PIXELS; x++)
+		{
+			pixels[i * ROW_PIXELS + x] = (byte)(((planes_0[i] >> (7 - x)) & 0x1) | (((planes_1[i] >> (7 - x)) & 0x1) << 1));
+		}
+	}
+}
+
+static bool always_supported(void)
+{
+	return true;
+}
+
+#ifdef X64_KERNELS
+static void cpuid(const unsigned int leaf, unsigned int info[4])
+{
+#ifdef _MSC_VER
+	__cpuidex((int*)info, (int)leaf, 0);
+#else
+	__cpuid_count(leaf, 0, info[0], info[1], info[2], info[3]);
+#endif
+}
+
+// Leaf 7 of CPUID has the AVX2 and BMI2 bits
+static bool has_leaf_7(void)
+{
+	unsigned int info[4];
+	cpuid(0, info);
+	return info[0] >= 7;
+}
+
+static bool has_bmi2(void)
+{
+	unsigned int info[4];
+	if (!has_leaf_7())
+	{
+		return false;
+	}
+	cpuid(7, info);
+	return (info[1] >> 8) & 0x1;
+}
+
+// AVX2 also needs the OS to save the YMM registers, which XGETBV tells
+static bool has_avx2(void)
+{
+	unsigned int info[4];
+	if (!has_leaf_7())
+	{
+		return false;
+	}
+
+	cpuid(1, info);
+	const unsigned int osxsave_avx = (1u << 27) | (1u << 28);
+	if ((info[2] & osxsave_avx) != osxsave_avx)
+	{
+		return false;
+	}
+
+#ifdef _MSC_VER
+	const uint64_t xcr0 = _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	const uint64_t xcr0 = ((uint64_t)edx << 32) | eax;
+#endif
+	if ((xcr0 & 0x6) != 0x6)
+	{
+		return false;
+	}
+
+	cpuid(7, info);
+	return (info[1] >> 5) & 0x1;
+}
+
+// PDEP spreads the 8 bits of a plane over the 8 bytes of the row, the byte swap puts bit 7 on the left.
+// PDEP is microcoded and slow on AMD CPUs before Zen 3, so tile_decode never picks this one.
+TARGET("bmi2") static void decode_bmi2(const byte* planes_0, const byte* planes_1, const int count, byte* pixels)
+{
+	for (int i = 0; i < count; i++)
+	{
+		const uint64_t row = _pdep_u64(planes_0[i], 0x0101010101010101ull) | _pdep_u64(planes_1[i], 0x0202020202020202ull);
+		const uint64_t left_to_right = BYTE_SWAP_64(row);
+		memcpy(&pixels[i * ROW_PIXELS], &left_to_right, ROW_PIXELS);
+	}
+}
+
+// Color of pixel x in each row of a vector of plane bytes
+TARGET("sse2") static __m128i get_column_sse2(const __m128i plane_0, const __m128i plane_1, const int x)
+{
+	const __m128i bit = _mm_set1_epi8((char)(0x80 >> x));
+	const __m128i low = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(plane_0, bit), bit), _mm_set1_epi8(1));
+	const __m128i high = _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(plane_1, bit), bit), _mm_set1_epi8(2));
+	return _mm_or_si128(low, high);
+}
+
+// 16 rows at a time: the 8 columns of pixels are found for all of them, then transposed into rows with the unpacks,
+// pairs of bytes, then of words, then of double words.
+TARGET("sse2") static void decode_sse2(const byte* planes_0, const byte* planes_1, const int count, byte* pixels)
+{
+	int row = 0;
+	for (; row + 16 <= count; row += 16)
+	{
+		const __m128i plane_0 = _mm_loadu_si128((const __m128i*)&planes_0[row]);
+		const __m128i plane_1 = _mm_loadu_si128((const __m128i*)&planes_1[row]);
+
+		__m128i pairs[8];
+		for (int x = 0; x < ROW_PIXELS; x += 2)
+		{
+			const __m128i left = get_column_sse2(plane_0, plane_1, x);
+			const __m128i right = get_column_sse2(plane_0, plane_1, x + 1);
+			pairs[x] = _mm_unpacklo_epi8(left, right);
+			pairs[x + 1] = _mm_unpackhi_epi8(left, right);
+		}
+
+		// Rows 0-7 come from the low halves, rows 8-15 from the high ones
+		for (int half = 0; half < 2; half++)
+		{
+			const __m128i columns_0_3_low = _mm_unpacklo_epi16(pairs[half], pairs[2 + half]);
+			const __m128i columns_0_3_high = _mm_unpackhi_epi16(pairs[half], pairs[2 + half]);
+			const __m128i columns_4_7_low = _mm_unpacklo_epi16(pairs[4 + half], pairs[6 + half]);
+			const __m128i columns_4_7_high = _mm_unpackhi_epi16(pairs[4 + half], pairs[6 + half]);
+
+			__m128i* out = (__m128i*)&pixels[(row + half * 8) * ROW_PIXELS];
+			_mm_storeu_si128(&out[0], _mm_unpacklo_epi32(columns_0_3_low, columns_4_7_low));
+			_mm_storeu_si128(&out[1], _mm_unpackhi_epi32(columns_0_3_low, columns_4_7_low));
+			_mm_storeu_si128(&out[2], _mm_unpacklo_epi32(columns_0_3_high, columns_4_7_high));
+			_mm_storeu_si128(&out[3], _mm_unpackhi_epi32(columns_0_3_high, columns_4_7_high));
+		}
+	}
+
+	decode_bits(&planes_0[row], &planes_1[row], count - row, &pixels[row * ROW_PIXELS]);
+}
+
+TARGET("avx2") static __m256i get_column_avx2(const __m256i plane_0, const __m256i plane_1, const int x)
+{
+	const __m256i bit = _mm256_set1_epi8((char)(0x80 >> x));
+	const __m256i low = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(plane_0, bit), bit), _mm256_set1_epi8(1));
+	const __m256i high = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_and_si256(plane_1, bit), bit), _mm256_set1_epi8(2));
+	return _mm256_or_si256(low, high);
+}
+
+// The SSE2 transpose on 32 rows. The unpacks stay within 128-bit lanes, so the low lane holds rows 0-15
+// and the high one rows 16-31.
+TARGET("avx2") static void decode_avx2(const byte* planes_0, const byte* planes_1, const int count, byte* pixels)
+{
+	int row = 0;
+	for (; row + 32 <= count; row += 32)
+	{
+		const __m256i plane_0 = _mm256_loadu_si256((const __m256i*)&planes_0[row]);
+		const __m256i plane_1 = _mm256_loadu_si256((const __m256i*)&planes_1[row]);
+
+		__m256i pairs[8];
+		for (int x = 0; x < ROW_PIXELS; x += 2)
+		{
+			const __m256i left = get_column_avx2(plane_0, plane_1, x);
+			const __m256i right = get_column_avx2(plane_0, plane_1, x + 1);
+			pairs[x] = _mm256_unpacklo_epi8(left, right);
+			pairs[x + 1] = _mm256_unpackhi_epi8(left, right);
+		}
+
+		for (int half = 0; half < 2; half++)
+		{
+			const __m256i columns_0_3_low = _mm256_unpacklo_epi16(pairs[half], pairs[2 + half]);
+			const __m256i columns_0_3_high = _mm256_unpackhi_epi16(pairs[half], pairs[2 + half]);
+			const __m256i columns_4_7_low = _mm256_unpacklo_epi16(pairs[4 + half], pairs[6 + half]);
+			const __m256i columns_4_7_high = _mm256_unpackhi_epi16(pairs[4 + half], pairs[6 + half]);
+
+			const __m256i rows[4] =
+			{
+				_mm256_unpacklo_epi32(columns_0_3_low, columns_4_7_low),
+				_mm256_unpackhi_epi32(columns_0_3_low, columns_4_7_low),
+				_mm256_unpacklo_epi32(columns_0_3_high, columns_4_7_high),
+				_mm256_unpackhi_epi32(columns_0_3_high, columns_4_7_high)
+			};
+
+			__m128i* low_lane = (__m128i*)&pixels[(row + half * 8) * ROW_PIXELS];
+			__m128i* high_lane = (__m128i*)&pixels[(row + 16 + half * 8) * ROW_PIXELS];
+			for (int i = 0; i < 4; i++)
+			{
+				_mm_storeu_si128(&low_lane[i], _mm256_castsi256_si128(rows[i]));
+				_mm_storeu_si128(&high_lane[i], _mm256_extracti128_si256(rows[i], 1));
+			}
+		}
+	}
+
+	decode_sse2(&planes_0[row], &planes_1[row], count - row, &pixels[row * ROW_PIXELS]);
+}
+#endif
+
+const tile_decode_kernel tile_decode_kernels[] =
+{
+	{ "bit by bit", decode_bits, always_supported },
+#ifdef X64_KERNELS
+	{ "BMI2 PDEP", decode_bmi2, has_bmi2 },
+	{ "SSE2", decode_sse2, always_supported },
+	{ "AVX2", decode_avx2, has_avx2 },
+#endif
+};
+
+const int tile_decode_kernel_count = sizeof(tile_decode_kernels) / sizeof(tile_decode_kernels[0]);
+
+static tile_decoder select_kernel(void)
+{
+#ifdef X64_KERNELS
+	// SSE2 is part of x86-64
+	return has_avx2() ? decode_avx2 : decode_sse2;
+#else
+	return decode_bits;
+#endif
+}
+
+void tile_decode(const byte* planes_0, const byte* planes_1, const int count, byte* pixels)
+{
+	static tile_decoder decoder = NULL;
+	if (decoder == NULL)
+	{
+		decoder = select_kernel();
+	}
+	decoder(planes_0, planes_1, count, pixels);
+}
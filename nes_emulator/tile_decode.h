@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "config.h"
+
+// Decodes count rows of pattern table tiles. Row i is planes_0[i] and planes_1[i], its 8 pixels go to pixels[i * 8]
+// left to right as their color within the palette, 0 to 3.
+typedef void (*tile_decoder)(const byte* planes_0, const byte* planes_1, int count, byte* pixels);
+
+typedef struct
+{
+	const char* name;
+	tile_decoder decode;
+	// Whether the CPU running the emulator has the instructions the kernel needs
+	bool (*supported)(void);
+} tile_decode_kernel;
+
+// Every kernel, the bit by bit loop first. The others are x86-64 only.
+extern const tile_decode_kernel tile_decode_kernels[];
+extern const int tile_decode_kernel_count;
+
+// Decodes with the fastest kernel the CPU supports, picked with CPUID on the first call
+void tile_decode(const byte* planes_0, const byte* planes_1, int count, byte* pixels);
@@ -22,17 +22,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x69;
+			image[0x8000] = 0x69;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x11;
+			image[0x8001] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			nes.cpu.a = 0x22;
@@ -51,17 +53,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x69;
+			image[0x8000] = 0x69;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0xFF;
+			image[0x8001] = 0xFF;
 
 			cpu_init(&nes.cpu, 0x8000);
 			nes.cpu.a = 0x22;
@@ -80,17 +84,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x69;
+			image[0x8000] = 0x69;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0b01111111;
+			image[0x8001] = 0b01111111;
 
 			cpu_init(&nes.cpu, 0x8000);
 			nes.cpu.a = 0b00000001;
@@ -109,17 +115,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x69;
+			image[0x8000] = 0x69;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = -127;
+			image[0x8001] = -127;
 
 			cpu_init(&nes.cpu, 0x8000);
 			nes.cpu.a = -127;
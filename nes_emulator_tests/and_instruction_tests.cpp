@@ -20,17 +20,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x29;
+			image[0x8000] = 0x29;
 
 			// immediate
-			nes.cpu.memory.data[0x8001] = 0xF0;
+			image[0x8001] = 0xF0;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -53,21 +55,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x25;
+			image[0x8000] = 0x25;
 
 			// zero page address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 
 			cpu_init(&nes.cpu, 0x8000);
 
-			nes.cpu.memory.data[0x0001] = 0xF0;
+			nes.cpu.memory.ram[0x0001] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x25);
@@ -87,22 +91,24 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x35;
+			image[0x8000] = 0x35;
 
 			// zero page address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0002] = 0xF0;
+			nes.cpu.memory.ram[0x0002] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x35);
@@ -122,22 +128,24 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x35;
+			image[0x8000] = 0x35;
 
 			// absolute address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x01;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
-			nes.cpu.memory.data[0x0001] = 0xF0;
+			nes.cpu.memory.ram[0x0001] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x35);
@@ -157,23 +165,25 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x3D;
+			image[0x8000] = 0x3D;
 
 			// absolute address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x01;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0002] = 0xF0;
+			nes.cpu.memory.ram[0x0002] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x3D);
@@ -193,23 +203,25 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x39;
+			image[0x8000] = 0x39;
 
 			// absolute address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x01;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.y = 0x01;
-			nes.cpu.memory.data[0x0002] = 0xF0;
+			nes.cpu.memory.ram[0x0002] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x39);
@@ -229,26 +241,28 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x21;
+			image[0x8000] = 0x21;
 
 			// absolute address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0001] = 0x01;
-			nes.cpu.memory.data[0x0002] = 0x04;
-			nes.cpu.memory.data[0x0003] = 0x00;
+			nes.cpu.memory.ram[0x0001] = 0x01;
+			nes.cpu.memory.ram[0x0002] = 0x04;
+			nes.cpu.memory.ram[0x0003] = 0x00;
 
-			nes.cpu.memory.data[0x0004] = 0xF0;
+			nes.cpu.memory.ram[0x0004] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x21);
@@ -268,25 +282,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x31;
+			image[0x8000] = 0x31;
 
 			// absolute address 0x0001
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.y = 0x01;
-			nes.cpu.memory.data[0x0001] = 0x03;
-			nes.cpu.memory.data[0x0002] = 0x00;
+			nes.cpu.memory.ram[0x0001] = 0x03;
+			nes.cpu.memory.ram[0x0002] = 0x00;
 
-			nes.cpu.memory.data[0x0004] = 0xF0;
+			nes.cpu.memory.ram[0x0004] = 0xF0;
 			nes.cpu.a = 0b10001111;
 
 			cpu_exec(&nes.cpu, 0x31);
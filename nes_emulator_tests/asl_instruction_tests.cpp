@@ -20,14 +20,16 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x0A;
+			image[0x8000] = 0x0A;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -2,9 +2,14 @@
 
 #include "CppUnitTest.h"
 
+#include <cstring>
+#include <string>
+
 extern "C" {
 #include "../nes_emulator/cpu.h"
+#include "../nes_emulator/jit.h"
 #include "../nes_emulator/nes.h"
+#include "../nes_emulator/recompiler.h"
 }
 
 #pragma warning( push )
@@ -22,11 +27,13 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -42,12 +49,1238 @@ namespace nes_emulator_tests
 			cpu cpu;
 			cpu_clear_memory(&cpu);
 
-			for (auto i : cpu.memory.data)
+			for (auto value : cpu.memory.ram)
+			{
+				Assert::IsTrue(value == 0x00);
+			}
+			Assert::IsTrue(cpu.memory.prg_rom == NULL);
+			Assert::IsTrue(cpu.memory.image == NULL);
+		}
+
+		TEST_METHOD(cpu_decode_prg_rom_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDA #$11
+			image[0x8000] = 0xA9;
+			image[0x8001] = 0x11;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_decode_prg_rom(&nes.cpu);
+			cpu_exec_batch(&nes.cpu, 1);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8002);
+			Assert::IsTrue(nes.cpu.a == 0x11);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_decode_cache_invalidation_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDA #$22
+			image[0x8000] = 0xA9;
+			image[0x8001] = 0x22;
+
+			// STA $8006
+			image[0x8002] = 0x8D;
+			image[0x8003] = 0x06;
+			image[0x8004] = 0x80;
+
+			// LDA #$11, patched to LDA #$22 by the store above
+			image[0x8005] = 0xA9;
+			image[0x8006] = 0x11;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_decode_prg_rom(&nes.cpu);
+			cpu_exec_batch(&nes.cpu, 3);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8007);
+			Assert::IsTrue(nes.cpu.a == 0x22);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_fused_dex_bne_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDX #$03
+			image[0x8000] = 0xA2;
+			image[0x8001] = 0x03;
+
+			// DEX
+			image[0x8002] = 0xCA;
+
+			// BNE $8002
+			image[0x8003] = 0xD0;
+			image[0x8004] = 0xFD;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_decode_prg_rom(&nes.cpu);
+			cpu_exec_batch(&nes.cpu, 7);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8005);
+			Assert::IsTrue(nes.cpu.x == 0x00);
+			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
+			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
+#ifdef DECODE_CACHE
+			Assert::IsTrue(nes.cpu.fusion_hits[fusion_dex_bne] == 3);
+#endif
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_fused_pair_split_at_batch_end_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDX #$03
+			image[0x8000] = 0xA2;
+			image[0x8001] = 0x03;
+
+			// DEX
+			image[0x8002] = 0xCA;
+
+			// BNE $8002
+			image[0x8003] = 0xD0;
+			image[0x8004] = 0xFD;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_decode_prg_rom(&nes.cpu);
+			cpu_exec_batch(&nes.cpu, 2);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8003);
+			Assert::IsTrue(nes.cpu.x == 0x02);
+			Assert::IsTrue(nes.cpu.fusion_hits[fusion_dex_bne] == 0);
+
+			cpu_free(&nes.cpu);
+		}
+
+		static void load_clc_adc_sta(nes* nes, byte* image)
+		{
+			cpu_clear_memory(&nes->cpu);
+			cpu_load_image(&nes->cpu, image);
+			nes->cpu.controller = &nes->controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDA #$10
+			image[0x8000] = 0xA9;
+			image[0x8001] = 0x10;
+
+			// SEC
+			image[0x8002] = 0x38;
+
+			// CLC
+			image[0x8003] = 0x18;
+
+			// ADC #$25
+			image[0x8004] = 0x69;
+			image[0x8005] = 0x25;
+
+			// STA $0200
+			image[0x8006] = 0x8D;
+			image[0x8007] = 0x00;
+			image[0x8008] = 0x02;
+
+			cpu_init(&nes->cpu, 0x8000);
+			cpu_decode_prg_rom(&nes->cpu);
+		}
+
+		TEST_METHOD(cpu_fused_clc_adc_sta_test)
+		{
+			nes nes;
+			byte image[MAX_MEMORY] = {};
+			load_clc_adc_sta(&nes, image);
+			const uint64_t start = nes.cpu.cycles;
+
+			cpu_exec_batch(&nes.cpu, 5);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8009);
+			Assert::IsTrue(nes.cpu.a == 0x35);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0200] == 0x35);
+			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
+			Assert::IsTrue(nes.cpu.cycles - start == 12);
+#ifdef DECODE_CACHE
+			Assert::IsTrue(nes.cpu.fusion_hits[fusion_clc_adc_sta] == 1);
+#endif
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_fused_triple_split_at_batch_end_test)
+		{
+			nes nes;
+			byte image[MAX_MEMORY] = {};
+			load_clc_adc_sta(&nes, image);
+
+			// Two instructions are left for the triple, CLC and ADC run on their own and STA waits
+			cpu_exec_batch(&nes.cpu, 4);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8006);
+			Assert::IsTrue(nes.cpu.a == 0x35);
+			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
+			Assert::IsTrue(nes.cpu.memory.ram[0x0200] == 0x00);
+			Assert::IsTrue(nes.cpu.fusion_hits[fusion_clc_adc_sta] == 0);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_fused_ppu_status_timing_test)
+		{
+			// The same vblank wait loop with and without the decode cache
+			static nes fused;
+			static nes reference;
+			static byte image[MAX_MEMORY];
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// INX
+			image[0x8000] = 0xE8;
+
+			// LDA $2002
+			image[0x8001] = 0xAD;
+			image[0x8002] = 0x02;
+			image[0x8003] = 0x20;
+
+			// BPL $8000
+			image[0x8004] = 0x10;
+			image[0x8005] = 0xFA;
+
+			for (nes* machine : { &fused, &reference })
+			{
+				cpu_clear_memory(&machine->cpu);
+				cpu_load_image(&machine->cpu, image);
+				machine->cpu.controller = &machine->controller;
+				cpu_init(&machine->cpu, 0x8000);
+			}
+			cpu_decode_prg_rom(&fused.cpu);
+
+			// A loop iteration is INX and the pair, so batches of 3 never split it
+			while (fused.cpu.pc != 0x8006)
+			{
+				cpu_exec_batch(&fused.cpu, 3);
+			}
+			while (reference.cpu.pc != 0x8006)
+			{
+				cpu_exec_batch(&reference.cpu, 1);
+			}
+
+			// LDA $2002 caught the PPU up to the same cycle and saw vblank start on the same iteration
+			Assert::IsTrue(fused.cpu.ppu.clock == reference.cpu.ppu.clock);
+			Assert::IsTrue(fused.cpu.cycles == reference.cpu.cycles);
+			Assert::IsTrue(fused.cpu.x == reference.cpu.x);
+			Assert::IsTrue(fused.cpu.a == reference.cpu.a);
+			Assert::IsTrue(fused.cpu.p == reference.cpu.p);
+			Assert::IsTrue(cpu_get_n_flag(&fused.cpu) == cpu_get_n_flag(&reference.cpu));
+			Assert::IsTrue(cpu_get_z_flag(&fused.cpu) == cpu_get_z_flag(&reference.cpu));
+#ifdef DECODE_CACHE
+			Assert::IsTrue(fused.cpu.fusion_hits[fusion_lda_ppu_status_bpl] > 0);
+#endif
+
+			cpu_free(&fused.cpu);
+			cpu_free(&reference.cpu);
+		}
+
+		TEST_METHOD(cpu_fetch_window_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0xFD;
+			image[0xFFFD] = 0x07;
+
+			// INX at $0802, behind the instruction that leaves RAM
+			image[0x0802] = 0xE8;
+
+			cpu_init(&nes.cpu, 0x8000);
+
+			// LDA #$42
+			nes.cpu.memory.ram[0x07FD] = 0xA9;
+			nes.cpu.memory.ram[0x07FE] = 0x42;
+
+			// LDA $0300, the operand is in the image past the end of RAM
+			nes.cpu.memory.ram[0x07FF] = 0xAD;
+			image[0x0800] = 0x00;
+			image[0x0801] = 0x03;
+			nes.cpu.memory.ram[0x0300] = 0x99;
+
+			cpu_exec_batch(&nes.cpu, 1);
+			Assert::IsTrue(nes.cpu.a == 0x42);
+
+			cpu_exec_batch(&nes.cpu, 2);
+			Assert::IsTrue(nes.cpu.pc == 0x0803);
+			Assert::IsTrue(nes.cpu.a == 0x99);
+			Assert::IsTrue(nes.cpu.x == 0x01);
+		}
+
+		TEST_METHOD(cpu_cycles_page_cross_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDX #$01
+			image[0x8000] = 0xA2;
+			image[0x8001] = 0x01;
+
+			// LDA $80FF,X
+			image[0x8002] = 0xBD;
+			image[0x8003] = 0xFF;
+			image[0x8004] = 0x80;
+
+			// LDA $8000,X
+			image[0x8005] = 0xBD;
+			image[0x8006] = 0x00;
+			image[0x8007] = 0x80;
+
+			cpu_init(&nes.cpu, 0x8000);
+			Assert::IsTrue(nes.cpu.cycles == 7);
+
+			cpu_exec_batch(&nes.cpu, 1);
+			Assert::IsTrue(nes.cpu.cycles == 9);
+
+			cpu_exec_batch(&nes.cpu, 1);
+			Assert::IsTrue(nes.cpu.cycles == 14);
+
+			cpu_exec_batch(&nes.cpu, 1);
+			Assert::IsTrue(nes.cpu.cycles == 18);
+		}
+
+		TEST_METHOD(cpu_cycles_branch_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0xFA;
+			image[0xFFFD] = 0x80;
+
+			// CLC
+			image[0x80FA] = 0x18;
+
+			// BCS $810D, not taken
+			image[0x80FB] = 0xB0;
+			image[0x80FC] = 0x10;
+
+			// BCC $8101, taken into the next page
+			image[0x80FD] = 0x90;
+			image[0x80FE] = 0x02;
+
+			// BCC $8100, taken within the page
+			image[0x8101] = 0x90;
+			image[0x8102] = 0xFD;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_exec_batch(&nes.cpu, 4);
+
+			Assert::IsTrue(nes.cpu.pc == 0x8100);
+			Assert::IsTrue(nes.cpu.cycles == 7 + 2 + 2 + 4 + 3);
+		}
+
+		TEST_METHOD(cpu_unofficial_opcodes_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LAX $10
+			image[0x8000] = 0xA7;
+			image[0x8001] = 0x10;
+
+			// SLO $11
+			image[0x8002] = 0x07;
+			image[0x8003] = 0x11;
+
+			// DCP $12
+			image[0x8004] = 0xC7;
+			image[0x8005] = 0x12;
+
+			// SAX $13
+			image[0x8006] = 0x87;
+			image[0x8007] = 0x13;
+
+			// NOP $12F0,X, crosses into the next page
+			image[0x8008] = 0x3C;
+			image[0x8009] = 0xF0;
+			image[0x800A] = 0x12;
+
+			cpu_init(&nes.cpu, 0x8000);
+			nes.cpu.memory.ram[0x10] = 0x81;
+			nes.cpu.memory.ram[0x11] = 0x40;
+			nes.cpu.memory.ram[0x12] = 0x82;
+
+			cpu_exec_batch(&nes.cpu, 5);
+
+			Assert::IsTrue(nes.cpu.pc == 0x800B);
+			Assert::IsTrue(nes.cpu.a == 0x81);
+			Assert::IsTrue(nes.cpu.x == 0x81);
+			Assert::IsTrue(nes.cpu.memory.ram[0x11] == 0x80);
+			Assert::IsTrue(nes.cpu.memory.ram[0x12] == 0x81);
+			Assert::IsTrue(nes.cpu.memory.ram[0x13] == 0x81);
+			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
+			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
+			Assert::IsTrue(nes.cpu.cycles == 7 + 3 + 5 + 5 + 3 + 5);
+		}
+
+		TEST_METHOD(cpu_oam_dma_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			for (int i = 0; i < OAM_SIZE; i++)
+			{
+				nes.cpu.memory.ram[0x0200 + i] = (byte)(i ^ 0x5A);
+			}
+
+			// LDA #$02
+			image[0x8000] = 0xA9;
+			image[0x8001] = 0x02;
+
+			// STA $4014
+			image[0x8002] = 0x8D;
+			image[0x8003] = 0x14;
+			image[0x8004] = 0x40;
+
+			// STA $10
+			image[0x8005] = 0x85;
+			image[0x8006] = 0x10;
+
+			// STA $4014
+			image[0x8007] = 0x8D;
+			image[0x8008] = 0x14;
+			image[0x8009] = 0x40;
+
+			cpu_init(&nes.cpu, 0x8000);
+
+			// The first DMA starts on an odd cycle and waits one more
+			cpu_exec_batch(&nes.cpu, 2);
+			Assert::IsTrue(nes.cpu.cycles == 13 + 514);
+			for (int i = 0; i < OAM_SIZE; i++)
+			{
+				Assert::IsTrue(nes.cpu.ppu.oam.data[i] == (byte)(i ^ 0x5A));
+			}
+
+			cpu_exec_batch(&nes.cpu, 2);
+			Assert::IsTrue(nes.cpu.cycles == 13 + 514 + 7 + 513);
+		}
+
+		TEST_METHOD(cpu_memory_mirroring_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte prg_rom[0x4000] = {};
+			cpu_load_cartridge(&nes.cpu, prg_rom, sizeof(prg_rom), NULL);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			prg_rom[0x3FFC] = 0x00;
+			prg_rom[0x3FFD] = 0x80;
+			prg_rom[0x0000] = 0xEA;
+
+			cpu_init(&nes.cpu, sizeof(prg_rom));
+
+			// 16KB of PRG-ROM show up at $8000 and $C000, and can't be written
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, 0xC000) == 0xEA);
+			cpu_write_bus(&nes.cpu, 0xC000, 0x00);
+			Assert::IsTrue(prg_rom[0x0000] == 0xEA);
+
+			// RAM repeats every 2KB up to $1FFF
+			cpu_write_bus(&nes.cpu, 0x0812, 0x34);
+			Assert::IsTrue(nes.cpu.memory.ram[0x12] == 0x34);
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, 0x1812) == 0x34);
+
+			// Without PRG-RAM nothing is stored at $6000, reads see the open bus
+			cpu_write_bus(&nes.cpu, 0x6000, 0x56);
+#ifdef BUS_ACCURATE
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, 0x6000) == 0x56);
+#else
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, 0x6000) == 0x00);
+#endif
+
+			// The PPU registers repeat every 8 bytes up to $3FFF
+			cpu_write_bus(&nes.cpu, 0x3FFE, 0x21);
+			cpu_write_bus(&nes.cpu, 0x3FFE, 0x08);
+			cpu_write_bus(&nes.cpu, 0x2007, 0x78);
+			Assert::IsTrue(ppu_read_vram(&nes.cpu.ppu, 0x2108) == 0x78);
+
+			// With horizontal mirroring $2400 shows the name table at $2000
+			Assert::IsTrue(ppu_read_vram(&nes.cpu.ppu, 0x2508) == 0x78);
+		}
+
+		TEST_METHOD(cpu_ppu_register_reads_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte prg_rom[0x4000] = {};
+			cpu_load_cartridge(&nes.cpu, prg_rom, sizeof(prg_rom), NULL);
+			nes.cpu.controller = &nes.controller;
+			cpu_init(&nes.cpu, sizeof(prg_rom));
+
+			// Reading PPU_STATUS clears the vblank flag
+			nes.cpu.ppu.registers.ppu_status = 0x80;
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, PPU_STATUS) == 0x80);
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, PPU_STATUS) == 0x00);
+
+			ppu_write_vram(&nes.cpu.ppu, 0x2000, 0x11);
+			ppu_write_vram(&nes.cpu.ppu, 0x2001, 0x22);
+			ppu_write_vram(&nes.cpu.ppu, 0x3F00, 0x0F);
+
+			// A single write to PPU_ADDR leaves the address alone
+			cpu_write_bus(&nes.cpu, PPU_ADDR, 0x20);
+			Assert::IsTrue(nes.cpu.ppu.ppu_data_addr == 0x0000);
+			cpu_write_bus(&nes.cpu, PPU_ADDR, 0x00);
+			Assert::IsTrue(nes.cpu.ppu.ppu_data_addr == 0x2000);
+
+			// Name table reads are a read behind
+			cpu_read_bus(&nes.cpu, PPU_DATA);
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, PPU_DATA) == 0x11);
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, PPU_DATA) == 0x22);
+
+			// Palette reads are not
+			cpu_write_bus(&nes.cpu, PPU_ADDR, 0x3F);
+			cpu_write_bus(&nes.cpu, PPU_ADDR, 0x00);
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, PPU_DATA) == 0x0F);
+
+			// OAM_DATA writes move OAM_ADDR along
+			cpu_write_bus(&nes.cpu, OAM_ADDR, 0x10);
+			cpu_write_bus(&nes.cpu, OAM_DATA, 0x33);
+			cpu_write_bus(&nes.cpu, OAM_DATA, 0x44);
+			Assert::IsTrue(nes.cpu.ppu.oam.data[0x11] == 0x44);
+			Assert::IsTrue(cpu_read_bus(&nes.cpu, OAM_DATA) == 0x00);
+		}
+
+		TEST_METHOD(cpu_ppu_scroll_registers_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte prg_rom[0x4000] = {};
+			cpu_load_cartridge(&nes.cpu, prg_rom, sizeof(prg_rom), NULL);
+			nes.cpu.controller = &nes.controller;
+			cpu_init(&nes.cpu, sizeof(prg_rom));
+
+			// PPU_CTRL picks the name table in t
+			cpu_write_bus(&nes.cpu, PPU_CTRL, 0x03);
+			Assert::IsTrue(nes.cpu.ppu.ppu_temp_addr == 0x0C00);
+			cpu_write_bus(&nes.cpu, PPU_CTRL, 0x00);
+
+			// X, then Y
+			cpu_read_bus(&nes.cpu, PPU_STATUS);
+			cpu_write_bus(&nes.cpu, PPU_SCROLL, 0x7D);
+			Assert::IsTrue(nes.cpu.ppu.ppu_temp_addr == 0x000F);
+			Assert::IsTrue(nes.cpu.ppu.fine_x == 0x05);
+			cpu_write_bus(&nes.cpu, PPU_SCROLL, 0x5E);
+			Assert::IsTrue(nes.cpu.ppu.ppu_temp_addr == 0x616F);
+
+			// PPU_ADDR shares t with the scroll, v only changes with the second write
+			cpu_write_bus(&nes.cpu, PPU_ADDR, 0x3D);
+			Assert::IsTrue(nes.cpu.ppu.ppu_temp_addr == 0x3D6F);
+			Assert::IsTrue(nes.cpu.ppu.ppu_data_addr == 0x0000);
+			cpu_write_bus(&nes.cpu, PPU_ADDR, 0xF0);
+			Assert::IsTrue(nes.cpu.ppu.ppu_temp_addr == 0x3DF0);
+			Assert::IsTrue(nes.cpu.ppu.ppu_data_addr == 0x3DF0);
+			Assert::IsTrue(nes.cpu.ppu.fine_x == 0x05);
+		}
+
+#ifdef BUS_ACCURATE
+		TEST_METHOD(cpu_bus_accurate_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte prg_rom[0x4000] = {};
+			cpu_load_cartridge(&nes.cpu, prg_rom, sizeof(prg_rom), NULL);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			prg_rom[0x3FFC] = 0x00;
+			prg_rom[0x3FFD] = 0x80;
+
+			// LDX #$10
+			prg_rom[0x0000] = 0xA2;
+			prg_rom[0x0001] = 0x10;
+
+			// LDA $20F2,X reads PPU_STATUS at $2002 before its mirror at $2102
+			prg_rom[0x0002] = 0xBD;
+			prg_rom[0x0003] = 0xF2;
+			prg_rom[0x0004] = 0x20;
+
+			// INC $2007 reads PPU_DATA once and writes it twice
+			prg_rom[0x0005] = 0xEE;
+			prg_rom[0x0006] = 0x07;
+			prg_rom[0x0007] = 0x20;
+
+			// LDA $5000 reads open bus, the last operand byte
+			prg_rom[0x0008] = 0xAD;
+			prg_rom[0x0009] = 0x00;
+			prg_rom[0x000A] = 0x50;
+
+			cpu_init(&nes.cpu, sizeof(prg_rom));
+			nes.cpu.ppu.registers.ppu_status = 0x80;
+
+			cpu_exec_batch(&nes.cpu, 2);
+			Assert::IsTrue(nes.cpu.a == 0x00);
+
+			cpu_exec_batch(&nes.cpu, 1);
+			Assert::IsTrue(nes.cpu.ppu.ppu_data_addr == 3);
+
+			cpu_exec_batch(&nes.cpu, 1);
+			Assert::IsTrue(nes.cpu.a == 0x50);
+		}
+#endif
+
+		TEST_METHOD(cpu_run_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// DEX
+			image[0x8000] = 0xCA;
+
+			// BNE $8000
+			image[0x8001] = 0xD0;
+			image[0x8002] = 0xFD;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_decode_prg_rom(&nes.cpu);
+
+			// 20 loops of 5 cycles
+			Assert::IsTrue(cpu_run(&nes.cpu, 100) == run_budget_spent);
+			Assert::IsTrue(nes.cpu.cycles == 7 + 100);
+			Assert::IsTrue(nes.cpu.x == 0xEC);
+			Assert::IsTrue(nes.cpu.pc == 0x8000);
+
+			// The event comes before the end of the budget
+			nes.cpu.event_cycle = nes.cpu.cycles + 50;
+			Assert::IsTrue(cpu_run(&nes.cpu, 100) == run_event_reached);
+			Assert::IsTrue(nes.cpu.cycles == 7 + 150);
+			Assert::IsTrue(nes.cpu.x == 0xE2);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_nmi_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset and NMI vectors
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+			image[0xFFFA] = 0x00;
+			image[0xFFFB] = 0x90;
+
+			// JMP $8000
+			image[0x8000] = 0x4C;
+			image[0x8001] = 0x00;
+			image[0x8002] = 0x80;
+
+			// INC $10
+			image[0x9000] = 0xE6;
+			image[0x9001] = 0x10;
+
+			// RTI
+			image[0x9002] = 0x40;
+
+			cpu_init(&nes.cpu, 0x8000);
+
+			// NMI enabled outside of vblank
+			cpu_write_bus(&nes.cpu, PPU_CTRL, 0x80);
+			cpu_run(&nes.cpu, 100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+
+			// Taken once when vblank starts, with the status pushed without B
+			nes.cpu.event_cycle = cpu_next_vblank_cycle(&nes.cpu);
+			while (cpu_run(&nes.cpu, 30000) != run_event_reached)
+			{
+			}
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+			cpu_sync_ppu(&nes.cpu);
+			Assert::IsTrue(nes.cpu.ppu.registers.ppu_status & VBLANK_FLAG);
+			nes.cpu.event_cycle = UINT64_MAX;
+			cpu_run(&nes.cpu, 100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 1);
+			Assert::IsTrue(nes.cpu.memory.ram[0x1FF] == 0x80);
+			Assert::IsTrue(nes.cpu.memory.ram[0x1FD] == UNUSED_FLAG);
+			Assert::IsTrue(nes.cpu.pc >= 0x8000 && nes.cpu.pc <= 0x8002);
+
+			// The line is already up
+			cpu_sync_ppu(&nes.cpu);
+			cpu_run(&nes.cpu, 100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 1);
+
+			// Enabling NMI again during vblank raises it
+			cpu_write_bus(&nes.cpu, PPU_CTRL, 0x00);
+			cpu_write_bus(&nes.cpu, PPU_CTRL, 0x80);
+			cpu_run(&nes.cpu, 100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 2);
+
+			// Reading PPU_STATUS ends vblank for the line
+			cpu_read_bus(&nes.cpu, PPU_STATUS);
+			Assert::IsFalse(nes.cpu.nmi_line);
+
+			// The next vblank raises it again
+			nes.cpu.event_cycle = cpu_next_vblank_cycle(&nes.cpu);
+			while (cpu_run(&nes.cpu, 30000) != run_event_reached)
 			{
-				Assert::IsTrue(cpu.memory.data[i] == 0x00);
 			}
+			cpu_sync_ppu(&nes.cpu);
+			nes.cpu.event_cycle = UINT64_MAX;
+			cpu_run(&nes.cpu, 100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 3);
+
+			// And the one after it, though no access saw the line go down in between
+			nes.cpu.event_cycle = cpu_next_vblank_cycle(&nes.cpu);
+			while (cpu_run(&nes.cpu, 30000) != run_event_reached)
+			{
+			}
+			cpu_sync_ppu(&nes.cpu);
+			nes.cpu.event_cycle = UINT64_MAX;
+			cpu_run(&nes.cpu, 100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 4);
+		}
+
+		// LDA #$80, STA $2000, then INX in a loop, with an NMI handler at $9000 that stores X in $10 and counts in $11.
+		// NMI is enabled during vblank, in the middle of the batch.
+		static void load_nmi_within_batch(nes* nes, byte* image)
+		{
+			cpu_clear_memory(&nes->cpu);
+			cpu_load_image(&nes->cpu, image);
+			nes->cpu.controller = &nes->controller;
+
+			// reset and NMI vectors
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+			image[0xFFFA] = 0x00;
+			image[0xFFFB] = 0x90;
+
+			// LDA #$80
+			image[0x8000] = 0xA9;
+			image[0x8001] = 0x80;
+
+			// STA $2000
+			image[0x8002] = 0x8D;
+			image[0x8003] = 0x00;
+			image[0x8004] = 0x20;
+
+			// INX
+			image[0x8005] = 0xE8;
+
+			// JMP $8005
+			image[0x8006] = 0x4C;
+			image[0x8007] = 0x05;
+			image[0x8008] = 0x80;
+
+			// STX $10
+			image[0x9000] = 0x86;
+			image[0x9001] = 0x10;
+
+			// INC $11
+			image[0x9002] = 0xE6;
+			image[0x9003] = 0x11;
+
+			// RTI
+			image[0x9004] = 0x40;
+
+			cpu_init(&nes->cpu, 0x8000);
+			nes->cpu.ppu.registers.ppu_status |= VBLANK_FLAG;
+			nes->cpu.event_cycle = UINT64_MAX;
+		}
+
+		// CLI, then 50 INX, with the IRQ line held and an IRQ handler at $9000 that stores X in $10
+		static void load_irq_after_cli(nes* nes, byte* image)
+		{
+			cpu_clear_memory(&nes->cpu);
+			cpu_load_image(&nes->cpu, image);
+			nes->cpu.controller = &nes->controller;
+
+			// reset and IRQ vectors
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+			image[0xFFFE] = 0x00;
+			image[0xFFFF] = 0x90;
+
+			// CLI
+			image[0x8000] = 0x58;
+
+			// INX
+			memset(&image[0x8001], 0xE8, 50);
+
+			// STX $10
+			image[0x9000] = 0x86;
+			image[0x9001] = 0x10;
+
+			// JMP $9002
+			image[0x9002] = 0x4C;
+			image[0x9003] = 0x02;
+			image[0x9004] = 0x90;
+
+			cpu_init(&nes->cpu, 0x8000);
+			cpu_set_i_flag(&nes->cpu, 1);
+			cpu_set_irq(&nes->cpu, 0x01, true);
+			nes->cpu.memory.ram[0x10] = 0xFF;
+		}
+
+		TEST_METHOD(cpu_nmi_within_batch_test)
+		{
+			nes nes;
+			byte image[MAX_MEMORY] = {};
+			load_nmi_within_batch(&nes, image);
+			cpu_decode_prg_rom(&nes.cpu);
+
+			// Raised in the middle of a batch of 142 instructions, it is taken before the INX that follows the write
+			cpu_run(&nes.cpu, 1000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x11] == 1);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+			Assert::IsTrue(nes.cpu.x > 0);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_irq_after_cli_test)
+		{
+			nes nes;
+			byte image[MAX_MEMORY] = {};
+			load_irq_after_cli(&nes, image);
+			cpu_decode_prg_rom(&nes.cpu);
+
+			// Taken right after CLI, before the first INX
+			cpu_exec_batch(&nes.cpu, 40);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+			Assert::IsTrue(nes.cpu.pc == 0x9002);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_irq_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset and IRQ vectors
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+			image[0xFFFE] = 0x00;
+			image[0xFFFF] = 0x90;
+
+			// SEI
+			image[0x8000] = 0x78;
+
+			// DEX
+			image[0x8001] = 0xCA;
+
+			// BNE $8001
+			image[0x8002] = 0xD0;
+			image[0x8003] = 0xFD;
+
+			// CLI
+			image[0x8004] = 0x58;
+
+			// JMP $8005
+			image[0x8005] = 0x4C;
+			image[0x8006] = 0x05;
+			image[0x8007] = 0x80;
+
+			// INC $10
+			image[0x9000] = 0xE6;
+			image[0x9001] = 0x10;
+
+			// JMP $9002
+			image[0x9002] = 0x4C;
+			image[0x9003] = 0x02;
+			image[0x9004] = 0x90;
+
+			cpu_init(&nes.cpu, 0x8000);
+			cpu_exec_batch(&nes.cpu, 1);
+			cpu_set_irq(&nes.cpu, 0x01, true);
+
+			// Masked while the loop runs with I set
+			cpu_run(&nes.cpu, 200);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+			Assert::IsTrue(nes.cpu.interrupts == INTERRUPT_IRQ);
+
+			// Taken after CLI
+			cpu_run(&nes.cpu, 2000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 1);
+			Assert::IsTrue(nes.cpu.pc == 0x9002);
+			Assert::IsTrue(cpu_get_i_flag(&nes.cpu));
+			Assert::IsTrue((nes.cpu.memory.ram[0x1FD] & (B_FLAG | I_FLAG)) == 0);
+
+			// The request goes once the last device lets go of the line
+			cpu_set_irq(&nes.cpu, 0x02, true);
+			cpu_set_irq(&nes.cpu, 0x01, false);
+			Assert::IsTrue(nes.cpu.interrupts == INTERRUPT_IRQ);
+			cpu_set_irq(&nes.cpu, 0x02, false);
+			Assert::IsTrue(nes.cpu.interrupts == 0);
+		}
+
+		TEST_METHOD(cpu_idle_loop_test)
+		{
+			nes reference;
+			nes nes;
+			byte images[2][MAX_MEMORY] = {};
+
+			for (auto machine : { &nes, &reference })
+			{
+				byte* image = images[machine == &nes ? 0 : 1];
+				cpu_clear_memory(&machine->cpu);
+				cpu_load_image(&machine->cpu, image);
+				machine->cpu.controller = &machine->controller;
+
+				// reset vector
+				image[0xFFFC] = 0x00;
+				image[0xFFFD] = 0x80;
+
+				// BIT $2002
+				image[0x8000] = 0x2C;
+				image[0x8001] = 0x02;
+				image[0x8002] = 0x20;
+
+				// BPL $8000
+				image[0x8003] = 0x10;
+				image[0x8004] = 0xFB;
+
+				// JMP $8005
+				image[0x8005] = 0x4C;
+				image[0x8006] = 0x05;
+				image[0x8007] = 0x80;
+
+				cpu_init(&machine->cpu, 0x8000);
+			}
+
+			// Only the first one skips, the reference runs every iteration
+			Assert::AreEqual(2, (int)cpu_idle_loop_length(&nes.cpu, 0x8000));
+			cpu_decode_prg_rom(&nes.cpu);
+
+			for (auto machine : { &nes, &reference })
+			{
+				machine->cpu.ppu.ppu_latch = true;
+				machine->cpu.event_cycle = machine->cpu.cycles + 1000;
+				Assert::IsTrue(cpu_run(&machine->cpu, 2000) == run_event_reached);
+			}
+
+#ifdef DECODE_CACHE
+			Assert::IsTrue(nes.cpu.idle_cycles > 0);
+#endif
+			Assert::IsTrue(reference.cpu.idle_cycles == 0);
+			Assert::IsTrue(nes.cpu.cycles == reference.cpu.cycles);
+			Assert::IsTrue(nes.cpu.pc == reference.cpu.pc);
+			Assert::IsTrue(nes.cpu.p == reference.cpu.p);
+			Assert::IsFalse(nes.cpu.ppu.ppu_latch);
+
+			// The skipped iterations stop short of the start of vblank, both leave the loop in the same iteration
+			const uint64_t vblank = cpu_next_vblank_cycle(&nes.cpu);
+			for (auto machine : { &nes, &reference })
+			{
+				machine->cpu.event_cycle = vblank + 100;
+				while (cpu_run(&machine->cpu, 30000) != run_event_reached)
+				{
+				}
+				Assert::IsTrue(machine->cpu.pc == 0x8005);
+			}
+			Assert::IsTrue(nes.cpu.cycles == reference.cpu.cycles);
+			Assert::IsTrue(nes.cpu.ppu.frames == 1);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_recompile_prg_rom_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDX #$00
+			image[0x8000] = 0xA2;
+			image[0x8001] = 0x00;
+
+			// INX
+			image[0x8002] = 0xE8;
+
+			// BNE $8002
+			image[0x8003] = 0xD0;
+			image[0x8004] = 0xFD;
+
+			// JMP ($0200), left to the interpreter at run time
+			image[0x8005] = 0x6C;
+			image[0x8006] = 0x00;
+			image[0x8007] = 0x02;
+
+			// NOP, never reached
+			image[0x8008] = 0xEA;
+
+			cpu_init(&nes.cpu, 0x8000);
+
+			FILE* out = tmpfile();
+			Assert::IsNotNull(out);
+			Assert::AreEqual(3, recompile_prg_rom(&nes.cpu, out, "test"));
+
+			std::string code;
+			char buffer[4096];
+			rewind(out);
+			for (size_t read; (read = fread(buffer, 1, sizeof(buffer), out)) > 0;)
+			{
+				code.append(buffer, read);
+			}
+			fclose(out);
+
+			Assert::IsTrue(code.find("static int block_8000(") != std::string::npos);
+			Assert::IsTrue(code.find("static int block_8002(") != std::string::npos);
+			Assert::IsTrue(code.find("static int block_8005(") != std::string::npos);
+			Assert::IsTrue(code.find("block_8008") == std::string::npos);
+			Assert::IsTrue(code.find("if (!(p & Z_FLAG))") != std::string::npos);
+			Assert::IsTrue(code.find("cpu->cycles += 4 + penalty;") != std::string::npos);
+		}
+
+		TEST_METHOD(cpu_recompile_interrupt_exit_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDA #$80
+			image[0x8000] = 0xA9;
+			image[0x8001] = 0x80;
+
+			// STA $2000
+			image[0x8002] = 0x8D;
+			image[0x8003] = 0x00;
+			image[0x8004] = 0x20;
+
+			// CLI
+			image[0x8005] = 0x58;
+
+			// INX
+			image[0x8006] = 0xE8;
+
+			// JMP $8000
+			image[0x8007] = 0x4C;
+			image[0x8008] = 0x00;
+			image[0x8009] = 0x80;
+
+			cpu_init(&nes.cpu, 0x8000);
+
+			FILE* out = tmpfile();
+			Assert::IsNotNull(out);
+			Assert::AreEqual(1, recompile_prg_rom(&nes.cpu, out, "test"));
+
+			std::string code;
+			char buffer[4096];
+			rewind(out);
+			for (size_t read; (read = fread(buffer, 1, sizeof(buffer), out)) > 0;)
+			{
+				code.append(buffer, read);
+			}
+			fclose(out);
+
+			// The block can stop after the write to PPU_CTRL and after CLI
+			Assert::IsTrue(code.find("\t\tpc = 0x8005;\n") != std::string::npos);
+			Assert::IsTrue(code.find("\t\treturn 2;\n") != std::string::npos);
+			Assert::IsTrue(code.find("\t\tpc = 0x8006;\n") != std::string::npos);
+			Assert::IsTrue(code.find("\t\treturn 3;\n") != std::string::npos);
+			Assert::IsTrue(code.find("\treturn 5;\n") != std::string::npos);
+		}
+
+#ifdef JIT
+		TEST_METHOD(cpu_jit_block_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// LDX #$05
+			image[0x8000] = 0xA2;
+			image[0x8001] = 0x05;
+
+			// LDA #$07
+			image[0x8002] = 0xA9;
+			image[0x8003] = 0x07;
+
+			// DEX
+			image[0x8004] = 0xCA;
+
+			// STA $0200,X
+			image[0x8005] = 0x9D;
+			image[0x8006] = 0x00;
+			image[0x8007] = 0x02;
+
+			// BNE $8004
+			image[0x8008] = 0xD0;
+			image[0x8009] = 0xFA;
+
+			cpu_init(&nes.cpu, 0x8000);
+			Assert::IsTrue(jit_create(&nes.cpu));
+			cpu_exec_batch(&nes.cpu, 17);
+
+			Assert::IsTrue(nes.cpu.pc == 0x800A);
+			Assert::IsTrue(nes.cpu.x == 0x00);
+			Assert::IsTrue(nes.cpu.a == 0x07);
+			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
+			for (int i = 0; i < 5; i++)
+			{
+				Assert::IsTrue(nes.cpu.memory.ram[0x0200 + i] == 0x07);
+			}
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_jit_nmi_within_batch_test)
+		{
+			nes nes;
+			byte image[MAX_MEMORY] = {};
+			load_nmi_within_batch(&nes, image);
+			Assert::IsTrue(jit_create(&nes.cpu));
+
+			// The block stops after the write that raised the NMI
+			cpu_run(&nes.cpu, 1000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x11] == 1);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+			Assert::IsTrue(nes.cpu.x > 0);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_jit_irq_after_cli_test)
+		{
+			nes nes;
+			byte image[MAX_MEMORY] = {};
+			load_irq_after_cli(&nes, image);
+			Assert::IsTrue(jit_create(&nes.cpu));
+
+			// CLI ends its block instead of running the INX after it
+			cpu_exec_batch(&nes.cpu, 40);
+			Assert::IsTrue(nes.cpu.memory.ram[0x10] == 0);
+			Assert::IsTrue(nes.cpu.pc == 0x9002);
+
+			cpu_free(&nes.cpu);
+		}
+
+		TEST_METHOD(cpu_jit_self_modifying_code_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			nes.cpu.controller = &nes.controller;
+
+			// INC $0304
+			nes.cpu.memory.ram[0x0300] = 0xEE;
+			nes.cpu.memory.ram[0x0301] = 0x04;
+			nes.cpu.memory.ram[0x0302] = 0x03;
+
+			// LDA #$00, the operand is changed by the INC above
+			nes.cpu.memory.ram[0x0303] = 0xA9;
+			nes.cpu.memory.ram[0x0304] = 0x00;
+
+			// JMP $0300
+			nes.cpu.memory.ram[0x0305] = 0x4C;
+			nes.cpu.memory.ram[0x0306] = 0x00;
+			nes.cpu.memory.ram[0x0307] = 0x03;
+
+			cpu_init(&nes.cpu, 0x8000);
+			nes.cpu.pc = 0x0300;
+			Assert::IsTrue(jit_create(&nes.cpu));
+			cpu_exec_batch(&nes.cpu, 9);
+
+			Assert::IsTrue(nes.cpu.pc == 0x0300);
+			Assert::IsTrue(nes.cpu.a == 0x03);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0304] == 0x03);
+
+			cpu_free(&nes.cpu);
 		}
-		
+#endif
 	};
 }
 
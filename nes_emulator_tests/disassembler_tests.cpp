@@ -0,0 +1,119 @@
+#include "pch.h"
+
+#include "CppUnitTest.h"
+
+#include <string>
+
+extern "C" {
+#include "../nes_emulator/cpu.h"
+#include "../nes_emulator/disassembler.h"
+#include "../nes_emulator/nes.h"
+}
+
+#pragma warning( push )
+#pragma warning( disable : 6262)
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace nes_emulator_tests
+{
+	TEST_CLASS(disassembler_tests)
+	{
+	public:
+
+		TEST_METHOD(disassemble_address_modes_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+
+			// LDA $0200,X
+			image[0x8000] = 0xBD;
+			image[0x8001] = 0x00;
+			image[0x8002] = 0x02;
+
+			// BNE $8000
+			image[0x8003] = 0xD0;
+			image[0x8004] = 0xFB;
+
+			// STA ($10),Y
+			image[0x8005] = 0x91;
+			image[0x8006] = 0x10;
+
+			// ROL A
+			image[0x8007] = 0x2A;
+
+			// JMP ($1234)
+			image[0x8008] = 0x6C;
+			image[0x8009] = 0x34;
+			image[0x800A] = 0x12;
+
+			char buffer[32];
+			Assert::IsTrue(disassemble(&nes.cpu, 0x8000, buffer, sizeof(buffer)) == 3);
+			Assert::IsTrue(std::string(buffer) == "LDA $0200,X");
+			Assert::IsTrue(disassemble(&nes.cpu, 0x8003, buffer, sizeof(buffer)) == 2);
+			Assert::IsTrue(std::string(buffer) == "BNE $8000");
+			Assert::IsTrue(disassemble(&nes.cpu, 0x8005, buffer, sizeof(buffer)) == 2);
+			Assert::IsTrue(std::string(buffer) == "STA ($10),Y");
+			Assert::IsTrue(disassemble(&nes.cpu, 0x8007, buffer, sizeof(buffer)) == 1);
+			Assert::IsTrue(std::string(buffer) == "ROL A");
+			Assert::IsTrue(disassemble(&nes.cpu, 0x8008, buffer, sizeof(buffer)) == 3);
+			Assert::IsTrue(std::string(buffer) == "JMP ($1234)");
+		}
+
+		TEST_METHOD(disassemble_all_opcodes_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+
+			for (int opcode = 0; opcode < 256; opcode++)
+			{
+				image[0x8000] = (byte)opcode;
+
+				char buffer[32] = {};
+				const byte length = disassemble(&nes.cpu, 0x8000, buffer, sizeof(buffer));
+
+				Assert::IsTrue(length >= 1 && length <= 3);
+				Assert::IsTrue(std::string(buffer).size() >= 3);
+			}
+		}
+
+		TEST_METHOD(disassemble_trace_test)
+		{
+			nes nes;
+			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
+			nes.cpu.controller = &nes.controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0xC0;
+
+			// JMP $C5F5
+			image[0xC000] = 0x4C;
+			image[0xC001] = 0xF5;
+			image[0xC002] = 0xC5;
+
+			// NOP $A9, unofficial
+			image[0xC003] = 0x04;
+			image[0xC004] = 0xA9;
+
+			cpu_init(&nes.cpu, 0x8000);
+			nes.cpu.sp = 0xFD;
+			nes.cpu.p = 0x24;
+
+			char line[TRACE_LINE_SIZE];
+			disassemble_trace(&nes.cpu, 0xC000, line, sizeof(line));
+			Assert::IsTrue(std::string(line) == "C000  4C F5 C5  JMP $C5F5                       A:00 X:00 Y:00 P:24 SP:FD CYC:7");
+
+			disassemble_trace(&nes.cpu, 0xC003, line, sizeof(line));
+			Assert::IsTrue(std::string(line) == "C003  04 A9    *NOP $A9                         A:00 X:00 Y:00 P:24 SP:FD CYC:7");
+		}
+	};
+}
+
+#pragma warning( pop )
@@ -0,0 +1,114 @@
+#include "pch.h"
+
+#include "CppUnitTest.h"
+
+#include <cstring>
+
+extern "C" {
+#include "../nes_emulator/cpu.h"
+#include "../nes_emulator/hooks.h"
+#include "../nes_emulator/nes.h"
+}
+
+#pragma warning( push )
+#pragma warning( disable : 6262)
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace nes_emulator_tests
+{
+#ifdef NATIVE_HOOKS
+	TEST_CLASS(hooks_tests)
+	{
+	public:
+
+		// JSR $90F0, then JMP $8003, with the division loop of rom/division.bin ending in an RTS at $90F0.
+		// The loop crosses into the next page, so its branches take a cycle more.
+		static void load_division(nes* nes, byte* image, const word dividend, const word divisor)
+		{
+			static const byte divide[] =
+			{
+				0xA9, 0x00, 0x85, 0xFD, 0x85, 0xFE, 0xA2, 0x10, 0x06, 0xFB, 0x26, 0xFC, 0x26, 0xFD, 0x26, 0xFE,
+				0xA5, 0xFD, 0x38, 0xE5, 0x58, 0xA8, 0xA5, 0xFE, 0xE5, 0x59, 0x90, 0x06, 0x85, 0xFE, 0x84, 0xFD,
+				0xE6, 0xFB, 0xCA, 0xD0, 0xE3, 0x60
+			};
+
+			cpu_clear_memory(&nes->cpu);
+			cpu_load_image(&nes->cpu, image);
+			nes->cpu.controller = &nes->controller;
+
+			// reset vector
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
+
+			// JSR $90F0
+			image[0x8000] = 0x20;
+			image[0x8001] = 0xF0;
+			image[0x8002] = 0x90;
+
+			// JMP $8003
+			image[0x8003] = 0x4C;
+			image[0x8004] = 0x03;
+			image[0x8005] = 0x80;
+
+			memcpy(&image[0x90F0], divide, sizeof(divide));
+
+			cpu_init(&nes->cpu, 0x8000);
+			nes->cpu.memory.ram[0xFB] = dividend & 0xFF;
+			nes->cpu.memory.ram[0xFC] = dividend >> 8;
+			nes->cpu.memory.ram[0x58] = divisor & 0xFF;
+			nes->cpu.memory.ram[0x59] = divisor >> 8;
+		}
+
+		TEST_METHOD(hooks_division_test)
+		{
+			static nes interpreted, hooked;
+			static byte interpreted_image[MAX_MEMORY], hooked_image[MAX_MEMORY];
+
+			load_division(&interpreted, interpreted_image, 50000, 123);
+			load_division(&hooked, hooked_image, 50000, 123);
+			Assert::IsTrue(hooks_attach(&hooked.cpu) == 1);
+
+			// Run until both are back from the routine
+			while (interpreted.cpu.pc != 0x8003)
+			{
+				cpu_exec_batch(&interpreted.cpu, 1);
+			}
+			cpu_exec_batch(&hooked.cpu, 1);
+
+			Assert::IsTrue(hooked.cpu.pc == 0x8003);
+			Assert::IsTrue(hooked.cpu.memory.ram[0xFB] == (50000 / 123) % 256);
+			Assert::IsTrue(hooked.cpu.memory.ram[0xFD] == 50000 % 123);
+
+			Assert::IsTrue(hooked.cpu.a == interpreted.cpu.a);
+			Assert::IsTrue(hooked.cpu.x == interpreted.cpu.x);
+			Assert::IsTrue(hooked.cpu.y == interpreted.cpu.y);
+			Assert::IsTrue(hooked.cpu.p == interpreted.cpu.p);
+			Assert::IsTrue(hooked.cpu.sp == interpreted.cpu.sp);
+			Assert::IsTrue(hooked.cpu.cycles == interpreted.cpu.cycles);
+			Assert::IsTrue(memcmp(hooked.cpu.memory.ram, interpreted.cpu.memory.ram, RAM_SIZE) == 0);
+
+			cpu_free(&hooked.cpu);
+		}
+
+		TEST_METHOD(hooks_changed_code_test)
+		{
+			static nes nes;
+			static byte image[MAX_MEMORY];
+
+			load_division(&nes, image, 1000, 10);
+			Assert::IsTrue(hooks_attach(&nes.cpu) == 1);
+
+			// LDA #$00 becomes LDA #$01, the routine is no longer the one the hook replaces
+			image[0x90F1] = 0x01;
+			cpu_exec_batch(&nes.cpu, 1);
+
+			Assert::IsTrue(nes.cpu.pc == 0x90F0);
+
+			cpu_free(&nes.cpu);
+		}
+	};
+#endif
+}
+
+#pragma warning( pop )
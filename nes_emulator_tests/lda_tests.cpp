@@ -23,17 +23,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA9;
+			image[0x8000] = 0xA9;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x11;
+			image[0x8001] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA9);
@@ -49,17 +51,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA9;
+			image[0x8000] = 0xA9;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = -10;
+			image[0x8001] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA9);
@@ -75,17 +79,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA9;
+			image[0x8000] = 0xA9;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x00;
+			image[0x8001] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA9);
@@ -102,20 +108,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA5;
+			image[0x8000] = 0xA5;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = 0x11;
+			nes.cpu.memory.ram[0x0055] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA5);
@@ -131,20 +139,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA5;
+			image[0x8000] = 0xA5;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = -10;
+			nes.cpu.memory.ram[0x0055] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA5);
@@ -160,20 +170,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA5;
+			image[0x8000] = 0xA5;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = 0x00;
+			nes.cpu.memory.ram[0x0055] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA5);
@@ -190,20 +202,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB5;
+			image[0x8000] = 0xB5;
 
 			// value
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 
-			nes.cpu.memory.data[0x0065] = 0x11;
+			nes.cpu.memory.ram[0x0065] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -222,20 +236,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB5;
+			image[0x8000] = 0xB5;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0065] = -10;
+			nes.cpu.memory.ram[0x0065] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -254,20 +270,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB5;
+			image[0x8000] = 0xB5;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0065] = 0x00;
+			nes.cpu.memory.ram[0x0065] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -286,21 +304,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAD;
+			image[0x8000] = 0xAD;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = 0x11;
+			image[0x5501] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAD);
@@ -316,21 +336,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAD;
+			image[0x8000] = 0xAD;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = -10;
+			image[0x5501] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAD);
@@ -346,21 +368,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAD;
+			image[0x8000] = 0xAD;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = 0x00;
+			image[0x5501] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAD);
@@ -378,21 +402,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBD;
+			image[0x8000] = 0xBD;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x11;
+			image[0x5511] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -411,21 +437,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBD;
+			image[0x8000] = 0xBD;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = -10;
+			image[0x5511] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -444,21 +472,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBD;
+			image[0x8000] = 0xBD;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x00;
+			image[0x5511] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -478,21 +508,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB9;
+			image[0x8000] = 0xB9;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x11;
+			image[0x5511] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -511,21 +543,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB9;
+			image[0x8000] = 0xB9;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = -10;
+			image[0x5511] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -544,21 +578,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB9;
+			image[0x8000] = 0xB9;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x00;
+			image[0x5511] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -578,25 +614,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA1;
+			image[0x8000] = 0xA1;
 
 			// first part of the vector
-			nes.cpu.memory.data[0x8001] = 0x02;
+			image[0x8001] = 0x02;
 
 			// low byte
-			nes.cpu.memory.data[0x12] = 0x11;
+			nes.cpu.memory.ram[0x12] = 0x11;
 			// high byte
-			nes.cpu.memory.data[0x13] = 0x01;
+			nes.cpu.memory.ram[0x13] = 0x01;
 
 			// value
-			nes.cpu.memory.data[0x0111] = 0x11;
+			nes.cpu.memory.ram[0x0111] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -616,25 +654,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA1;
+			image[0x8000] = 0xA1;
 
 			// first part of the vector
-			nes.cpu.memory.data[0x8001] = 0x02;
+			image[0x8001] = 0x02;
 
 			// low byte
-			nes.cpu.memory.data[0x12] = 0x11;
+			nes.cpu.memory.ram[0x12] = 0x11;
 			// high byte
-			nes.cpu.memory.data[0x13] = 0x01;
+			nes.cpu.memory.ram[0x13] = 0x01;
 
 			// value
-			nes.cpu.memory.data[0x0111] = -10;
+			nes.cpu.memory.ram[0x0111] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -653,25 +693,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA1;
+			image[0x8000] = 0xA1;
 
 			// first part of the vector
-			nes.cpu.memory.data[0x8001] = 0x02;
+			image[0x8001] = 0x02;
 
 			// low byte
-			nes.cpu.memory.data[0x12] = 0x11;
+			nes.cpu.memory.ram[0x12] = 0x11;
 			// high byte
-			nes.cpu.memory.data[0x13] = 0x01;
+			nes.cpu.memory.ram[0x13] = 0x01;
 
 			// value
-			nes.cpu.memory.data[0x0111] = 0x00;
+			nes.cpu.memory.ram[0x0111] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -691,25 +733,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB1;
+			image[0x8000] = 0xB1;
 
 			// vector
-			nes.cpu.memory.data[0x8001] = 0x02;
+			image[0x8001] = 0x02;
 
 			// low byte of the address
-			nes.cpu.memory.data[0x02] = 0x11;
+			nes.cpu.memory.ram[0x02] = 0x11;
 			// high byte of the address
-			nes.cpu.memory.data[0x03] = 0x01;
+			nes.cpu.memory.ram[0x03] = 0x01;
 
 			// value
-			nes.cpu.memory.data[0x0121] = 0x11;
+			nes.cpu.memory.ram[0x0121] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -729,25 +773,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB1;
+			image[0x8000] = 0xB1;
 
 			// vector
-			nes.cpu.memory.data[0x8001] = 0x02;
+			image[0x8001] = 0x02;
 
 			// low byte of the address
-			nes.cpu.memory.data[0x02] = 0x11;
+			nes.cpu.memory.ram[0x02] = 0x11;
 			// high byte of the address
-			nes.cpu.memory.data[0x03] = 0x01;
+			nes.cpu.memory.ram[0x03] = 0x01;
 
 			// value
-			nes.cpu.memory.data[0x0121] = -10;
+			nes.cpu.memory.ram[0x0121] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -766,25 +812,27 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB1;
+			image[0x8000] = 0xB1;
 
 			// vector
-			nes.cpu.memory.data[0x8001] = 0x02;
+			image[0x8001] = 0x02;
 
 			// low byte of the address
-			nes.cpu.memory.data[0x02] = 0x11;
+			nes.cpu.memory.ram[0x02] = 0x11;
 			// high byte of the address
-			nes.cpu.memory.data[0x03] = 0x01;
+			nes.cpu.memory.ram[0x03] = 0x01;
 
 			// value
-			nes.cpu.memory.data[0x0121] = 0x00;
+			nes.cpu.memory.ram[0x0121] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -21,17 +21,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA2;
+			image[0x8000] = 0xA2;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x11;
+			image[0x8001] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA2);
@@ -47,17 +49,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA2;
+			image[0x8000] = 0xA2;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = -10;
+			image[0x8001] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA2);
@@ -73,17 +77,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA2;
+			image[0x8000] = 0xA2;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x00;
+			image[0x8001] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA2);
@@ -100,20 +106,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA6;
+			image[0x8000] = 0xA6;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = 0x11;
+			nes.cpu.memory.ram[0x0055] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA6);
@@ -129,20 +137,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA6;
+			image[0x8000] = 0xA6;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = -10;
+			nes.cpu.memory.ram[0x0055] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA6);
@@ -158,20 +168,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA6;
+			image[0x8000] = 0xA6;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = 0x00;
+			nes.cpu.memory.ram[0x0055] = 0x00;
 
 
 			cpu_init(&nes.cpu, 0x8000);
@@ -190,20 +202,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB6;
+			image[0x8000] = 0xB6;
 
 			// value
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 
-			nes.cpu.memory.data[0x0065] = 0x11;
+			nes.cpu.memory.ram[0x0065] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -223,20 +237,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB6;
+			image[0x8000] = 0xB6;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0065] = -10;
+			nes.cpu.memory.ram[0x0065] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -256,20 +272,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB6;
+			image[0x8000] = 0xB6;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0065] = 0x00;
+			nes.cpu.memory.ram[0x0065] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -289,21 +307,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAE;
+			image[0x8000] = 0xAE;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = 0x11;
+			image[0x5501] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAE);
@@ -319,21 +339,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAE;
+			image[0x8000] = 0xAE;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = -10;
+			image[0x5501] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAE);
@@ -349,21 +371,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAE;
+			image[0x8000] = 0xAE;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = 0x00;
+			image[0x5501] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			nes.cpu.x = 0x01;
@@ -380,21 +404,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBE;
+			image[0x8000] = 0xBE;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x11;
+			image[0x5511] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -413,21 +439,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBE;
+			image[0x8000] = 0xBE;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = -10;
+			image[0x5511] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -446,21 +474,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBE;
+			image[0x8000] = 0xBE;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x00;
+			image[0x5511] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -21,17 +21,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA0;
+			image[0x8000] = 0xA0;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x11;
+			image[0x8001] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA0);
@@ -47,17 +49,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA0;
+			image[0x8000] = 0xA0;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = -10;
+			image[0x8001] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA0);
@@ -73,17 +77,19 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA0;
+			image[0x8000] = 0xA0;
 
 			// immediate value
-			nes.cpu.memory.data[0x8001] = 0x00;
+			image[0x8001] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA0);
@@ -100,20 +106,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA4;
+			image[0x8000] = 0xA4;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = 0x11;
+			nes.cpu.memory.ram[0x0055] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA4);
@@ -129,20 +137,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA4;
+			image[0x8000] = 0xA4;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = -10;
+			nes.cpu.memory.ram[0x0055] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA4);
@@ -158,20 +168,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xA4;
+			image[0x8000] = 0xA4;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0055] = 0x00;
+			nes.cpu.memory.ram[0x0055] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xA4);
@@ -188,20 +200,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB4;
+			image[0x8000] = 0xB4;
 
 			// value
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 
-			nes.cpu.memory.data[0x0065] = 0x11;
+			nes.cpu.memory.ram[0x0065] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -220,20 +234,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB4;
+			image[0x8000] = 0xB4;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0065] = -10;
+			nes.cpu.memory.ram[0x0065] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -252,20 +268,22 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xB4;
+			image[0x8000] = 0xB4;
 
 			// pointer
-			nes.cpu.memory.data[0x8001] = 0x55;
+			image[0x8001] = 0x55;
 
 			// value
-			nes.cpu.memory.data[0x0065] = 0x00;
+			nes.cpu.memory.ram[0x0065] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -284,21 +302,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAC;
+			image[0x8000] = 0xAC;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = 0x11;
+			image[0x5501] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAC);
@@ -314,21 +334,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAC;
+			image[0x8000] = 0xAC;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = -10;
+			image[0x5501] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAC);
@@ -344,21 +366,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xAC;
+			image[0x8000] = 0xAC;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5501] = 0x00;
+			image[0x5501] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 			cpu_exec(&nes.cpu, 0xAC);
@@ -374,21 +398,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBC;
+			image[0x8000] = 0xBC;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x11;
+			image[0x5511] = 0x11;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -407,21 +433,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBC;
+			image[0x8000] = 0xBC;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = -10;
+			image[0x5511] = -10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -440,21 +468,23 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0xBC;
+			image[0x8000] = 0xBC;
 
 			// low byte
-			nes.cpu.memory.data[0x8001] = 0x01;
+			image[0x8001] = 0x01;
 			// high byte
-			nes.cpu.memory.data[0x8002] = 0x55;
+			image[0x8002] = 0x55;
 			// value
-			nes.cpu.memory.data[0x5511] = 0x00;
+			image[0x5511] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -0,0 +1,242 @@
+#include "pch.h"
+
+#include "CppUnitTest.h"
+
+extern "C" {
+#include "../nes_emulator/ppu.h"
+}
+
+#pragma warning( push )
+#pragma warning( disable : 6262)
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace nes_emulator_tests
+{
+	TEST_CLASS(ppu_tests)
+	{
+	public:
+
+		// Tile 1 has the values 3 3 1 1 2 2 0 0 in its first row and 0 in the others
+		static void load_tile(ppu* ppu, byte* chr)
+		{
+			ppu->memory.chr = chr;
+			chr[0x10] = 0xF0;
+			chr[0x18] = 0xCC;
+
+			ppu->memory.palette[0x00] = 0x0F;
+			ppu->memory.palette[0x01] = 0x16;
+			ppu->memory.palette[0x02] = 0x27;
+			ppu->memory.palette[0x03] = 0x30;
+			ppu->memory.palette[0x11] = 0x01;
+			ppu->memory.palette[0x12] = 0x02;
+			ppu->memory.palette[0x13] = 0x03;
+		}
+
+		static uint32_t get_color(const byte palette_index)
+		{
+			return 0xFF000000 | ppu_colors[palette_index];
+		}
+
+		// Runs scanline y from its start through dot 257, where v moves on to the next row
+		static void run_scanline(ppu* ppu, uint32_t* framebuffer, const int y)
+		{
+			ppu->framebuffer = framebuffer;
+			ppu->scanline = (word)y;
+			ppu->dot = 0;
+			ppu_run(ppu, ppu->clock + 257);
+		}
+
+		TEST_METHOD(render_scanline_background_test)
+		{
+			static ppu ppu;
+			static byte chr[CHR_SIZE];
+			static uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+			load_tile(&ppu, chr);
+			ppu.memory.name_tables[0][0] = 1;
+			ppu.registers.ppu_mask = SHOW_BG_FLAG | SHOW_BG_LEFT_FLAG;
+
+			run_scanline(&ppu, framebuffer, 0);
+
+			const byte values[] = { 3, 3, 1, 1, 2, 2, 0, 0 };
+			for (int i = 0; i < 8; i++)
+			{
+				Assert::IsTrue(framebuffer[i] == get_color(ppu.memory.palette[values[i]]));
+			}
+			Assert::IsTrue(framebuffer[SCREEN_WIDTH - 1] == get_color(0x0F));
+
+			// v is on the next row of the same tiles
+			Assert::IsTrue(ppu.ppu_data_addr == 0x1000);
+
+			// Fine x 2 starts the scanline at the third pixel of row 0
+			ppu.ppu_data_addr = 0x0000;
+			ppu.fine_x = 2;
+			run_scanline(&ppu, framebuffer, 0);
+			Assert::IsTrue(framebuffer[0] == get_color(0x16));
+			Assert::IsTrue(framebuffer[2] == get_color(0x27));
+		}
+
+		TEST_METHOD(render_scanline_scroll_test)
+		{
+			static ppu ppu;
+			static byte chr[CHR_SIZE];
+			static uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+			load_tile(&ppu, chr);
+			ppu.memory.mirroring = mirroring_vertical;
+			ppu.memory.name_tables[1][0] = 1;
+			ppu.registers.ppu_mask = SHOW_BG_FLAG | SHOW_BG_LEFT_FLAG;
+
+			// Coarse x 31 of the name table at $2000, the next tile is the first one of $2400
+			ppu.ppu_data_addr = 0x001F;
+			ppu.ppu_temp_addr = 0x001F;
+			run_scanline(&ppu, framebuffer, 0);
+			Assert::IsTrue(framebuffer[7] == get_color(0x0F));
+			Assert::IsTrue(framebuffer[8] == get_color(0x30));
+
+			// Fine y 7 of row 29 goes on to row 0 of the name table below, coarse x comes back from t
+			ppu.ppu_data_addr = 0x73BF;
+			run_scanline(&ppu, framebuffer, 0);
+			Assert::IsTrue(ppu.ppu_data_addr == 0x081F);
+		}
+
+		TEST_METHOD(render_scanline_sprites_test)
+		{
+			static ppu ppu;
+			static byte chr[CHR_SIZE];
+			static uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+			load_tile(&ppu, chr);
+			ppu.memory.name_tables[0][31] = 1;
+			ppu.registers.ppu_mask = SHOW_BG_FLAG | SHOW_SPRITES_FLAG | SHOW_BG_LEFT_FLAG | SHOW_SPRITES_LEFT_FLAG;
+
+			// Sprite 0 a scanline below y 9, with only 4 columns on screen over the last tile of the background
+			for (int i = 0; i < OAM_SIZE; i++)
+			{
+				ppu.oam.data[i] = 0xFF;
+			}
+			ppu.oam.data[0] = 9;
+			ppu.oam.data[1] = 1;
+			ppu.oam.data[2] = 0;
+			ppu.oam.data[3] = SCREEN_WIDTH - 4;
+
+			run_scanline(&ppu, framebuffer, 9);
+			Assert::IsTrue(framebuffer[9 * SCREEN_WIDTH + SCREEN_WIDTH - 4] == get_color(0x27));
+			Assert::IsFalse(ppu.registers.ppu_status & SPRITE_0_HIT_FLAG);
+
+			ppu.ppu_data_addr = 0x0000;
+			run_scanline(&ppu, framebuffer, 10);
+			const uint32_t* line_10 = &framebuffer[10 * SCREEN_WIDTH];
+			Assert::IsTrue(line_10[SCREEN_WIDTH - 4] == get_color(0x03));
+			Assert::IsTrue(line_10[SCREEN_WIDTH - 2] == get_color(0x01));
+			Assert::IsTrue(ppu.registers.ppu_status & SPRITE_0_HIT_FLAG);
+
+			// Behind the background the sprite only shows through its transparent pixels
+			ppu.oam.data[2] = 0b00100000;
+			ppu.ppu_data_addr = 0x0000;
+			run_scanline(&ppu, framebuffer, 10);
+			Assert::IsTrue(line_10[SCREEN_WIDTH - 4] == get_color(0x27));
+			Assert::IsTrue(line_10[SCREEN_WIDTH - 2] == get_color(0x01));
+		}
+
+		TEST_METHOD(decode_chr_test)
+		{
+			static ppu ppu;
+			static byte chr[CHR_SIZE];
+			static uint32_t framebuffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+			load_tile(&ppu, chr);
+			ppu.memory.chr_writable = true;
+			ppu_decode_chr(&ppu);
+
+			// Row 0 of tile 1, and the same row flipped for sprites
+			const byte values[] = { 3, 3, 1, 1, 2, 2, 0, 0 };
+			const tile_row* row = &ppu.memory.tile_rows[8];
+			for (int i = 0; i < 8; i++)
+			{
+				Assert::IsTrue(row->pixels[i] == values[i]);
+				Assert::IsTrue(row->flipped[7 - i] == values[i]);
+			}
+
+			// Writing CHR-RAM decodes the row again, and drawing uses it
+			ppu_write_vram(&ppu, 0x0018, 0x00);
+			Assert::IsTrue(row->pixels[0] == 1);
+			Assert::IsTrue(row->pixels[4] == 0);
+
+			ppu.memory.name_tables[0][0] = 1;
+			ppu.registers.ppu_mask = SHOW_BG_FLAG | SHOW_BG_LEFT_FLAG;
+			run_scanline(&ppu, framebuffer, 0);
+			Assert::IsTrue(framebuffer[0] == get_color(0x16));
+			Assert::IsTrue(framebuffer[4] == get_color(0x0F));
+
+			ppu_free(&ppu);
+		}
+
+		TEST_METHOD(ppu_run_vblank_test)
+		{
+			static ppu ppu;
+			static byte chr[CHR_SIZE];
+			load_tile(&ppu, chr);
+
+			// Vblank starts at dot 1 of scanline 241 and ends at dot 1 of the pre-render scanline
+			const uint64_t vblank = VBLANK_SCANLINE * SCANLINE_DOTS + 1;
+			Assert::IsTrue(ppu_next_vblank(&ppu) == vblank);
+			Assert::IsTrue(ppu_next_status_change(&ppu) == vblank);
+
+			ppu_run(&ppu, vblank - 1);
+			Assert::IsFalse(ppu.registers.ppu_status & VBLANK_FLAG);
+			ppu_run(&ppu, vblank);
+			Assert::IsTrue(ppu.registers.ppu_status & VBLANK_FLAG);
+			Assert::IsTrue(ppu.frames == 1);
+
+			const uint64_t vblank_end = PRE_RENDER_SCANLINE * SCANLINE_DOTS + 1;
+			Assert::IsTrue(ppu_next_status_change(&ppu) == vblank_end);
+			ppu_run(&ppu, vblank_end);
+			Assert::IsFalse(ppu.registers.ppu_status & VBLANK_FLAG);
+
+			// The next frame is odd, its pre-render scanline is a dot short while rendering
+			ppu_run(&ppu, FRAME_SCANLINES * SCANLINE_DOTS + vblank);
+			Assert::IsTrue(ppu.odd_frame);
+			ppu.registers.ppu_mask = SHOW_BG_FLAG;
+			Assert::IsTrue(ppu_next_vblank(&ppu) == 2 * FRAME_SCANLINES * SCANLINE_DOTS + vblank - 1);
+		}
+
+		TEST_METHOD(ppu_run_sprite_0_hit_test)
+		{
+			static ppu ppu;
+			static byte chr[CHR_SIZE];
+
+			// Sprite 0 on scanline 8 over the last tile of the second row of tiles, both show tile 1
+			load_tile(&ppu, chr);
+			ppu.memory.name_tables[0][63] = 1;
+			ppu.registers.ppu_mask = SHOW_BG_FLAG | SHOW_SPRITES_FLAG | SHOW_BG_LEFT_FLAG | SHOW_SPRITES_LEFT_FLAG;
+			for (int i = 0; i < OAM_SIZE; i++)
+			{
+				ppu.oam.data[i] = 0xFF;
+			}
+			ppu.oam.data[0] = 7;
+			ppu.oam.data[1] = 1;
+			ppu.oam.data[2] = 0;
+			ppu.oam.data[3] = SCREEN_WIDTH - 4;
+
+			// The scanline is drawn at its dot 1, the hit comes out at the dot of the first opaque pixel of both
+			const uint64_t draw = 8 * SCANLINE_DOTS + 1;
+			Assert::IsTrue(ppu_next_status_change(&ppu) == draw);
+			ppu_run(&ppu, draw);
+			Assert::IsFalse(ppu.registers.ppu_status & SPRITE_0_HIT_FLAG);
+
+			const uint64_t hit = 8 * SCANLINE_DOTS + SCREEN_WIDTH - 4 + 1;
+			Assert::IsTrue(ppu_next_status_change(&ppu) == hit);
+			ppu_run(&ppu, hit - 1);
+			Assert::IsFalse(ppu.registers.ppu_status & SPRITE_0_HIT_FLAG);
+			ppu_run(&ppu, hit);
+			Assert::IsTrue(ppu.registers.ppu_status & SPRITE_0_HIT_FLAG);
+
+			// Then nothing changes until vblank
+			Assert::IsTrue(ppu_next_status_change(&ppu) == VBLANK_SCANLINE * SCANLINE_DOTS + 1);
+		}
+	};
+}
+
+#pragma warning( pop )
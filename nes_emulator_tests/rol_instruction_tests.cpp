@@ -20,14 +20,16 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x2A;
+			image[0x8000] = 0x2A;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -84,27 +86,29 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x2E;
+			image[0x8000] = 0x2E;
 
 			// absolute address 0x0000
-			nes.cpu.memory.data[0x8001] = 0x00;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x00;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
-			nes.cpu.memory.data[0x0000] = 0b10000000;
+			nes.cpu.memory.ram[0x0000] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x2E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0000] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0000] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -114,12 +118,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0000] = 0b10000000;
+			nes.cpu.memory.ram[0x0000] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x2E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0000] == 0b00000001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0000] == 0b00000001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -129,12 +133,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0000] = 0b00001000;
+			nes.cpu.memory.ram[0x0000] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x2E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0000] == 0b00010001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0000] == 0b00010001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -148,28 +152,30 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x3E;
+			image[0x8000] = 0x3E;
 
 			// absolute address 0x0000
-			nes.cpu.memory.data[0x8001] = 0x00;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x00;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0001] = 0b10000000;
+			nes.cpu.memory.ram[0x0001] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x3E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0001] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0001] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -179,12 +185,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0001] = 0b10000000;
+			nes.cpu.memory.ram[0x0001] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x3E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0001] == 0b00000001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0001] == 0b00000001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -194,12 +200,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0001] = 0b00001000;
+			nes.cpu.memory.ram[0x0001] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x3E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0001] == 0b00010001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0001] == 0b00010001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -213,26 +219,28 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x26;
+			image[0x8000] = 0x26;
 
 			// zero page address 0x10
-			nes.cpu.memory.data[0x8001] = 0x10;
+			image[0x8001] = 0x10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
-			nes.cpu.memory.data[0x0010] = 0b10000000;
+			nes.cpu.memory.ram[0x0010] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x26);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0010] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0010] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -242,12 +250,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0010] = 0b10000000;
+			nes.cpu.memory.ram[0x0010] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x26);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0010] == 0b00000001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0010] == 0b00000001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -257,12 +265,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0010] = 0b00001000;
+			nes.cpu.memory.ram[0x0010] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x26);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0010] == 0b00010001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0010] == 0b00010001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -276,27 +284,29 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x36;
+			image[0x8000] = 0x36;
 
 			// zero page address 0x10
-			nes.cpu.memory.data[0x8001] = 0x10;
+			image[0x8001] = 0x10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0011] = 0b10000000;
+			nes.cpu.memory.ram[0x0011] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x36);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0011] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0011] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -306,12 +316,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0011] = 0b10000000;
+			nes.cpu.memory.ram[0x0011] = 0b10000000;
 
 			cpu_exec(&nes.cpu, 0x36);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0011] == 0b00000001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0011] == 0b00000001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -321,12 +331,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0011] = 0b00001000;
+			nes.cpu.memory.ram[0x0011] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x36);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0011] == 0b00010001);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0011] == 0b00010001);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -20,14 +20,16 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x6A;
+			image[0x8000] = 0x6A;
 
 			cpu_init(&nes.cpu, 0x8000);
 
@@ -82,27 +84,29 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x6E;
+			image[0x8000] = 0x6E;
 
 			// absolute address 0x0000
-			nes.cpu.memory.data[0x8001] = 0x00;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x00;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
-			nes.cpu.memory.data[0x0000] = 0b00000001;
+			nes.cpu.memory.ram[0x0000] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x6E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0000] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0000] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -112,12 +116,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0000] = 0b00000001;
+			nes.cpu.memory.ram[0x0000] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x6E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0000] == 0b10000000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0000] == 0b10000000);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -127,12 +131,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0000] = 0b00001000;
+			nes.cpu.memory.ram[0x0000] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x6E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0000] == 0b10000100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0000] == 0b10000100);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -146,28 +150,30 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x7E;
+			image[0x8000] = 0x7E;
 
 			// absolute address 0x0000
-			nes.cpu.memory.data[0x8001] = 0x00;
-			nes.cpu.memory.data[0x8002] = 0x00;
+			image[0x8001] = 0x00;
+			image[0x8002] = 0x00;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0001] = 0b00000001;
+			nes.cpu.memory.ram[0x0001] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x7E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0001] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0001] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -177,12 +183,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0001] = 0b00000001;
+			nes.cpu.memory.ram[0x0001] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x7E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0001] == 0b10000000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0001] == 0b10000000);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -192,12 +198,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0001] = 0b00001000;
+			nes.cpu.memory.ram[0x0001] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x7E);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8003);
-			Assert::IsTrue(nes.cpu.memory.data[0x0001] == 0b10000100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0001] == 0b10000100);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -211,26 +217,28 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x66;
+			image[0x8000] = 0x66;
 
 			// zero page address 0x10
-			nes.cpu.memory.data[0x8001] = 0x10;
+			image[0x8001] = 0x10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
-			nes.cpu.memory.data[0x0010] = 0b00000001;
+			nes.cpu.memory.ram[0x0010] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x66);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0010] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0010] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -240,12 +248,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0010] = 0b00000001;
+			nes.cpu.memory.ram[0x0010] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x66);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0010] == 0b10000000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0010] == 0b10000000);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -255,12 +263,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0010] = 0b00001000;
+			nes.cpu.memory.ram[0x0010] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x66);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0010] == 0b10000100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0010] == 0b10000100);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
@@ -274,27 +282,29 @@ namespace nes_emulator_tests
 		{
 			nes nes;
 			cpu_clear_memory(&nes.cpu);
+			byte image[MAX_MEMORY] = {};
+			cpu_load_image(&nes.cpu, image);
 			nes.cpu.controller = &nes.controller;
 
 			// reset vector
-			nes.cpu.memory.data[0xFFFC] = 0x00;
-			nes.cpu.memory.data[0xFFFD] = 0x80;
+			image[0xFFFC] = 0x00;
+			image[0xFFFD] = 0x80;
 
 			// instruction
-			nes.cpu.memory.data[0x8000] = 0x76;
+			image[0x8000] = 0x76;
 
 			// zero page address 0x10
-			nes.cpu.memory.data[0x8001] = 0x10;
+			image[0x8001] = 0x10;
 
 			cpu_init(&nes.cpu, 0x8000);
 
 			nes.cpu.x = 0x01;
-			nes.cpu.memory.data[0x0011] = 0b00000001;
+			nes.cpu.memory.ram[0x0011] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x76);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0011] == 0x00);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0011] == 0x00);
 			Assert::IsTrue(cpu_get_z_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -304,12 +314,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0011] = 0b00000001;
+			nes.cpu.memory.ram[0x0011] = 0b00000001;
 
 			cpu_exec(&nes.cpu, 0x76);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0011] == 0b10000000);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0011] == 0b10000000);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_c_flag(&nes.cpu));
@@ -319,12 +329,12 @@ namespace nes_emulator_tests
 			Assert::IsFalse(cpu_get_d_flag(&nes.cpu));
 
 			nes.cpu.pc = 0x8000;
-			nes.cpu.memory.data[0x0011] = 0b00001000;
+			nes.cpu.memory.ram[0x0011] = 0b00001000;
 
 			cpu_exec(&nes.cpu, 0x76);
 
 			Assert::IsTrue(nes.cpu.pc == 0x8002);
-			Assert::IsTrue(nes.cpu.memory.data[0x0011] == 0b10000100);
+			Assert::IsTrue(nes.cpu.memory.ram[0x0011] == 0b10000100);
 			Assert::IsFalse(cpu_get_z_flag(&nes.cpu));
 			Assert::IsTrue(cpu_get_n_flag(&nes.cpu));
 			Assert::IsFalse(cpu_get_c_flag(&nes.cpu));
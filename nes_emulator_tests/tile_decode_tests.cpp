@@ -0,0 +1,69 @@
+#include "pch.h"
+
+#include "CppUnitTest.h"
+
+#include <cstring>
+
+extern "C" {
+#include "../nes_emulator/tile_decode.h"
+}
+
+#pragma warning( push )
+#pragma warning( disable : 6262)
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace nes_emulator_tests
+{
+	TEST_CLASS(tile_decode_tests)
+	{
+	public:
+
+		TEST_METHOD(tile_decode_bit_by_bit_test)
+		{
+			// 0xF0/0xCC is 3 3 1 1 2 2 0 0, the planes swapped give 3 3 2 2 1 1 0 0
+			const byte planes_0[] = { 0xF0, 0xCC };
+			const byte planes_1[] = { 0xCC, 0xF0 };
+			const byte expected[] = { 3, 3, 1, 1, 2, 2, 0, 0, 3, 3, 2, 2, 1, 1, 0, 0 };
+			byte pixels[16];
+
+			tile_decode_kernels[0].decode(planes_0, planes_1, 2, pixels);
+			Assert::IsTrue(memcmp(pixels, expected, sizeof(expected)) == 0);
+		}
+
+		TEST_METHOD(tile_decode_kernels_test)
+		{
+			// Every pair of plane bytes once, and an odd count so the kernels also go through their tails
+			static byte planes_0[0x10000];
+			static byte planes_1[0x10000];
+			static byte expected[0x10000 * 8];
+			static byte pixels[0x10000 * 8];
+			const int count = 0x10000 - 7;
+
+			for (int i = 0; i < 0x10000; i++)
+			{
+				planes_0[i] = (byte)i;
+				planes_1[i] = (byte)(i >> 8);
+			}
+			tile_decode_kernels[0].decode(planes_0, planes_1, count, expected);
+
+			for (int i = 1; i < tile_decode_kernel_count; i++)
+			{
+				if (!tile_decode_kernels[i].supported())
+				{
+					continue;
+				}
+
+				memset(pixels, 0xFF, sizeof(pixels));
+				tile_decode_kernels[i].decode(planes_0, planes_1, count, pixels);
+				Assert::IsTrue(memcmp(pixels, expected, count * 8) == 0);
+				Assert::IsTrue(pixels[count * 8] == 0xFF);
+			}
+
+			tile_decode(planes_0, planes_1, count, pixels);
+			Assert::IsTrue(memcmp(pixels, expected, count * 8) == 0);
+		}
+	};
+}
+
+#pragma warning( pop )